@@ -5,8 +5,10 @@
  * A complete console-based hand cricket game
  * Written in pure C language
  * 
- * Compile: gcc handcricket.c -o handcricket
- * Run: ./handcricket
+ * Compile: gcc handcricket.c -o handcricket -pthread -lm
+ * Run: ./handcricket [--match-log FILE] [--no-animation]
+ *      ./handcricket --script matches.txt [--seed N] [--difficulty 1|2|3]
+ *      ./handcricket --tournament 1000000 [--threads T] [--player-strategy NAME]
  * ========================================
  */
 
@@ -15,9 +17,26 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "handcricket_matchlog.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#define write _write
+#else
+#include <unistd.h>
+#include <sys/ioctl.h>
+#endif
 
 /* ==================== CONSTANTS ==================== */
 #define MAX_HISTORY 100
+#define REPEAT_OUT_LIMIT 5
 #define EASY 1
 #define MEDIUM 2
 #define HARD 3
@@ -32,28 +51,431 @@ int same_choice_count = 0;
 int last_player_input = -1;
 int second_phase = 0;
 
-/* ==================== UTILITY FUNCTIONS ==================== */
+/* Match log (optional): every ball is appended as a fixed-size record */
+FILE *match_log = NULL;
+char match_log_buffer[65536];
+uint64_t match_key = 0;
+int match_number = 0;
 
-/* Clear screen - works on both Windows and Unix */
-void clear_screen(void) {
+/* ==================== OUTPUT BUFFER ==================== */
+/*
+ * Everything the game prints goes through this buffer and reaches stdout
+ * in one write() per flush. On a terminal the buffer is flushed once per
+ * screen; when stdout is a file or a pipe it is only flushed when it fills
+ * up or the program ends.
+ */
+#define OUT_BUFFER_SIZE 65536
+
+char out_buf[OUT_BUFFER_SIZE];
+size_t out_len = 0;
+int out_to_tty = 0;
+
+/* Write out everything buffered so far */
+void out_flush(void) {
+    size_t done = 0;
+    int n;
+    
+    while (done < out_len) {
+        n = (int)write(fileno(stdout), out_buf + done, (unsigned)(out_len - done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;      /* stdout is gone; drop the output */
+        }
+        done += n;
+    }
+    out_len = 0;
+}
+
+/* Append bytes */
+void out_write(const char *text, size_t len) {
+    size_t room;
+    
+    while (len > 0) {
+        if (out_len == OUT_BUFFER_SIZE) {
+            out_flush();
+        }
+        room = OUT_BUFFER_SIZE - out_len;
+        if (room > len) {
+            room = len;
+        }
+        memcpy(out_buf + out_len, text, room);
+        out_len += room;
+        text += room;
+        len -= room;
+    }
+}
+
+void out_puts(const char *text) {
+    out_write(text, strlen(text));
+}
+
+/* `count` copies of one character */
+void out_fill(int c, size_t count) {
+    size_t room;
+    
+    while (count > 0) {
+        if (out_len == OUT_BUFFER_SIZE) {
+            out_flush();
+        }
+        room = OUT_BUFFER_SIZE - out_len;
+        if (room > count) {
+            room = count;
+        }
+        memset(out_buf + out_len, c, room);
+        out_len += room;
+        count -= room;
+    }
+}
+
+/* printf straight into the buffer */
+void out_printf(const char *format, ...) {
+    va_list args;
+    int n;
+    
+    if (OUT_BUFFER_SIZE - out_len < 1024) {
+        out_flush();
+    }
+    va_start(args, format);
+    n = vsnprintf(out_buf + out_len, OUT_BUFFER_SIZE - out_len, format, args);
+    va_end(args);
+    if (n > 0) {
+        out_len += (size_t)n < OUT_BUFFER_SIZE - out_len ? (size_t)n : OUT_BUFFER_SIZE - out_len - 1;
+    }
+}
+
+/* A screen is complete: show it now if someone is watching */
+void out_screen_done(void) {
+    if (out_to_tty) {
+        out_flush();
+    }
+}
+
+/* ==================== TERMINAL RENDERER ==================== */
+/*
+ * Screens are drawn into an off-screen frame of text rows instead of
+ * straight to stdout. screen_present() compares the frame with what the
+ * terminal already shows and sends only the rows that changed, positioned
+ * with ANSI cursor moves, through the output buffer. When stdout is not a
+ * terminal the frame is written out as plain text instead.
+ */
+#define SCREEN_ROWS 64
+#define SCREEN_COLS 120
+
+char frame[SCREEN_ROWS][SCREEN_COLS + 1];  /* screen being built */
+char shown[SCREEN_ROWS][SCREEN_COLS + 1];  /* what the terminal shows */
+int shown_valid[SCREEN_ROWS];
+int shown_rows = 0;
+int frame_rows = 1;
+int frame_row = 0;
+int frame_col = 0;
+int plain_row = 0;      /* plain mode: how much of the frame is printed */
+int plain_col = 0;
+int screen_ansi = 0;
+int screen_started = 0;
+
+/* Decide between ANSI and plain output */
+void screen_init(void) {
+    const char *term = getenv("TERM");
+    
+    out_to_tty = isatty(fileno(stdout));
+    screen_ansi = out_to_tty && !(term != NULL && strcmp(term, "dumb") == 0);
+#ifdef _WIN32
+    if (screen_ansi) {
+        HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode = 0;
+        if (!GetConsoleMode(out, &mode) ||
+            !SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) {
+            screen_ansi = 0;
+        }
+    }
+#endif
+}
+
+/* Number of rows the terminal can show, or 0 if unknown */
+int terminal_rows(void) {
+#ifdef TIOCGWINSZ
+    struct winsize ws;
+    if (ioctl(fileno(stdout), TIOCGWINSZ, &ws) == 0) {
+        return ws.ws_row;
+    }
+#endif
+    return 0;
+}
+
+/* Add one character to the frame */
+void screen_putc(int c) {
+    if (c == '\n') {
+        if (frame_row == SCREEN_ROWS - 1) {
+            /* Out of rows: scroll the frame up by one */
+            memmove(frame[0], frame[1], sizeof(frame[0]) * (SCREEN_ROWS - 1));
+            frame[SCREEN_ROWS - 1][0] = '\0';
+            if (plain_row > 0) {
+                plain_row--;
+            }
+            memset(shown_valid, 0, sizeof(shown_valid));
+        } else {
+            frame_row++;
+        }
+        frame_col = 0;
+        frame[frame_row][0] = '\0';
+    } else if (frame_col < SCREEN_COLS) {
+        frame[frame_row][frame_col++] = (char)c;
+        frame[frame_row][frame_col] = '\0';
+    }
+    if (frame_row + 1 > frame_rows) {
+        frame_rows = frame_row + 1;
+    }
+}
+
+/* Add text to the frame, copying whole runs between newlines */
+void screen_write(const char *text, size_t len) {
+    const char *newline;
+    size_t run, copy;
+    
+    while (len > 0) {
+        newline = memchr(text, '\n', len);
+        run = newline != NULL ? (size_t)(newline - text) : len;
+        copy = run < (size_t)(SCREEN_COLS - frame_col) ? run : (size_t)(SCREEN_COLS - frame_col);
+        memcpy(&frame[frame_row][frame_col], text, copy);
+        frame_col += (int)copy;
+        frame[frame_row][frame_col] = '\0';
+        if (newline == NULL) {
+            break;
+        }
+        screen_putc('\n');
+        text += run + 1;
+        len -= run + 1;
+    }
+}
+
+void screen_puts(const char *text) {
+    screen_write(text, strlen(text));
+}
+
+/* `count` copies of one character */
+void screen_fill(int c, int count) {
+    if (count > SCREEN_COLS - frame_col) {
+        count = SCREEN_COLS - frame_col;
+    }
+    if (count > 0) {
+        memset(&frame[frame_row][frame_col], c, count);
+        frame_col += count;
+        frame[frame_row][frame_col] = '\0';
+    }
+}
+
+/* printf into the frame */
+void screen_printf(const char *format, ...) {
+    char text[1024];
+    va_list args;
+    int n;
+    
+    va_start(args, format);
+    n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    
+    if (n > 0) {
+        screen_write(text, (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1);
+    }
+}
+
+/* Send the frame to the terminal */
+void screen_present(void) {
+    int r, rows;
+    
+    if (!screen_ansi) {
+        /* Plain text: print whatever was added since the last present */
+        for (r = plain_row; r <= frame_row; r++) {
+            out_puts(frame[r] + (r == plain_row ? plain_col : 0));
+            if (r < frame_row) {
+                out_write("\n", 1);
+            }
+        }
+        plain_row = frame_row;
+        plain_col = frame_col;
+        out_screen_done();
+        return;
+    }
+    
+    /* Taller than the terminal: let it scroll, and redraw in full next time */
+    rows = terminal_rows();
+    if (rows > 0 && frame_rows > rows) {
+        out_puts("\x1b[H\x1b[2J");
+        for (r = 0; r < frame_rows; r++) {
+            if (r > 0) {
+                out_write("\r\n", 2);
+            }
+            out_puts(frame[r]);
+        }
+        out_screen_done();
+        memset(shown_valid, 0, sizeof(shown_valid));
+        screen_started = 0;
+        return;
+    }
+    
+    /* Start from a blank terminal the first time */
+    if (!screen_started) {
+        out_puts("\x1b[H\x1b[2J");
+        memset(shown_valid, 0, sizeof(shown_valid));
+        shown_rows = 0;
+        screen_started = 1;
+    }
+    
+    rows = frame_rows > shown_rows ? frame_rows : shown_rows;
+    for (r = 0; r < rows; r++) {
+        const char *line = r < frame_rows ? frame[r] : "";
+        if (shown_valid[r] && strcmp(shown[r], line) == 0) {
+            continue;
+        }
+        out_printf("\x1b[%d;1H%s\x1b[K", r + 1, line);
+        strcpy(shown[r], line);
+        shown_valid[r] = 1;
+    }
+    shown_rows = frame_rows;
+    
+    /* Leave the cursor where the next character would go */
+    out_printf("\x1b[%d;%dH", frame_row + 1, frame_col + 1);
+    out_screen_done();
+}
+
+/*
+ * The user just typed a line: the terminal echoed it and moved to the
+ * next row. Follow along in the frame and forget what we think is shown
+ * on those rows so the echo gets overwritten on the next present.
+ */
+void screen_input_done(void) {
+    int r;
+    
+    if (!screen_ansi) {
+        return;
+    }
+    for (r = frame_row; r < SCREEN_ROWS; r++) {
+        shown_valid[r] = 0;
+    }
+    screen_putc('\n');
+}
+
+/* Put the cursor below the last frame and write out everything left */
+void screen_finish(void) {
+    screen_present();
+    if (screen_ansi) {
+        out_write("\n", 1);
+    }
+    out_flush();
+}
+
+/* ==================== ANIMATION TIMING ==================== */
+/*
+ * Animations are paced by a monotonic clock: each frame has an absolute
+ * deadline and the process sleeps until it, so waiting costs no CPU and
+ * takes the same time on fast and slow machines.
+ */
+#define TOSS_FRAME_MS 350
+
+int animations_enabled = 1;
+
+/* Milliseconds from a clock that never jumps */
+long long monotonic_ms(void) {
 #ifdef _WIN32
-    system("cls");
+    return (long long)GetTickCount64();
 #else
-    system("clear");
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 #endif
 }
 
+/* Sleep until the monotonic clock reaches the deadline */
+void sleep_until_ms(long long deadline) {
+    long long remaining;
+    
+    while ((remaining = deadline - monotonic_ms()) > 0) {
+#ifdef _WIN32
+        Sleep((DWORD)remaining);
+#else
+        struct timespec ts;
+        ts.tv_sec = remaining / 1000;
+        ts.tv_nsec = (remaining % 1000) * 1000000L;
+        if (nanosleep(&ts, NULL) != 0 && errno != EINTR) {
+            break;
+        }
+#endif
+    }
+}
+
+/* Draw `frames` frames, `frame_ms` apart; instant with --no-animation */
+void animate(int frames, int frame_ms, void (*draw_frame)(int frame)) {
+    long long start = monotonic_ms();
+    int i;
+    
+    for (i = 0; i < frames; i++) {
+        draw_frame(i);
+        if (animations_enabled) {
+            screen_present();
+            sleep_until_ms(start + (long long)(i + 1) * frame_ms);
+        }
+    }
+}
+
+/* ==================== UTILITY FUNCTIONS ==================== */
+
+/* Start a new screen (redrawn in place, no shell needed) */
+void clear_screen(void) {
+    int r;
+    
+    if (!screen_ansi) {
+        /* Plain output: finish the old screen, then a blank line */
+        screen_present();
+        if (screen_started) {
+            out_write("\n", 1);
+        }
+        screen_started = 1;
+    }
+    
+    for (r = 0; r < frame_rows; r++) {
+        frame[r][0] = '\0';
+    }
+    frame_rows = 1;
+    frame_row = 0;
+    frame_col = 0;
+    plain_row = 0;
+    plain_col = 0;
+}
+
+/* Input was closed (Ctrl+D or end of a pipe): leave cleanly */
+void end_of_input(void) {
+    screen_finish();
+    if (match_log != NULL) {
+        fclose(match_log);
+    }
+    exit(0);
+}
+
 /* Pause and wait for user input */
 void pause_game(void) {
-    printf("\nPress Enter to continue...");
-    getchar();
+    screen_printf("\nPress Enter to continue...");
+    screen_present();
+    if (getchar() == EOF) {
+        end_of_input();
+    }
+    screen_input_done();
 }
 
 /* Get a single character from user (flush buffer) */
 char get_char_input(void) {
     char c;
-    scanf(" %c", &c);
-    while (getchar() != '\n'); /* Clear input buffer */
+    int next;
+    screen_present();
+    if (scanf(" %c", &c) != 1) {
+        end_of_input();
+    }
+    /* Clear input buffer */
+    do {
+        next = getchar();
+    } while (next != '\n' && next != EOF);
+    screen_input_done();
     return c;
 }
 
@@ -63,31 +485,96 @@ int get_int_input(int min, int max) {
     char buffer[100];
     
     while (1) {
-        if (fgets(buffer, sizeof(buffer), stdin) != NULL) {
-            if (sscanf(buffer, "%d", &value) == 1) {
-                if (value >= min && value <= max) {
-                    return value;
-                }
+        screen_present();
+        if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
+            end_of_input();
+        }
+        screen_input_done();
+        if (sscanf(buffer, "%d", &value) == 1) {
+            if (value >= min && value <= max) {
+                return value;
             }
         }
-        printf("Invalid input! Please enter a number between %d and %d: ", min, max);
+        screen_printf("Invalid input! Please enter a number between %d and %d: ", min, max);
     }
 }
 
 /* Print a decorative line */
 void print_line(char c, int length) {
-    for (int i = 0; i < length; i++) {
-        putchar(c);
-    }
-    putchar('\n');
+    screen_fill(c, length);
+    screen_putc('\n');
 }
 
 /* Print centered text */
 void print_centered(const char *text, int width) {
     int len = strlen(text);
     int padding = (width - len) / 2;
-    for (int i = 0; i < padding; i++) putchar(' ');
-    printf("%s\n", text);
+    screen_fill(' ', padding);
+    screen_puts(text);
+    screen_putc('\n');
+}
+
+/* ==================== MATCH LOG ==================== */
+
+/* Open (or create) a match log; stdio's buffer batches the writes */
+int open_match_log(const char *path) {
+    MatchLogHeader header;
+    
+    match_log = fopen(path, "a+b");
+    if (match_log == NULL) {
+        return 0;
+    }
+    setvbuf(match_log, match_log_buffer, _IOFBF, sizeof(match_log_buffer));
+    
+    fseek(match_log, 0, SEEK_END);
+    if (ftell(match_log) == 0) {
+        matchlog_init_header(&header);
+        fwrite(&header, sizeof(header), 1, match_log);
+        return 1;
+    }
+    
+    /* Appending to an existing log: make sure it is one */
+    rewind(match_log);
+    if (fread(&header, sizeof(header), 1, match_log) != 1 || !matchlog_header_ok(&header)) {
+        fclose(match_log);
+        match_log = NULL;
+        return 0;
+    }
+    fseek(match_log, 0, SEEK_END);
+    return 1;
+}
+
+/* Record one ball */
+void log_ball(int innings, int is_batting, int player_num, int comp_num,
+              int runs, int flags) {
+    MatchLogRecord record;
+    struct timeval tv;
+    
+    if (match_log == NULL) {
+        return;
+    }
+    
+    gettimeofday(&tv, NULL);
+    memset(&record, 0, sizeof(record));
+    record.timestamp_us = (uint64_t)tv.tv_sec * 1000000ull + (uint64_t)tv.tv_usec;
+    record.session = match_key;
+    record.innings = (uint8_t)innings;
+    record.player_number = (uint8_t)player_num;
+    record.computer_number = (uint8_t)comp_num;
+    record.runs = (uint8_t)runs;
+    record.flags = (uint8_t)(flags | (is_batting ? MATCHLOG_PLAYER_BATTING : 0));
+    record.difficulty = (uint8_t)difficulty;
+    record.source = MATCHLOG_SOURCE_CONSOLE;
+    fwrite(&record, sizeof(record), 1, match_log);
+}
+
+/* Give each match its own key in the log */
+void start_match_log(void) {
+    char id[64];
+    
+    match_number++;
+    sprintf(id, "console-%ld-%d", (long)time(NULL), match_number);
+    match_key = matchlog_key(id);
 }
 
 /* ==================== DISPLAY FUNCTIONS ==================== */
@@ -97,26 +584,26 @@ void display_header(void) {
     print_line('=', 50);
     print_centered("ODD OR EVEN HAND CRICKET GAME", 50);
     print_line('=', 50);
-    printf("\n");
+    screen_printf("\n");
 }
 
 /* Display current scores */
 void display_scores(void) {
     print_line('-', 50);
-    printf("|  YOUR SCORE: %-5d  |  COMPUTER SCORE: %-5d |\n", 
+    screen_printf("|  YOUR SCORE: %-5d  |  COMPUTER SCORE: %-5d |\n", 
            player_score, computer_score);
     print_line('-', 50);
 }
 
 /* Display difficulty level */
 void display_difficulty(void) {
-    printf("\n[Difficulty: ");
+    screen_printf("\n[Difficulty: ");
     switch (difficulty) {
-        case EASY:   printf("EASY");   break;
-        case MEDIUM: printf("MEDIUM"); break;
-        case HARD:   printf("HARD");   break;
+        case EASY:   screen_printf("EASY");   break;
+        case MEDIUM: screen_printf("MEDIUM"); break;
+        case HARD:   screen_printf("HARD");   break;
     }
-    printf("]\n");
+    screen_printf("]\n");
 }
 
 /* Display main menu */
@@ -124,18 +611,18 @@ void display_main_menu(void) {
     clear_screen();
     display_header();
     
-    printf("\n");
+    screen_printf("\n");
     print_centered("MAIN MENU", 50);
     print_line('-', 50);
-    printf("\n");
-    printf("  1. Start New Game\n");
-    printf("  2. Change Difficulty\n");
-    printf("  3. How to Play\n");
-    printf("  4. Exit\n");
-    printf("\n");
+    screen_puts("\n"
+                "  1. Start New Game\n"
+                "  2. Change Difficulty\n"
+                "  3. How to Play\n"
+                "  4. Exit\n"
+                "\n");
     display_difficulty();
     print_line('=', 50);
-    printf("\nEnter your choice (1-4): ");
+    screen_printf("\nEnter your choice (1-4): ");
 }
 
 /* Display how to play instructions */
@@ -143,29 +630,29 @@ void display_instructions(void) {
     clear_screen();
     display_header();
     
-    printf("\n");
+    screen_printf("\n");
     print_centered("HOW TO PLAY", 50);
     print_line('-', 50);
-    printf("\n");
-    printf("1. TOSS: Choose HEAD or TAILS to win the toss.\n\n");
-    printf("2. CHOICE: If you win, choose to BAT or BOWL first.\n\n");
-    printf("3. GAMEPLAY:\n");
-    printf("   - Enter a number between 0 and 10\n");
-    printf("   - Computer also picks a number (0-10)\n");
-    printf("   - If numbers match, the batsman is OUT!\n");
-    printf("   - If batting: your number adds to your score\n");
-    printf("   - If bowling: computer's number adds to its score\n\n");
-    printf("4. INNINGS:\n");
-    printf("   - After first innings, roles swap\n");
-    printf("   - Batting second? Chase the target!\n");
-    printf("   - Bowling second? Defend your score!\n\n");
-    printf("5. SPECIAL RULES:\n");
-    printf("   - If you pick 0, you get computer's number as runs\n");
-    printf("   - Don't repeat same number 5 times (you'll be OUT!)\n\n");
-    printf("6. DIFFICULTY LEVELS:\n");
-    printf("   - EASY: Computer picks randomly\n");
-    printf("   - MEDIUM: Computer sometimes predicts your moves\n");
-    printf("   - HARD: Computer analyzes your patterns!\n\n");
+    screen_puts("\n"
+                "1. TOSS: Choose HEAD or TAILS to win the toss.\n\n"
+                "2. CHOICE: If you win, choose to BAT or BOWL first.\n\n"
+                "3. GAMEPLAY:\n"
+                "   - Enter a number between 0 and 10\n"
+                "   - Computer also picks a number (0-10)\n"
+                "   - If numbers match, the batsman is OUT!\n"
+                "   - If batting: your number adds to your score\n"
+                "   - If bowling: computer's number adds to its score\n\n"
+                "4. INNINGS:\n"
+                "   - After first innings, roles swap\n"
+                "   - Batting second? Chase the target!\n"
+                "   - Bowling second? Defend your score!\n\n"
+                "5. SPECIAL RULES:\n"
+                "   - If you pick 0, you get computer's number as runs\n"
+                "   - Don't repeat same number 5 times (you'll be OUT!)\n\n"
+                "6. DIFFICULTY LEVELS:\n"
+                "   - EASY: Computer picks randomly\n"
+                "   - MEDIUM: Computer sometimes predicts your moves\n"
+                "   - HARD: Computer analyzes your patterns!\n\n");
     
     print_line('=', 50);
     pause_game();
@@ -176,60 +663,102 @@ void display_difficulty_menu(void) {
     clear_screen();
     display_header();
     
-    printf("\n");
+    screen_printf("\n");
     print_centered("SELECT DIFFICULTY", 50);
     print_line('-', 50);
-    printf("\n");
-    printf("  1. EASY   - Computer plays randomly\n");
-    printf("  2. MEDIUM - Computer sometimes predicts\n");
-    printf("  3. HARD   - Computer analyzes patterns\n");
-    printf("\n");
-    printf("Current difficulty: ");
+    screen_puts("\n"
+                "  1. EASY   - Computer plays randomly\n"
+                "  2. MEDIUM - Computer sometimes predicts\n"
+                "  3. HARD   - Computer analyzes patterns\n"
+                "\n"
+                "Current difficulty: ");
     switch (difficulty) {
-        case EASY:   printf("EASY\n");   break;
-        case MEDIUM: printf("MEDIUM\n"); break;
-        case HARD:   printf("HARD\n");   break;
+        case EASY:   screen_printf("EASY\n");   break;
+        case MEDIUM: screen_printf("MEDIUM\n"); break;
+        case HARD:   screen_printf("HARD\n");   break;
     }
-    printf("\n");
+    screen_printf("\n");
     print_line('=', 50);
-    printf("\nEnter your choice (1-3): ");
+    screen_printf("\nEnter your choice (1-3): ");
 }
 
 /* ==================== GAME LOGIC FUNCTIONS ==================== */
 
-/* Generate computer's move based on difficulty */
-int generate_computer_move(void) {
+/* Outcome of one ball */
+typedef struct {
+    int comp_num;       /* MATCHLOG_NO_NUMBER if the computer never picked */
+    int is_out;
+    int repeat_out;     /* out for repeating the same number 5 times */
+    int runs;
+    int chased;         /* second innings target reached */
+} BallResult;
+
+/* ==================== RANDOM NUMBERS ==================== */
+/*
+ * A small xorshift64* generator. Every caller owns its state, so the
+ * tournament threads each get an independent stream and --seed makes a
+ * run reproducible.
+ */
+typedef struct {
+    unsigned long long state;
+} Rng;
+
+Rng game_rng;
+
+void rng_seed(Rng *rng, unsigned long long seed) {
+    /* splitmix64 step so that nearby seeds give unrelated streams */
+    seed += 0x9E3779B97F4A7C15ull;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+    seed ^= seed >> 31;
+    rng->state = seed ? seed : 1;
+}
+
+/* Uniform number in 0 .. n-1 */
+int rng_below(Rng *rng, int n) {
+    unsigned long long x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return (int)((((x * 2685821657736338717ull) >> 32) * (unsigned long long)n) >> 32);
+}
+
+/* ==================== COMPUTER AI ==================== */
+
+/* Pick a number for a difficulty, given the opponent's moves so far */
+int choose_move(int level, const int *history, int count, Rng *rng) {
     int move;
     int i, freq[11] = {0};
     int max_freq, predicted;
     
-    switch (difficulty) {
+    switch (level) {
         case EASY:
             /* Random move */
-            move = rand() % 11;
+            move = rng_below(rng, 11);
             break;
             
         case MEDIUM:
             /* 30% chance to copy last player move, otherwise random */
-            if (rand() % 100 < 30 && move_count > 0) {
-                move = prev_moves[move_count - 1];
+            if (rng_below(rng, 100) < 30 && count > 0) {
+                move = history[count - 1];
             } else {
-                move = rand() % 11;
+                move = rng_below(rng, 11);
             }
             break;
             
         case HARD:
             /* Analyze player's move history and predict */
-            if (move_count == 0) {
-                move = rand() % 11;
+            if (count == 0) {
+                move = rng_below(rng, 11);
             } else {
                 /* Find most frequent player move */
-                for (i = 0; i < move_count; i++) {
-                    freq[prev_moves[i]]++;
+                for (i = 0; i < count; i++) {
+                    freq[history[i]]++;
                 }
                 
                 max_freq = 0;
-                predicted = rand() % 11;
+                predicted = rng_below(rng, 11);
                 
                 for (i = 0; i < 11; i++) {
                     if (freq[i] > max_freq) {
@@ -239,9 +768,9 @@ int generate_computer_move(void) {
                 }
                 
                 /* Add some variation */
-                if (rand() % 100 < 50) {
+                if (rng_below(rng, 100) < 50) {
                     move = predicted;
-                } else if (rand() % 100 < 50) {
+                } else if (rng_below(rng, 100) < 50) {
                     move = (predicted + 1) % 11;
                 } else {
                     move = (predicted + 10) % 11;
@@ -250,12 +779,42 @@ int generate_computer_move(void) {
             break;
             
         default:
-            move = rand() % 11;
+            move = rng_below(rng, 11);
     }
     
     return move;
 }
 
+/* Generate computer's move based on difficulty */
+int generate_computer_move(void) {
+    return choose_move(difficulty, prev_moves, move_count, &game_rng);
+}
+
+/*
+ * Runs off one ball, or -1 if the batsman is out. Batting humans who
+ * pick 0 take the computer's number as their runs.
+ */
+int ball_runs(int player_num, int comp_num, int player_batting) {
+    if (player_num == comp_num) {
+        return -1;
+    }
+    if (player_batting) {
+        return (player_num == 0) ? comp_num : player_num;
+    }
+    return comp_num;
+}
+
+/* Count consecutive picks of the same number; returns the run length */
+int count_repeats(int num, int *last, int *count) {
+    if (num == *last) {
+        (*count)++;
+    } else {
+        *count = 1;
+        *last = num;
+    }
+    return *count;
+}
+
 /* Reset game state for new game */
 void reset_game(void) {
     player_score = 0;
@@ -266,6 +825,75 @@ void reset_game(void) {
     second_phase = 0;
 }
 
+/* One frame of the coin flip */
+void draw_toss_frame(int frame) {
+    (void)frame;
+    screen_printf(".");
+}
+
+/*
+ * Play a single ball: the rules shared by the interactive game and
+ * scripted mode. Updates the scores, the move history and the repeat
+ * counter, and writes the ball to the match log.
+ */
+BallResult play_ball(int player_num, int is_batting, int target, int is_second_innings) {
+    BallResult ball;
+    int log_flags;
+    
+    ball.comp_num = MATCHLOG_NO_NUMBER;
+    ball.is_out = 0;
+    ball.repeat_out = 0;
+    ball.runs = 0;
+    ball.chased = 0;
+    
+    /* Check for repeated inputs */
+    if (count_repeats(player_num, &last_player_input, &same_choice_count) >= REPEAT_OUT_LIMIT &&
+        is_batting) {
+        /* Out before the computer even picks */
+        ball.is_out = 1;
+        ball.repeat_out = 1;
+        log_ball(is_second_innings + 1, is_batting, player_num, MATCHLOG_NO_NUMBER, 0,
+                 MATCHLOG_OUT | MATCHLOG_REPEAT_OUT |
+                 (is_second_innings ? MATCHLOG_GAME_OVER : 0));
+        return ball;
+    }
+    
+    /* Record move */
+    if (move_count < MAX_HISTORY) {
+        prev_moves[move_count++] = player_num;
+    }
+    
+    /* Generate computer's number */
+    ball.comp_num = generate_computer_move();
+    
+    /* Check if out, otherwise update scores */
+    ball.runs = ball_runs(player_num, ball.comp_num, is_batting);
+    ball.is_out = (ball.runs < 0);
+    if (ball.is_out) {
+        ball.runs = 0;
+    } else if (is_batting) {
+        player_score += ball.runs;
+    } else {
+        computer_score += ball.runs;
+    }
+    
+    /* Did the chasing side get there? */
+    if (is_second_innings && !ball.is_out) {
+        ball.chased = (is_batting && player_score > target) ||
+                      (!is_batting && computer_score > target);
+    }
+    
+    /* Record the ball */
+    log_flags = ball.is_out ? MATCHLOG_OUT : 0;
+    if (is_second_innings && (ball.is_out || ball.chased)) {
+        log_flags |= MATCHLOG_GAME_OVER;
+    }
+    log_ball(is_second_innings + 1, is_batting, player_num, ball.comp_num,
+             ball.runs, log_flags);
+    
+    return ball;
+}
+
 /* Perform the toss */
 int do_toss(void) {
     char player_toss;
@@ -275,43 +903,38 @@ int do_toss(void) {
     clear_screen();
     display_header();
     
-    printf("\n");
+    screen_printf("\n");
     print_centered("TOSS TIME!", 50);
     print_line('-', 50);
-    printf("\n");
-    printf("Choose: (H)ead or (T)ails? ");
+    screen_printf("\n");
+    screen_printf("Choose: (H)ead or (T)ails? ");
     
     player_toss = toupper(get_char_input());
     while (player_toss != 'H' && player_toss != 'T') {
-        printf("Invalid choice! Enter H for Head or T for Tails: ");
+        screen_printf("Invalid choice! Enter H for Head or T for Tails: ");
         player_toss = toupper(get_char_input());
     }
     
     /* Flip the coin */
-    coin = rand() % 2; /* 0 = Head, 1 = Tails */
+    coin = rng_below(&game_rng, 2); /* 0 = Head, 1 = Tails */
     
-    printf("\n");
-    printf("Flipping the coin...\n");
-    printf("\n");
+    screen_printf("\n");
+    screen_printf("Flipping the coin...\n");
+    screen_printf("\n");
     
     /* Animation effect */
-    for (int i = 0; i < 3; i++) {
-        printf(".");
-        fflush(stdout);
-        /* Simple delay */
-        for (volatile int j = 0; j < 50000000; j++);
-    }
+    animate(3, TOSS_FRAME_MS, draw_toss_frame);
     
-    printf("\n\nThe coin shows: %s!\n", coin == 0 ? "HEAD" : "TAILS");
-    printf("You chose: %s\n", player_toss == 'H' ? "HEAD" : "TAILS");
+    screen_printf("\n\nThe coin shows: %s!\n", coin == 0 ? "HEAD" : "TAILS");
+    screen_printf("You chose: %s\n", player_toss == 'H' ? "HEAD" : "TAILS");
     
     player_won = (player_toss == 'H' && coin == 0) || 
                  (player_toss == 'T' && coin == 1);
     
     if (player_won) {
-        printf("\n*** YOU WON THE TOSS! ***\n");
+        screen_printf("\n*** YOU WON THE TOSS! ***\n");
     } else {
-        printf("\n*** COMPUTER WON THE TOSS! ***\n");
+        screen_printf("\n*** COMPUTER WON THE TOSS! ***\n");
     }
     
     pause_game();
@@ -326,33 +949,33 @@ int choose_batting(int player_chooses) {
     clear_screen();
     display_header();
     
-    printf("\n");
+    screen_printf("\n");
     print_centered("CHOOSE YOUR ROLE", 50);
     print_line('-', 50);
-    printf("\n");
+    screen_printf("\n");
     
     if (player_chooses) {
-        printf("You won the toss! Choose:\n\n");
-        printf("  (B)at first\n");
-        printf("  (O)wl first\n\n");
-        printf("Your choice: ");
+        screen_printf("You won the toss! Choose:\n\n");
+        screen_printf("  (B)at first\n");
+        screen_printf("  (O)wl first\n\n");
+        screen_printf("Your choice: ");
         
         choice = toupper(get_char_input());
         while (choice != 'B' && choice != 'O') {
-            printf("Invalid choice! Enter B to Bat or O to Bowl: ");
+            screen_printf("Invalid choice! Enter B to Bat or O to Bowl: ");
             choice = toupper(get_char_input());
         }
         
         player_bats_first = (choice == 'B');
         
-        printf("\nYou chose to %s first!\n", player_bats_first ? "BAT" : "BOWL");
+        screen_printf("\nYou chose to %s first!\n", player_bats_first ? "BAT" : "BOWL");
     } else {
         /* Computer chooses randomly */
-        player_bats_first = rand() % 2;
+        player_bats_first = rng_below(&game_rng, 2);
         
-        printf("Computer won the toss and chose to %s first.\n", 
+        screen_printf("Computer won the toss and chose to %s first.\n", 
                player_bats_first ? "BOWL" : "BAT");
-        printf("You will %s first.\n", player_bats_first ? "BAT" : "BOWL");
+        screen_printf("You will %s first.\n", player_bats_first ? "BAT" : "BOWL");
     }
     
     pause_game();
@@ -361,31 +984,32 @@ int choose_batting(int player_chooses) {
 
 /* Display the round result */
 void display_round_result(int player_num, int comp_num, int is_out, int is_batting) {
-    printf("\n");
+    screen_printf("\n");
     print_line('-', 40);
-    printf("Your number:      %d\n", player_num);
-    printf("Computer's number: %d\n", comp_num);
+    screen_printf("Your number:      %d\n", player_num);
+    screen_printf("Computer's number: %d\n", comp_num);
     print_line('-', 40);
     
     if (is_out) {
-        printf("\n  *** SAME NUMBER! %s IS OUT! ***\n", 
+        screen_printf("\n  *** SAME NUMBER! %s IS OUT! ***\n", 
                is_batting ? "YOU ARE" : "COMPUTER");
     } else {
         if (is_batting) {
             int runs = (player_num == 0) ? comp_num : player_num;
-            printf("\nYou scored %d run(s)!\n", runs);
+            screen_printf("\nYou scored %d run(s)!\n", runs);
         } else {
-            printf("\nComputer scored %d run(s)!\n", comp_num);
+            screen_printf("\nComputer scored %d run(s)!\n", comp_num);
         }
     }
 }
 
 /* Play one innings */
 int play_innings(int is_batting, int target, int is_second_innings) {
-    int player_num, comp_num;
+    int player_num;
     int runs_scored = 0;
     int is_out = 0;
     int round_num = 1;
+    BallResult ball;
     
     /* Reset tracking for new innings */
     same_choice_count = 0;
@@ -397,90 +1021,62 @@ int play_innings(int is_batting, int target, int is_second_innings) {
         display_header();
         
         /* Show innings info */
-        printf("\n");
+        screen_printf("\n");
         if (is_second_innings) {
-            printf("*** %s INNINGS ***\n", is_batting ? "CHASING" : "DEFENDING");
-            printf("Target: %d runs\n", target + 1);
+            screen_printf("*** %s INNINGS ***\n", is_batting ? "CHASING" : "DEFENDING");
+            screen_printf("Target: %d runs\n", target + 1);
         } else {
-            printf("*** %s INNINGS ***\n", is_batting ? "BATTING" : "BOWLING");
+            screen_printf("*** %s INNINGS ***\n", is_batting ? "BATTING" : "BOWLING");
         }
-        printf("You are: %s\n", is_batting ? "BATTING" : "BOWLING");
-        printf("Round: %d\n\n", round_num);
+        screen_printf("You are: %s\n", is_batting ? "BATTING" : "BOWLING");
+        screen_printf("Round: %d\n\n", round_num);
         
         display_scores();
         
         if (is_second_innings) {
             if (is_batting) {
-                printf("\nYou need %d more run(s) to win!\n", 
+                screen_printf("\nYou need %d more run(s) to win!\n", 
                        (target + 1) - player_score);
             } else {
-                printf("\nComputer needs %d more run(s) to win!\n", 
+                screen_printf("\nComputer needs %d more run(s) to win!\n", 
                        (target + 1) - computer_score);
             }
         }
         
         /* Get player input */
-        printf("\nEnter your number (0-10): ");
+        screen_printf("\nEnter your number (0-10): ");
         player_num = get_int_input(0, 10);
         
-        /* Check for repeated inputs */
-        if (player_num == last_player_input) {
-            same_choice_count++;
-            if (same_choice_count == 3) {
-                printf("\n*** WARNING: Don't repeat the same number! ***\n");
-                pause_game();
-            } else if (same_choice_count == 4) {
-                printf("\n*** BE CAREFUL! One more repeat and you're OUT! ***\n");
-                pause_game();
-            } else if (same_choice_count >= 5 && is_batting) {
-                printf("\n*** You used the same number 5 times! YOU'RE OUT! ***\n");
-                is_out = 1;
-                pause_game();
-                break;
-            }
-        } else {
-            same_choice_count = 1;
-            last_player_input = player_num;
-        }
+        ball = play_ball(player_num, is_batting, target, is_second_innings);
+        is_out = ball.is_out;
+        runs_scored += ball.runs;
         
-        /* Record move */
-        if (move_count < MAX_HISTORY) {
-            prev_moves[move_count++] = player_num;
-        }
-        
-        /* Generate computer's number */
-        comp_num = generate_computer_move();
-        
-        /* Check if out */
-        is_out = (player_num == comp_num);
-        
-        /* Update scores */
-        if (!is_out) {
-            if (is_batting) {
-                int runs = (player_num == 0) ? comp_num : player_num;
-                player_score += runs;
-                runs_scored += runs;
-            } else {
-                computer_score += comp_num;
-                runs_scored += comp_num;
-            }
+        /* Warn about repeated inputs */
+        if (ball.repeat_out) {
+            screen_printf("\n*** You used the same number 5 times! YOU'RE OUT! ***\n");
+            pause_game();
+            break;
+        } else if (same_choice_count == 3) {
+            screen_printf("\n*** WARNING: Don't repeat the same number! ***\n");
+            pause_game();
+        } else if (same_choice_count == 4) {
+            screen_printf("\n*** BE CAREFUL! One more repeat and you're OUT! ***\n");
+            pause_game();
         }
         
         /* Display result */
-        display_round_result(player_num, comp_num, is_out, is_batting);
+        display_round_result(player_num, ball.comp_num, is_out, is_batting);
         display_scores();
         
         /* Check win/lose conditions in second innings */
-        if (is_second_innings && !is_out) {
-            if (is_batting && player_score > target) {
-                printf("\n*** YOU CHASED THE TARGET! ***\n");
-                pause_game();
-                return runs_scored;
-            } else if (!is_batting && computer_score > target) {
-                printf("\n*** COMPUTER CHASED THE TARGET! ***\n");
-                pause_game();
-                return runs_scored;
+        if (ball.chased) {
+            if (is_batting) {
+                screen_printf("\n*** YOU CHASED THE TARGET! ***\n");
+            } else {
+                screen_printf("\n*** COMPUTER CHASED THE TARGET! ***\n");
             }
+            pause_game();
+            return runs_scored;
         }
         
         if (!is_out) {
@@ -498,48 +1094,49 @@ void display_final_result(void) {
     clear_screen();
     display_header();
     
-    printf("\n");
+    screen_printf("\n");
     print_centered("GAME OVER!", 50);
     print_line('=', 50);
-    printf("\n");
+    screen_printf("\n");
     
     display_scores();
     
-    printf("\n");
+    screen_printf("\n");
     print_line('-', 50);
     
     if (player_score > computer_score) {
-        printf("\n");
-        printf("  *************************************\n");
-        printf("  *                                   *\n");
-        printf("  *   CONGRATULATIONS! YOU WIN!       *\n");
-        printf("  *                                   *\n");
-        printf("  *   You won by %d run(s)!           *\n", 
-               player_score - computer_score);
-        printf("  *                                   *\n");
-        printf("  *************************************\n");
+        screen_printf("\n"
+                      "  *************************************\n"
+                      "  *                                   *\n"
+                      "  *   CONGRATULATIONS! YOU WIN!       *\n"
+                      "  *                                   *\n"
+                      "  *   You won by %d run(s)!           *\n"
+                      "  *                                   *\n"
+                      "  *************************************\n",
+                      player_score - computer_score);
     } else if (computer_score > player_score) {
-        printf("\n");
-        printf("  *************************************\n");
-        printf("  *                                   *\n");
-        printf("  *   SORRY! YOU LOST!                *\n");
-        printf("  *                                   *\n");
-        printf("  *   Computer won by %d run(s)       *\n", 
-               computer_score - player_score);
-        printf("  *                                   *\n");
-        printf("  *************************************\n");
+        screen_printf("\n"
+                      "  *************************************\n"
+                      "  *                                   *\n"
+                      "  *   SORRY! YOU LOST!                *\n"
+                      "  *                                   *\n"
+                      "  *   Computer won by %d run(s)       *\n"
+                      "  *                                   *\n"
+                      "  *************************************\n",
+                      computer_score - player_score);
     } else {
-        printf("\n");
-        printf("  *************************************\n");
-        printf("  *                                   *\n");
-        printf("  *   IT'S A TIE!                     *\n");
-        printf("  *                                   *\n");
-        printf("  *   Both scored %d runs!            *\n", player_score);
-        printf("  *                                   *\n");
-        printf("  *************************************\n");
+        screen_printf("\n"
+                      "  *************************************\n"
+                      "  *                                   *\n"
+                      "  *   IT'S A TIE!                     *\n"
+                      "  *                                   *\n"
+                      "  *   Both scored %d runs!            *\n"
+                      "  *                                   *\n"
+                      "  *************************************\n",
+                      player_score);
     }
     
-    printf("\n");
+    screen_printf("\n");
     print_line('=', 50);
     pause_game();
 }
@@ -552,6 +1149,7 @@ void play_game(void) {
     
     /* Reset for new game */
     reset_game();
+    start_match_log();
     
     /* Toss */
     player_won_toss = do_toss();
@@ -562,14 +1160,14 @@ void play_game(void) {
     /* First innings */
     clear_screen();
     display_header();
-    printf("\n");
+    screen_printf("\n");
     print_centered("FIRST INNINGS STARTING!", 50);
-    printf("\n");
+    screen_printf("\n");
     
     if (player_bats_first) {
-        printf("You are BATTING first. Score as many runs as you can!\n");
+        screen_printf("You are BATTING first. Score as many runs as you can!\n");
     } else {
-        printf("You are BOWLING first. Try to get the computer out!\n");
+        screen_printf("You are BOWLING first. Try to get the computer out!\n");
     }
     
     pause_game();
@@ -587,19 +1185,19 @@ void play_game(void) {
     /* Transition to second innings */
     clear_screen();
     display_header();
-    printf("\n");
+    screen_printf("\n");
     print_centered("INNINGS BREAK", 50);
     print_line('-', 50);
-    printf("\n");
+    screen_printf("\n");
     
     if (player_bats_first) {
-        printf("Your score: %d runs\n", player_score);
-        printf("\nComputer needs %d runs to win!\n", player_score + 1);
-        printf("\nYou are now BOWLING. Defend your score!\n");
+        screen_printf("Your score: %d runs\n", player_score);
+        screen_printf("\nComputer needs %d runs to win!\n", player_score + 1);
+        screen_printf("\nYou are now BOWLING. Defend your score!\n");
     } else {
-        printf("Computer's score: %d runs\n", computer_score);
-        printf("\nYou need %d runs to win!\n", computer_score + 1);
-        printf("\nYou are now BATTING. Chase the target!\n");
+        screen_printf("Computer's score: %d runs\n", computer_score);
+        screen_printf("\nYou need %d runs to win!\n", computer_score + 1);
+        screen_printf("\nYou are now BATTING. Chase the target!\n");
     }
     
     pause_game();
@@ -611,17 +1209,588 @@ void play_game(void) {
     play_innings(!player_bats_first, first_innings_score, 1);
     
     /* Display final result */
+    if (match_log != NULL) {
+        fflush(match_log);
+    }
     display_final_result();
 }
 
+/* ==================== SCRIPTED MODE ==================== */
+/*
+ * --script FILE plays matches from a script instead of the keyboard.
+ * A script is a list of whitespace separated tokens ('#' starts a
+ * comment). Each match is:
+ *
+ *   H|T      the toss call
+ *   B|O      bat or bowl first (ignored when the computer wins the toss)
+ *   0-10 ... the ball numbers; they are reused from the start if the
+ *            match outlasts them, and any left over are skipped
+ *
+ * D1, D2 or D3 between matches changes the difficulty. No screens or
+ * pauses are shown; each ball prints one line:
+ *
+ *   ball <match> <innings> <bat|bowl> <you> <computer|-> <runs> <you>-<computer> [out|repeat-out]
+ *
+ * followed by a "match" line with the result and a final "summary" line.
+ */
+#define MAX_SCRIPT_BALLS 1000
+
+FILE *script_file = NULL;
+int script_line = 1;
+int script_balls[MAX_SCRIPT_BALLS];
+int script_ball_count = 0;
+int script_next_ball = 0;
+
+/* Read the next token; returns 0 at the end of the script */
+int next_script_token(char *token, int size) {
+    int c, len = 0;
+    
+    /* Skip blanks and comments */
+    while ((c = fgetc(script_file)) != EOF) {
+        if (c == '#') {
+            while ((c = fgetc(script_file)) != EOF && c != '\n');
+        }
+        if (c == '\n') {
+            script_line++;
+        }
+        if (c != EOF && !isspace(c)) {
+            break;
+        }
+    }
+    if (c == EOF) {
+        return 0;
+    }
+    
+    while (c != EOF && !isspace(c) && c != '#') {
+        if (len < size - 1) {
+            token[len++] = (char)c;
+        }
+        c = fgetc(script_file);
+    }
+    if (c == '#' || c == '\n') {
+        ungetc(c, script_file);
+    }
+    token[len] = '\0';
+    return 1;
+}
+
+/* Is the token a ball number (0-10)? */
+int script_number(const char *token, int *value) {
+    char *end;
+    long n = strtol(token, &end, 10);
+    
+    if (end == token || *end != '\0' || n < 0 || n > 10) {
+        return 0;
+    }
+    *value = (int)n;
+    return 1;
+}
+
+/* Play one innings from the match's ball list */
+void script_innings(int match, int is_batting, int target, int is_second_innings) {
+    int player_num;
+    BallResult ball;
+    
+    same_choice_count = 0;
+    last_player_input = -1;
+    move_count = 0;
+    
+    while (1) {
+        player_num = script_balls[script_next_ball];
+        script_next_ball = (script_next_ball + 1) % script_ball_count;
+        
+        ball = play_ball(player_num, is_batting, target, is_second_innings);
+        
+        if (ball.repeat_out) {
+            out_printf("ball %d %d %s %d - %d %d-%d repeat-out\n", match, is_second_innings + 1,
+                   is_batting ? "bat" : "bowl", player_num, ball.runs,
+                   player_score, computer_score);
+        } else {
+            out_printf("ball %d %d %s %d %d %d %d-%d%s\n", match, is_second_innings + 1,
+                   is_batting ? "bat" : "bowl", player_num, ball.comp_num, ball.runs,
+                   player_score, computer_score, ball.is_out ? " out" : "");
+        }
+        
+        if (ball.is_out || ball.chased) {
+            return;
+        }
+    }
+}
+
+/* Play every match in the script; returns the process exit code */
+int run_script(void) {
+    char token[32];
+    int have_token;
+    int match = 0;
+    int wins = 0, losses = 0, ties = 0;
+    int player_won_toss, player_bats_first, first_innings_score;
+    int toss, role, coin, value;
+    
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    
+    have_token = next_script_token(token, sizeof(token));
+    while (have_token) {
+        toss = toupper((unsigned char)token[0]);
+        
+        /* Difficulty change between matches */
+        if (toss == 'D' && token[1] >= '1' && token[1] <= '3' && token[2] == '\0') {
+            difficulty = token[1] - '0';
+            have_token = next_script_token(token, sizeof(token));
+            continue;
+        }
+        if ((toss != 'H' && toss != 'T') || token[1] != '\0') {
+            fprintf(stderr, "script line %d: expected H or T for the toss, got '%s'\n",
+                    script_line, token);
+            return 1;
+        }
+        if (!next_script_token(token, sizeof(token)) ||
+            ((role = toupper((unsigned char)token[0])) != 'B' && role != 'O') ||
+            token[1] != '\0') {
+            fprintf(stderr, "script line %d: expected B or O after the toss\n", script_line);
+            return 1;
+        }
+        
+        /* Collect this match's ball numbers */
+        script_ball_count = 0;
+        script_next_ball = 0;
+        while ((have_token = next_script_token(token, sizeof(token))) &&
+               script_number(token, &value)) {
+            if (script_ball_count < MAX_SCRIPT_BALLS) {
+                script_balls[script_ball_count++] = value;
+            }
+        }
+        if (script_ball_count == 0) {
+            fprintf(stderr, "script line %d: match %d has no ball numbers\n",
+                    script_line, match + 1);
+            return 1;
+        }
+        
+        match++;
+        reset_game();
+        start_match_log();
+        
+        /* Same random draws as do_toss() and choose_batting() */
+        coin = rng_below(&game_rng, 2);
+        player_won_toss = (toss == 'H' && coin == 0) || (toss == 'T' && coin == 1);
+        if (player_won_toss) {
+            player_bats_first = (role == 'B');
+        } else {
+            player_bats_first = rng_below(&game_rng, 2);
+        }
+        
+        script_innings(match, player_bats_first, 0, 0);
+        first_innings_score = player_bats_first ? player_score : computer_score;
+        second_phase = 1;
+        script_innings(match, !player_bats_first, first_innings_score, 1);
+        
+        if (player_score > computer_score) {
+            wins++;
+        } else if (computer_score > player_score) {
+            losses++;
+        } else {
+            ties++;
+        }
+        out_printf("match %d toss=%s %s result=%s %d-%d difficulty=%d\n", match,
+               player_won_toss ? "won" : "lost",
+               player_bats_first ? "bat-first" : "bowl-first",
+               player_score > computer_score ? "win" :
+               computer_score > player_score ? "loss" : "tie",
+               player_score, computer_score, difficulty);
+    }
+    
+    out_printf("summary matches=%d wins=%d losses=%d ties=%d\n", match, wins, losses, ties);
+    out_flush();
+    return 0;
+}
+
+/* ==================== TOURNAMENT MODE ==================== */
+/*
+ * --tournament N plays N matches for every pairing of the computer
+ * strategies (EASY, MEDIUM, HARD) and a scripted "player" strategy,
+ * in both seats. The side in the player seat plays by the human rules
+ * (0 steals the bowler's number, 5 repeats while batting is out). Work
+ * is split across threads; each thread has its own random stream and
+ * its own result counters, merged when all threads finish.
+ */
+#define STRATEGY_PLAYER 0
+#define STRATEGY_COUNT 4
+#define MAX_THREADS 256
+
+const char *strategy_names[STRATEGY_COUNT] = { "player", "easy", "medium", "hard" };
+
+/* Scripted "player" styles for --player-strategy */
+#define PLAYER_RANDOM 0
+#define PLAYER_CYCLE  1
+#define PLAYER_STICKY 2
+#define PLAYER_HIGH   3
+const char *player_style_names[] = { "random", "cycle", "sticky", "high" };
+int player_style = PLAYER_RANDOM;
+
+typedef struct {
+    long long matches;
+    long long seat_wins[2];     /* [0] player seat, [1] computer seat */
+    long long ties;
+    double score_sum[2];
+    double score_sq_sum[2];
+} PairingStats;
+
+typedef struct {
+    int thread_id;
+    long long matches;          /* per pairing, for this thread */
+    unsigned long long seed;
+    PairingStats stats[STRATEGY_COUNT][STRATEGY_COUNT];
+} TournamentWorker;
+
+/* Everything one side needs to pick its numbers during an innings */
+typedef struct {
+    int strategy;
+    int moves[MAX_HISTORY];
+    int move_count;
+    int favourite;              /* PLAYER_STICKY */
+} Side;
+
+/* The configured player style's next number */
+int player_style_move(Side *self, Rng *rng, int repeats_left) {
+    int move;
+    
+    switch (player_style) {
+        case PLAYER_CYCLE:
+            move = self->move_count > 0 ? (self->moves[self->move_count - 1] + 1) % 11
+                                        : rng_below(rng, 11);
+            break;
+        case PLAYER_STICKY:
+            /* Mostly the favourite number, but never the fifth repeat */
+            move = (rng_below(rng, 100) < 70 && repeats_left > 1) ? self->favourite
+                                                                   : rng_below(rng, 11);
+            break;
+        case PLAYER_HIGH:
+            move = rng_below(rng, 100) < 75 ? 6 + rng_below(rng, 5) : rng_below(rng, 6);
+            break;
+        default:
+            move = rng_below(rng, 11);
+    }
+    return move;
+}
+
+/* Next number for a side; computer strategies read the opponent's history */
+int side_move(Side *self, const Side *opponent, Rng *rng, int repeats_left) {
+    if (self->strategy == STRATEGY_PLAYER) {
+        return player_style_move(self, rng, repeats_left);
+    }
+    return choose_move(self->strategy, opponent->moves, opponent->move_count, rng);
+}
+
+void side_record(Side *side, int move) {
+    if (side->move_count < MAX_HISTORY) {
+        side->moves[side->move_count++] = move;
+    }
+}
+
+/* One innings between the two seats; returns the batting side's runs */
+int simulate_innings(Side *seat, int player_batting, int target, int second, Rng *rng) {
+    int runs = 0, last = -1, count = 0;
+    int player_num, comp_num, result;
+    
+    seat[0].move_count = 0;
+    seat[1].move_count = 0;
+    
+    while (1) {
+        player_num = side_move(&seat[0], &seat[1], rng,
+                               last == -1 ? REPEAT_OUT_LIMIT : REPEAT_OUT_LIMIT - count);
+        if (count_repeats(player_num, &last, &count) >= REPEAT_OUT_LIMIT && player_batting) {
+            return runs;
+        }
+        comp_num = side_move(&seat[1], &seat[0], rng, REPEAT_OUT_LIMIT);
+        side_record(&seat[0], player_num);
+        side_record(&seat[1], comp_num);
+        
+        result = ball_runs(player_num, comp_num, player_batting);
+        if (result < 0) {
+            return runs;
+        }
+        runs += result;
+        if (second && runs > target) {
+            return runs;
+        }
+    }
+}
+
+/* Play one match; returns +1 if the player seat wins, -1 if it loses, 0 on a tie */
+int simulate_match(int player_strategy, int computer_strategy, Rng *rng, int *scores) {
+    Side seat[2];
+    int player_bats_first;
+    
+    seat[0].strategy = player_strategy;
+    seat[1].strategy = computer_strategy;
+    seat[0].favourite = rng_below(rng, 11);
+    seat[1].favourite = rng_below(rng, 11);
+    
+    player_bats_first = rng_below(rng, 2);
+    if (player_bats_first) {
+        scores[0] = simulate_innings(seat, 1, 0, 0, rng);
+        scores[1] = simulate_innings(seat, 0, scores[0], 1, rng);
+    } else {
+        scores[1] = simulate_innings(seat, 0, 0, 0, rng);
+        scores[0] = simulate_innings(seat, 1, scores[1], 1, rng);
+    }
+    return (scores[0] > scores[1]) - (scores[0] < scores[1]);
+}
+
+void *tournament_thread(void *arg) {
+    TournamentWorker *w = arg;
+    Rng rng;
+    int a, b, result, scores[2], seat;
+    long long m;
+    
+    rng_seed(&rng, w->seed + (unsigned long long)w->thread_id * 0x9E3779B97F4A7C15ull);
+    
+    for (a = 0; a < STRATEGY_COUNT; a++) {
+        for (b = 0; b < STRATEGY_COUNT; b++) {
+            PairingStats *st = &w->stats[a][b];
+            if (a == b) {
+                continue;
+            }
+            for (m = 0; m < w->matches; m++) {
+                result = simulate_match(a, b, &rng, scores);
+                st->matches++;
+                if (result > 0) {
+                    st->seat_wins[0]++;
+                } else if (result < 0) {
+                    st->seat_wins[1]++;
+                } else {
+                    st->ties++;
+                }
+                for (seat = 0; seat < 2; seat++) {
+                    st->score_sum[seat] += scores[seat];
+                    st->score_sq_sum[seat] += (double)scores[seat] * scores[seat];
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* 95% Wilson score interval for a proportion, as +/- half-width around p */
+void wilson_interval(long long wins, long long n, double *low, double *high) {
+    double z = 1.96, p, centre, margin;
+    
+    if (n == 0) {
+        *low = *high = 0;
+        return;
+    }
+    p = (double)wins / n;
+    centre = (p + z * z / (2.0 * n)) / (1 + z * z / n);
+    margin = z * sqrt(p * (1 - p) / n + z * z / (4.0 * n * n)) / (1 + z * z / n);
+    *low = centre - margin;
+    *high = centre + margin;
+}
+
+/* 95% confidence half-width of a mean */
+double mean_margin(double sum, double sq_sum, long long n) {
+    double mean, var;
+    
+    if (n < 2) {
+        return 0;
+    }
+    mean = sum / n;
+    var = (sq_sum - n * mean * mean) / (n - 1);
+    return var > 0 ? 1.96 * sqrt(var / n) : 0;
+}
+
+int run_tournament(long long matches, int threads, unsigned long long seed) {
+    TournamentWorker *workers;
+    pthread_t tids[MAX_THREADS];
+    PairingStats total[STRATEGY_COUNT][STRATEGY_COUNT];
+    long long overall_wins[STRATEGY_COUNT] = {0}, overall_games[STRATEGY_COUNT] = {0};
+    long long per_thread, played = 0;
+    double low, high, elapsed;
+    long long start;
+    int t, a, b;
+    
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    per_thread = (matches + threads - 1) / threads;
+    
+    workers = calloc(threads, sizeof(TournamentWorker));
+    if (workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    
+    out_printf("Tournament: %lld matches per pairing, %d thread(s), player strategy '%s'\n\n",
+           per_thread * threads, threads, player_style_names[player_style]);
+    out_flush();
+    
+    start = monotonic_ms();
+    for (t = 0; t < threads; t++) {
+        workers[t].thread_id = t;
+        workers[t].matches = per_thread;
+        workers[t].seed = seed;
+        pthread_create(&tids[t], NULL, tournament_thread, &workers[t]);
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    elapsed = (monotonic_ms() - start) / 1000.0;
+    
+    /* Merge the per-thread counters */
+    memset(total, 0, sizeof(total));
+    for (t = 0; t < threads; t++) {
+        for (a = 0; a < STRATEGY_COUNT; a++) {
+            for (b = 0; b < STRATEGY_COUNT; b++) {
+                PairingStats *src = &workers[t].stats[a][b], *dst = &total[a][b];
+                dst->matches += src->matches;
+                dst->seat_wins[0] += src->seat_wins[0];
+                dst->seat_wins[1] += src->seat_wins[1];
+                dst->ties += src->ties;
+                dst->score_sum[0] += src->score_sum[0];
+                dst->score_sum[1] += src->score_sum[1];
+                dst->score_sq_sum[0] += src->score_sq_sum[0];
+                dst->score_sq_sum[1] += src->score_sq_sum[1];
+            }
+        }
+    }
+    
+    out_printf("%-7s vs %-7s %21s %21s %7s %15s %15s\n", "Player", "Computer",
+           "player seat wins", "computer seat wins", "ties", "player avg", "computer avg");
+    out_fill('-', 100);
+    out_write("\n", 1);
+    for (a = 0; a < STRATEGY_COUNT; a++) {
+        for (b = 0; b < STRATEGY_COUNT; b++) {
+            PairingStats *st = &total[a][b];
+            double n = (double)st->matches;
+            if (a == b || st->matches == 0) {
+                continue;
+            }
+            played += st->matches;
+            out_printf("%-7s vs %-8s", strategy_names[a], strategy_names[b]);
+            wilson_interval(st->seat_wins[0], st->matches, &low, &high);
+            out_printf("  %6.2f%% [%5.2f,%5.2f]", 100.0 * st->seat_wins[0] / n, 100 * low, 100 * high);
+            wilson_interval(st->seat_wins[1], st->matches, &low, &high);
+            out_printf("  %6.2f%% [%5.2f,%5.2f]", 100.0 * st->seat_wins[1] / n, 100 * low, 100 * high);
+            out_printf("  %5.2f%%", 100.0 * st->ties / n);
+            out_printf("  %6.2f +/- %4.2f", st->score_sum[0] / n,
+                   mean_margin(st->score_sum[0], st->score_sq_sum[0], st->matches));
+            out_printf("  %6.2f +/- %4.2f\n", st->score_sum[1] / n,
+                   mean_margin(st->score_sum[1], st->score_sq_sum[1], st->matches));
+            
+            overall_wins[a] += st->seat_wins[0];
+            overall_games[a] += st->matches;
+            overall_wins[b] += st->seat_wins[1];
+            overall_games[b] += st->matches;
+        }
+    }
+    
+    out_printf("\nOverall win rate (both seats):\n");
+    for (a = 0; a < STRATEGY_COUNT; a++) {
+        wilson_interval(overall_wins[a], overall_games[a], &low, &high);
+        out_printf("  %-7s %6.2f%% [%5.2f,%5.2f] of %lld matches\n", strategy_names[a],
+               overall_games[a] ? 100.0 * overall_wins[a] / overall_games[a] : 0.0,
+               100 * low, 100 * high, overall_games[a]);
+    }
+    out_printf("\n%lld matches in %.2f s (%.0f matches/s)\n", played, elapsed,
+           elapsed > 0 ? played / elapsed : 0.0);
+    
+    out_flush();
+    free(workers);
+    return 0;
+}
+
+/* Number of online CPUs, for the default thread count */
+int cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
 /* ==================== MAIN FUNCTION ==================== */
 
-int main(void) {
+int main(int argc, char *argv[]) {
     int choice;
     int running = 1;
+    int i;
+    unsigned int seed = 0;
+    int seeded = 0;
+    long long tournament_matches = 0;
+    int threads = 0;
+    
+    /* Command line options */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--match-log") == 0 && i + 1 < argc) {
+            if (!open_match_log(argv[++i])) {
+                fprintf(stderr, "Cannot open match log %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-animation") == 0) {
+            animations_enabled = 0;
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            i++;
+            script_file = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+            if (script_file == NULL) {
+                fprintf(stderr, "Cannot open script %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            seeded = 1;
+        } else if (strcmp(argv[i], "--tournament") == 0 && i + 1 < argc) {
+            tournament_matches = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--player-strategy") == 0 && i + 1 < argc) {
+            i++;
+            for (player_style = PLAYER_HIGH; player_style > PLAYER_RANDOM; player_style--) {
+                if (strcmp(argv[i], player_style_names[player_style]) == 0) {
+                    break;
+                }
+            }
+            if (strcmp(argv[i], player_style_names[player_style]) != 0) {
+                fprintf(stderr, "Player strategy must be random, cycle, sticky or high\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--difficulty") == 0 && i + 1 < argc) {
+            difficulty = atoi(argv[++i]);
+            if (difficulty < EASY || difficulty > HARD) {
+                fprintf(stderr, "Difficulty must be 1, 2 or 3\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--match-log FILE] [--no-animation] [--script FILE|-]\n"
+                            "       [--seed N] [--difficulty 1|2|3]\n"
+                            "       [--tournament N [--threads T] [--player-strategy random|cycle|sticky|high]]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
     
     /* Seed random number generator */
-    srand((unsigned int)time(NULL));
+    rng_seed(&game_rng, seeded ? seed : (unsigned long long)time(NULL));
+    
+    /* AI vs AI: no screens, no input */
+    if (tournament_matches > 0) {
+        return run_tournament(tournament_matches, threads > 0 ? threads : cpu_count(),
+                              seeded ? seed : (unsigned long long)time(NULL));
+    }
+    
+    /* Non-interactive: play the script and exit */
+    if (script_file != NULL) {
+        i = run_script();
+        if (match_log != NULL) {
+            fclose(match_log);
+        }
+        return i;
+    }
+    
+    screen_init();
     
     /* Main menu loop */
     while (running) {
@@ -636,11 +1805,11 @@ int main(void) {
             case 2:
                 display_difficulty_menu();
                 difficulty = get_int_input(1, 3);
-                printf("\nDifficulty set to ");
+                screen_printf("\nDifficulty set to ");
                 switch (difficulty) {
-                    case EASY:   printf("EASY!\n");   break;
-                    case MEDIUM: printf("MEDIUM!\n"); break;
-                    case HARD:   printf("HARD!\n");   break;
+                    case EASY:   screen_printf("EASY!\n");   break;
+                    case MEDIUM: screen_printf("MEDIUM!\n"); break;
+                    case HARD:   screen_printf("HARD!\n");   break;
                 }
                 pause_game();
                 break;
@@ -652,16 +1821,21 @@ int main(void) {
             case 4:
                 clear_screen();
                 display_header();
-                printf("\n");
+                screen_printf("\n");
                 print_centered("Thanks for playing!", 50);
                 print_centered("Goodbye!", 50);
-                printf("\n");
+                screen_printf("\n");
                 print_line('=', 50);
+                screen_finish();
                 running = 0;
                 break;
         }
     }
     
+    if (match_log != NULL) {
+        fclose(match_log);
+    }
+    
     return 0;
 }
 
@@ -680,13 +1854,21 @@ int main(void) {
  * - Warning system for repeated moves
  * - Target chasing mechanics
  * - Beautiful console UI with ASCII art
+ * - Flicker-free screen updates (only changed lines are redrawn)
+ * - Scripted batch mode for regression and throughput testing
+ * - Multi-threaded AI vs AI tournaments with confidence intervals
  * 
  * COMPILATION:
- *   gcc handcricket.c -o handcricket
+ *   gcc handcricket.c -o handcricket -pthread -lm
  * 
  * RUNNING:
  *   ./handcricket (Linux/Mac)
  *   handcricket.exe (Windows)
+ *   ./handcricket --match-log balls.log   (record every ball)
+ *   ./handcricket --no-animation          (skip the coin flip delay)
+ *   ./handcricket --script FILE           (play scripted matches, see
+ *                                          SCRIPTED MODE above)
+ *   ./handcricket --tournament N          (AI vs AI difficulty tuning)
  * 
  * ========================================
  */
@@ -0,0 +1,632 @@
+/*
+ * HAND CRICKET GAME - Batch match simulator
+ * Plays many independent matches of the web game's rules in lockstep, for
+ * tuning the computer's difficulty levels. Match state is kept as parallel
+ * arrays (one entry per match) so each ball is resolved for 8 matches at a
+ * time with AVX2, 4 with SSE4.1, or one by one in the scalar fallback.
+ *
+ * Compile: gcc -O2 handcricket_batchsim.c -o handcricket_batchsim
+ * Run: ./handcricket_batchsim -n 1000000 -D 3           (hard AI vs a random player)
+ *      ./handcricket_batchsim -n 1000000 -s sticky -k sse
+ *      ./handcricket_batchsim -n 100000 -c               (check every kernel against the rules)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#define REPEAT_OUT_LIMIT 5      /* same as the server: fifth identical pick in a row is out */
+#define MAX_HISTORY 100         /* the server remembers this many picks per innings */
+#define MAX_BALLS 100000        /* matches still going after this many balls count as unfinished */
+#define LANES 8                 /* arrays are padded to a multiple of the widest kernel */
+
+enum { PLAYER_RANDOM, PLAYER_CYCLE, PLAYER_STICKY, PLAYER_HIGH };
+const char *player_names[] = { "random", "cycle", "sticky", "high" };
+const char *diff_names[] = { "", "easy", "medium", "hard" };
+
+/* ==================== RANDOM NUMBERS ==================== */
+/*
+ * Every match has its own xorshift32 stream and draws exactly two numbers
+ * per ball: the low and high 16 bits of the first decide the player's
+ * pick, those of the second the computer's. Every kernel therefore sees
+ * the same numbers, and results can be compared match by match.
+ */
+uint32_t xorshift32(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/* Uniform 0..n-1 from 16 random bits */
+int below(uint32_t bits16, int n) {
+    return (int)((bits16 * (uint32_t)n) >> 16);
+}
+
+uint32_t seed_lane(uint64_t seed, int lane) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull * (uint64_t)(lane + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return (uint32_t)z ? (uint32_t)z : 1;
+}
+
+/* ==================== MATCH STATE (STRUCT OF ARRAYS) ==================== */
+typedef struct {
+    int n;                      /* matches, padded up to a multiple of LANES */
+    int32_t *player_score;
+    int32_t *computer_score;
+    int32_t *first_innings_score;
+    int32_t *batting;           /* 1 while the player bats */
+    int32_t *second_innings;
+    int32_t *over;
+    int32_t *balls;
+    int32_t *move_count;        /* picks remembered this innings, capped at MAX_HISTORY */
+    int32_t *same_count;        /* consecutive repeats, as same_choice_count */
+    int32_t *last_stored;       /* most recent remembered pick (prev_moves[move_count - 1]) */
+    int32_t *player_last;       /* the player's previous pick, remembered or not */
+    int32_t *favourite;         /* the sticky player's number */
+    uint32_t *rng;
+    int32_t *freq[11];          /* remembered picks per number, what HARD predicts from */
+} Batch;
+
+/* Column order used when moving whole matches in and out of vector lanes */
+enum { COL_PLAYER_SCORE, COL_COMPUTER_SCORE, COL_FIRST_INNINGS, COL_BATTING, COL_SECOND_INNINGS, COL_OVER,
+       COL_BALLS, COL_MOVE_COUNT, COL_SAME_COUNT, COL_LAST_STORED, COL_PLAYER_LAST, COL_FAVOURITE, COL_RNG,
+       COL_FREQ, COL_COUNT = COL_FREQ + 11 };
+
+void batch_slots(Batch *b, int32_t **slot[COL_COUNT]) {
+    int32_t **named[] = { &b->player_score, &b->computer_score, &b->first_innings_score, &b->batting,
+                          &b->second_innings, &b->over, &b->balls, &b->move_count, &b->same_count,
+                          &b->last_stored, &b->player_last, &b->favourite, (int32_t**)&b->rng };
+    for (int c = 0; c < COL_FREQ; c++) slot[c] = named[c];
+    for (int k = 0; k < 11; k++) slot[COL_FREQ + k] = &b->freq[k];
+}
+
+/* Toss and favourite number come from the first draw of each match's stream */
+void batch_init(Batch *b, int matches, uint64_t seed) {
+    int32_t **slot[COL_COUNT];
+    batch_slots(b, slot);
+    b->n = (matches + LANES - 1) / LANES * LANES;
+    for (int c = 0; c < COL_COUNT; c++) {
+        if (!(*slot[c] = aligned_alloc(32, (size_t)b->n * sizeof(int32_t)))) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        memset(*slot[c], 0, (size_t)b->n * sizeof(int32_t));
+    }
+    for (int i = 0; i < b->n; i++) {
+        uint32_t r = xorshift32(seed_lane(seed, i));
+        b->rng[i] = r;
+        b->batting[i] = r & 1;
+        b->favourite[i] = below(r >> 16, 11);
+        b->player_last[i] = -1;
+        b->over[i] = i >= matches; /* padding lanes never play */
+    }
+}
+
+void batch_free(Batch *b) {
+    int32_t **slot[COL_COUNT];
+    batch_slots(b, slot);
+    for (int c = 0; c < COL_COUNT; c++) free(*slot[c]);
+}
+
+/* ==================== RULES REFERENCE ==================== */
+/*
+ * One match at a time, written the way new_handcricket.c's handle_play()
+ * and generate_computer_move() are: a pick history array, a frequency
+ * count rebuilt on every HARD move. The kernels below must agree with it.
+ */
+typedef struct {
+    int player_score, computer_score, first_innings_score;
+    int is_batting, second_innings, over, balls;
+    int prev_moves[MAX_HISTORY], move_count, same_choice_count;
+    int player_last, favourite;
+    uint32_t rng;
+} RefMatch;
+
+int ref_player_move(const RefMatch *m, int style, uint32_t r) {
+    int lo = r & 0xFFFF, hi = r >> 16;
+    switch (style) {
+        case PLAYER_CYCLE:
+            return m->move_count > 0 ? (m->player_last + 1) % 11 : below(lo, 11);
+        case PLAYER_STICKY:
+            /* Mostly the favourite number, but never the fifth repeat */
+            if (below(hi, 100) < 70 && !(m->move_count > 0 && m->prev_moves[m->move_count - 1] == m->favourite &&
+                                        m->same_choice_count >= REPEAT_OUT_LIMIT - 1))
+                return m->favourite;
+            return below(lo, 11);
+        case PLAYER_HIGH:
+            return below(hi, 100) < 75 ? 6 + below(lo, 5) : below(lo, 6);
+        default:
+            return below(lo, 11);
+    }
+}
+
+int ref_computer_move(const RefMatch *m, int difficulty, uint32_t r) {
+    int lo = r & 0xFFFF, hi = r >> 16, freq[11] = {0};
+    switch (difficulty) {
+        case 2:
+            if (below(hi, 100) < 30 && m->move_count > 0) return m->prev_moves[m->move_count - 1];
+            return below(lo, 11);
+        case 3:
+            if (m->move_count == 0) return below(lo, 11);
+            int max_f = 0, pred = below(lo, 11);
+            for (int i = 0; i < m->move_count; i++) freq[m->prev_moves[i]]++;
+            for (int i = 0; i < 11; i++) if (freq[i] > max_f) { max_f = freq[i]; pred = i; }
+            return pred;
+        default:
+            return below(lo, 11);
+    }
+}
+
+void ref_play(RefMatch *m, int difficulty, int style) {
+    while (!m->over && m->balls < MAX_BALLS) {
+        uint32_t r1 = m->rng = xorshift32(m->rng);
+        uint32_t r2 = m->rng = xorshift32(m->rng);
+        int num = ref_player_move(m, style, r1);
+        int comp = ref_computer_move(m, difficulty, r2);
+        int out, runs;
+
+        m->balls++;
+        m->player_last = num;
+        if (m->move_count > 0 && num == m->prev_moves[m->move_count - 1]) m->same_choice_count++;
+        else m->same_choice_count = 1;
+        if (m->move_count < MAX_HISTORY) m->prev_moves[m->move_count++] = num;
+
+        if (m->is_batting) {
+            out = m->same_choice_count >= REPEAT_OUT_LIMIT || num == comp;
+            runs = num == 0 ? comp : num;
+        } else {
+            out = num == comp;
+            runs = comp;
+        }
+        if (!out) {
+            int *score = m->is_batting ? &m->player_score : &m->computer_score;
+            *score += runs;
+            if (m->second_innings && *score > m->first_innings_score) m->over = 1;
+        } else if (!m->second_innings) {
+            m->second_innings = 1;
+            m->first_innings_score = m->is_batting ? m->player_score : m->computer_score;
+            m->is_batting = !m->is_batting;
+            m->same_choice_count = 0;
+            m->move_count = 0;
+        } else {
+            m->over = 1;
+        }
+    }
+}
+
+/* Plays match i of a freshly initialised batch with the reference rules */
+void ref_run(const Batch *b, int i, int difficulty, int style, RefMatch *m) {
+    memset(m, 0, sizeof(*m));
+    m->is_batting = b->batting[i];
+    m->favourite = b->favourite[i];
+    m->player_last = -1;
+    m->rng = b->rng[i];
+    ref_play(m, difficulty, style);
+}
+
+/* ==================== SCALAR KERNEL ==================== */
+void kernel_scalar(Batch *b, int difficulty, int style) {
+    for (int i = 0; i < b->n; i++) {
+        while (!b->over[i] && b->balls[i] < MAX_BALLS) {
+            uint32_t r1 = b->rng[i] = xorshift32(b->rng[i]);
+            uint32_t r2 = b->rng[i] = xorshift32(b->rng[i]);
+            int lo1 = r1 & 0xFFFF, hi1 = r1 >> 16, lo2 = r2 & 0xFFFF, hi2 = r2 >> 16;
+            int mc = b->move_count[i], p, c;
+
+            switch (style) {
+                case PLAYER_CYCLE: p = mc > 0 ? (b->player_last[i] + 1) % 11 : below(lo1, 11); break;
+                case PLAYER_STICKY:
+                    p = below(hi1, 100) < 70 && !(mc > 0 && b->last_stored[i] == b->favourite[i] &&
+                                                  b->same_count[i] >= REPEAT_OUT_LIMIT - 1)
+                        ? b->favourite[i] : below(lo1, 11);
+                    break;
+                case PLAYER_HIGH: p = below(hi1, 100) < 75 ? 6 + below(lo1, 5) : below(lo1, 6); break;
+                default: p = below(lo1, 11);
+            }
+            c = below(lo2, 11);
+            if (difficulty == 2 && mc > 0 && below(hi2, 100) < 30) c = b->last_stored[i];
+            if (difficulty == 3 && mc > 0) {
+                int best = b->freq[0][i];
+                c = 0;
+                for (int k = 1; k < 11; k++) if (b->freq[k][i] > best) { best = b->freq[k][i]; c = k; }
+            }
+
+            b->balls[i]++;
+            b->player_last[i] = p;
+            b->same_count[i] = mc > 0 && p == b->last_stored[i] ? b->same_count[i] + 1 : 1;
+            if (mc < MAX_HISTORY) { b->freq[p][i]++; b->last_stored[i] = p; b->move_count[i] = mc + 1; }
+
+            int bat = b->batting[i];
+            int out = p == c || (bat && b->same_count[i] >= REPEAT_OUT_LIMIT);
+            int runs = bat && p == 0 ? c : bat ? p : c;
+            if (!out) {
+                int32_t *score = bat ? &b->player_score[i] : &b->computer_score[i];
+                *score += runs;
+                if (b->second_innings[i] && *score > b->first_innings_score[i]) b->over[i] = 1;
+            } else if (!b->second_innings[i]) {
+                b->second_innings[i] = 1;
+                b->first_innings_score[i] = bat ? b->player_score[i] : b->computer_score[i];
+                b->batting[i] = !bat;
+                b->same_count[i] = 0;
+                b->move_count[i] = 0;
+                for (int k = 0; k < 11; k++) b->freq[k][i] = 0;
+            } else {
+                b->over[i] = 1;
+            }
+        }
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+/* ==================== SIMD KERNELS ==================== */
+/*
+ * The same step as kernel_scalar for a vector of matches at once, with
+ * the state of W matches held in registers. Branches become masks: outs
+ * are a vector compare, runs a masked add, and the HARD prediction an
+ * argmax across the eleven frequency vectors (strict greater-than keeps
+ * the lowest number on ties, like the server's loop).
+ *
+ * Match lengths vary a lot, so a lane whose match ends is written back and
+ * refilled with the next unplayed match instead of idling until the whole
+ * vector is done. Lanes move through a small column-major spill area with
+ * the batch's layout; flags become all-ones masks only in registers.
+ */
+typedef struct {
+    int32_t col[COL_COUNT][LANES] __attribute__((aligned(32)));
+    int match[LANES];           /* match in each lane, -1 once the batch is drained */
+    int next;                   /* next match to hand out */
+    int32_t *batch[COL_COUNT];  /* the batch's columns */
+} LaneSpill;
+
+/* Writes back lane j's finished match and loads the next one; returns 0 if none is left */
+int lane_refill(const Batch *b, LaneSpill *sp, int j) {
+    int m = sp->match[j];
+    if (m >= 0)
+        for (int c = 0; c < COL_COUNT; c++) sp->batch[c][m] = sp->col[c][j];
+    m = sp->match[j] = sp->next < b->n ? sp->next++ : -1;
+    if (m < 0) { sp->col[COL_OVER][j] = 1; return 0; }
+    for (int c = 0; c < COL_COUNT; c++) sp->col[c][j] = sp->batch[c][m];
+    return 1;
+}
+
+void lane_spill_init(Batch *b, LaneSpill *sp, int width) {
+    int32_t **slot[COL_COUNT];
+    batch_slots(b, slot);
+    for (int c = 0; c < COL_COUNT; c++) sp->batch[c] = *slot[c];
+    sp->next = 0;
+    for (int j = 0; j < width; j++) { sp->match[j] = -1; lane_refill(b, sp, j); }
+}
+
+#define SIMD_KERNEL(NAME, TARGET, W, VEC, P)                                                          \
+__attribute__((target(TARGET)))                                                                       \
+void NAME(Batch *b, int difficulty, int style) {                                                      \
+    const VEC zero = P##_setzero_si(), one = P##_set1_epi32(1), all = P##_set1_epi32(-1);             \
+    const VEC lo_mask = P##_set1_epi32(0xFFFF), eleven = P##_set1_epi32(11);                          \
+    const VEC max_hist = P##_set1_epi32(MAX_HISTORY), last_ball = P##_set1_epi32(MAX_BALLS - 1);      \
+    const VEC repeat_limit = P##_set1_epi32(REPEAT_OUT_LIMIT - 1);                                    \
+    LaneSpill sp;                                                                                     \
+    VEC ps, cs, fis, bat, second, over, balls, mc, sc, last, plast, fav, rng, freq[11];               \
+    lane_spill_init(b, &sp, W);                                                                       \
+    for (;;) {                                                                                        \
+        ps = P##_load_si(sp.col[COL_PLAYER_SCORE]); cs = P##_load_si(sp.col[COL_COMPUTER_SCORE]);     \
+        fis = P##_load_si(sp.col[COL_FIRST_INNINGS]); bat = P##_load_si(sp.col[COL_BATTING]);         \
+        second = P##_load_si(sp.col[COL_SECOND_INNINGS]); over = P##_load_si(sp.col[COL_OVER]);       \
+        balls = P##_load_si(sp.col[COL_BALLS]); mc = P##_load_si(sp.col[COL_MOVE_COUNT]);             \
+        sc = P##_load_si(sp.col[COL_SAME_COUNT]); last = P##_load_si(sp.col[COL_LAST_STORED]);        \
+        plast = P##_load_si(sp.col[COL_PLAYER_LAST]); fav = P##_load_si(sp.col[COL_FAVOURITE]);       \
+        rng = P##_load_si(sp.col[COL_RNG]);                                                           \
+        for (int k = 0; k < 11; k++) freq[k] = P##_load_si(sp.col[COL_FREQ + k]);                     \
+        bat = P##_cmpgt_epi32(bat, zero); second = P##_cmpgt_epi32(second, zero);                    \
+        over = P##_cmpgt_epi32(over, zero);                                                            \
+        int live = 0;                                                                                 \
+        for (int j = 0; j < W; j++) live |= (sp.match[j] >= 0) << j;                                  \
+        if (!live) break;                                                                             \
+        for (;;) {                                                                                    \
+            VEC active = P##_andnot_si(P##_or_si(over, P##_cmpgt_epi32(balls, last_ball)), all);      \
+            int idle = ~P##_lanemask(active) & live;                                                  \
+            if (idle == live || __builtin_popcount(idle) >= W / 2) break; /* refill finished lanes */ \
+            VEC r1 = P##_xorshift(rng), r2 = P##_xorshift(r1);                                        \
+            rng = P##_blendv_epi8(rng, r2, active);                                                   \
+            VEC lo1 = P##_and_si(r1, lo_mask), hi1 = P##_srli_epi32(r1, 16);                          \
+            VEC lo2 = P##_and_si(r2, lo_mask), hi2 = P##_srli_epi32(r2, 16);                          \
+            VEC has_hist = P##_cmpgt_epi32(mc, zero), p, c;                                           \
+            switch (style) {                                                                          \
+                case PLAYER_CYCLE: {                                                                  \
+                    VEC next = P##_add_epi32(plast, one);                                             \
+                    next = P##_andnot_si(P##_cmpeq_epi32(next, eleven), next);                        \
+                    p = P##_blendv_epi8(P##_below(lo1, 11), next, has_hist);                          \
+                    break;                                                                            \
+                }                                                                                     \
+                case PLAYER_STICKY: {                                                                 \
+                    VEC fifth = P##_and_si(P##_and_si(has_hist, P##_cmpeq_epi32(last, fav)),          \
+                                           P##_cmpgt_epi32(sc, P##_sub_epi32(repeat_limit, one)));    \
+                    VEC keep = P##_andnot_si(fifth, P##_cmpgt_epi32(P##_set1_epi32(70), P##_below(hi1, 100))); \
+                    p = P##_blendv_epi8(P##_below(lo1, 11), fav, keep);                               \
+                    break;                                                                            \
+                }                                                                                     \
+                case PLAYER_HIGH: {                                                                   \
+                    VEC high = P##_cmpgt_epi32(P##_set1_epi32(75), P##_below(hi1, 100));              \
+                    p = P##_blendv_epi8(P##_below(lo1, 6), P##_add_epi32(P##_below(lo1, 5), P##_set1_epi32(6)), high); \
+                    break;                                                                            \
+                }                                                                                     \
+                default: p = P##_below(lo1, 11);                                                      \
+            }                                                                                         \
+            c = P##_below(lo2, 11);                                                                   \
+            if (difficulty == 2) {                                                                    \
+                VEC repeat = P##_and_si(has_hist, P##_cmpgt_epi32(P##_set1_epi32(30), P##_below(hi2, 100))); \
+                c = P##_blendv_epi8(c, last, repeat);                                                 \
+            } else if (difficulty == 3) {                                                             \
+                VEC best = freq[0], pred = zero;                                                      \
+                for (int k = 1; k < 11; k++) {                                                        \
+                    VEC gt = P##_cmpgt_epi32(freq[k], best);                                          \
+                    best = P##_max_epi32(best, freq[k]);                                              \
+                    pred = P##_blendv_epi8(pred, P##_set1_epi32(k), gt);                              \
+                }                                                                                     \
+                c = P##_blendv_epi8(c, pred, has_hist);                                               \
+            }                                                                                         \
+            balls = P##_sub_epi32(balls, active);                                                     \
+            plast = P##_blendv_epi8(plast, p, active);                                                \
+            VEC same = P##_and_si(has_hist, P##_cmpeq_epi32(p, last));                                \
+            sc = P##_blendv_epi8(sc, P##_blendv_epi8(one, P##_add_epi32(sc, one), same), active);    \
+            VEC record = P##_and_si(active, P##_cmpgt_epi32(max_hist, mc));                           \
+            for (int k = 0; k < 11; k++)                                                              \
+                freq[k] = P##_sub_epi32(freq[k], P##_and_si(record, P##_cmpeq_epi32(p, P##_set1_epi32(k)))); \
+            last = P##_blendv_epi8(last, p, record);                                                  \
+            mc = P##_sub_epi32(mc, record);                                                           \
+                                                                                                      \
+            VEC out = P##_or_si(P##_cmpeq_epi32(p, c),                                                \
+                                P##_and_si(bat, P##_cmpgt_epi32(sc, repeat_limit)));                  \
+            VEC runs = P##_blendv_epi8(c, P##_blendv_epi8(p, c, P##_cmpeq_epi32(p, zero)), bat);      \
+            VEC scoring = P##_andnot_si(out, active);                                                 \
+            ps = P##_add_epi32(ps, P##_and_si(runs, P##_and_si(scoring, bat)));                       \
+            cs = P##_add_epi32(cs, P##_andnot_si(bat, P##_and_si(runs, scoring)));                    \
+            VEC chased = P##_cmpgt_epi32(P##_blendv_epi8(cs, ps, bat), fis);                          \
+            over = P##_or_si(over, P##_and_si(scoring, P##_and_si(second, chased)));                  \
+                                                                                                      \
+            VEC dismissed = P##_and_si(out, active);                                                  \
+            VEC switching = P##_andnot_si(second, dismissed);                                         \
+            over = P##_or_si(over, P##_and_si(second, dismissed));                                    \
+            fis = P##_blendv_epi8(fis, P##_blendv_epi8(cs, ps, bat), switching);                      \
+            bat = P##_xor_si(bat, switching);                                                         \
+            second = P##_or_si(second, switching);                                                    \
+            sc = P##_andnot_si(switching, sc);                                                        \
+            mc = P##_andnot_si(switching, mc);                                                        \
+            for (int k = 0; k < 11; k++) freq[k] = P##_andnot_si(switching, freq[k]);                 \
+        }                                                                                             \
+        P##_store_si(sp.col[COL_PLAYER_SCORE], ps); P##_store_si(sp.col[COL_COMPUTER_SCORE], cs);     \
+        P##_store_si(sp.col[COL_FIRST_INNINGS], fis); P##_store_si(sp.col[COL_BATTING], P##_and_si(bat, one)); \
+        P##_store_si(sp.col[COL_SECOND_INNINGS], P##_and_si(second, one));                            \
+        P##_store_si(sp.col[COL_OVER], P##_and_si(over, one));                                        \
+        P##_store_si(sp.col[COL_BALLS], balls); P##_store_si(sp.col[COL_MOVE_COUNT], mc);             \
+        P##_store_si(sp.col[COL_SAME_COUNT], sc); P##_store_si(sp.col[COL_LAST_STORED], last);        \
+        P##_store_si(sp.col[COL_PLAYER_LAST], plast); P##_store_si(sp.col[COL_FAVOURITE], fav);       \
+        P##_store_si(sp.col[COL_RNG], rng);                                                           \
+        for (int k = 0; k < 11; k++) P##_store_si(sp.col[COL_FREQ + k], freq[k]);                     \
+        for (int j = 0; j < W; j++) {                                                                 \
+            /* Finished lanes get new matches; padding matches finish at once */                      \
+            while (sp.match[j] >= 0 && (sp.col[COL_OVER][j] || sp.col[COL_BALLS][j] >= MAX_BALLS))    \
+                if (!lane_refill(b, &sp, j)) break;                                                   \
+        }                                                                                             \
+    }                                                                                                 \
+}
+
+/* 128-bit helpers (SSE4.1) */
+#define sse_setzero_si _mm_setzero_si128
+#define sse_set1_epi32 _mm_set1_epi32
+#define sse_load_si(p) _mm_load_si128((const __m128i*)(p))
+#define sse_store_si(p, v) _mm_store_si128((__m128i*)(p), v)
+#define sse_and_si _mm_and_si128
+#define sse_andnot_si _mm_andnot_si128
+#define sse_or_si _mm_or_si128
+#define sse_xor_si _mm_xor_si128
+#define sse_add_epi32 _mm_add_epi32
+#define sse_sub_epi32 _mm_sub_epi32
+#define sse_cmpgt_epi32 _mm_cmpgt_epi32
+#define sse_cmpeq_epi32 _mm_cmpeq_epi32
+#define sse_max_epi32 _mm_max_epi32
+#define sse_blendv_epi8 _mm_blendv_epi8
+#define sse_lanemask(v) _mm_movemask_ps(_mm_castsi128_ps(v))
+#define sse_srli_epi32 _mm_srli_epi32
+#define sse_below(bits, n) _mm_srli_epi32(_mm_mullo_epi32(bits, _mm_set1_epi32(n)), 16)
+#define sse_xorshift(x) sse_xorshift32(x)
+
+__attribute__((target("sse4.1")))
+static inline __m128i sse_xorshift32(__m128i x) {
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+/* 256-bit helpers (AVX2) */
+#define avx_setzero_si _mm256_setzero_si256
+#define avx_set1_epi32 _mm256_set1_epi32
+#define avx_load_si(p) _mm256_load_si256((const __m256i*)(p))
+#define avx_store_si(p, v) _mm256_store_si256((__m256i*)(p), v)
+#define avx_and_si _mm256_and_si256
+#define avx_andnot_si _mm256_andnot_si256
+#define avx_or_si _mm256_or_si256
+#define avx_xor_si _mm256_xor_si256
+#define avx_add_epi32 _mm256_add_epi32
+#define avx_sub_epi32 _mm256_sub_epi32
+#define avx_cmpgt_epi32 _mm256_cmpgt_epi32
+#define avx_cmpeq_epi32 _mm256_cmpeq_epi32
+#define avx_max_epi32 _mm256_max_epi32
+#define avx_blendv_epi8 _mm256_blendv_epi8
+#define avx_lanemask(v) _mm256_movemask_ps(_mm256_castsi256_ps(v))
+#define avx_srli_epi32 _mm256_srli_epi32
+#define avx_below(bits, n) _mm256_srli_epi32(_mm256_mullo_epi32(bits, _mm256_set1_epi32(n)), 16)
+#define avx_xorshift(x) avx_xorshift32(x)
+
+__attribute__((target("avx2")))
+static inline __m256i avx_xorshift32(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+}
+
+SIMD_KERNEL(kernel_sse, "sse4.1", 4, __m128i, sse)
+SIMD_KERNEL(kernel_avx2, "avx2", 8, __m256i, avx)
+#endif /* HAVE_X86_KERNELS */
+
+/* ==================== KERNEL SELECTION ==================== */
+typedef void (*Kernel)(Batch *b, int difficulty, int style);
+
+typedef struct {
+    const char *name;
+    Kernel fn;
+    int supported;
+} KernelInfo;
+
+KernelInfo kernels[3];
+int kernel_count = 0;
+
+void detect_kernels(void) {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    kernels[kernel_count++] = (KernelInfo){ "avx2", kernel_avx2, __builtin_cpu_supports("avx2") };
+    kernels[kernel_count++] = (KernelInfo){ "sse", kernel_sse, __builtin_cpu_supports("sse4.1") };
+#endif
+    kernels[kernel_count++] = (KernelInfo){ "scalar", kernel_scalar, 1 };
+}
+
+/* The widest supported kernel, or the named one */
+const KernelInfo* find_kernel(const char *name) {
+    for (int i = 0; i < kernel_count; i++) {
+        if (!kernels[i].supported) continue;
+        if (!name || strcmp(name, "auto") == 0 || strcmp(name, kernels[i].name) == 0) return &kernels[i];
+    }
+    return NULL;
+}
+
+/* ==================== RESULTS ==================== */
+typedef struct {
+    uint64_t matches, wins, losses, ties, unfinished;
+    uint64_t balls, player_runs, computer_runs;
+} Summary;
+
+void summarize(const Batch *b, int matches, Summary *s) {
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < matches; i++) {
+        s->matches++;
+        s->balls += b->balls[i];
+        s->player_runs += b->player_score[i];
+        s->computer_runs += b->computer_score[i];
+        if (!b->over[i]) s->unfinished++;
+        else if (b->player_score[i] > b->computer_score[i]) s->wins++;
+        else if (b->player_score[i] < b->computer_score[i]) s->losses++;
+        else s->ties++;
+    }
+}
+
+double pct(uint64_t a, uint64_t b) {
+    return b ? 100.0 * (double)a / (double)b : 0.0;
+}
+
+/* Compares every match against the reference rules; returns the mismatch count */
+int check_kernel(const KernelInfo *k, int matches, uint64_t seed, int difficulty, int style) {
+    Batch b, fresh;
+    RefMatch m;
+    int bad = 0;
+    batch_init(&fresh, matches, seed);
+    batch_init(&b, matches, seed);
+    k->fn(&b, difficulty, style);
+    for (int i = 0; i < matches; i++) {
+        ref_run(&fresh, i, difficulty, style, &m);
+        if (m.player_score != b.player_score[i] || m.computer_score != b.computer_score[i] ||
+            m.balls != b.balls[i] || m.over != b.over[i] || m.first_innings_score != b.first_innings_score[i]) {
+            if (bad++ < 5)
+                fprintf(stderr, "  %s match %d: reference %d-%d in %d balls, kernel %d-%d in %d balls\n",
+                    k->name, i, m.player_score, m.computer_score, m.balls,
+                    b.player_score[i], b.computer_score[i], b.balls[i]);
+        }
+    }
+    batch_free(&fresh);
+    batch_free(&b);
+    return bad;
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ==================== MAIN FUNCTION ==================== */
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n matches] [-D difficulty 1-3, 0 = all] [-s random|cycle|sticky|high]\n"
+                    "          [-k auto|avx2|sse|scalar] [-S seed] [-c]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int matches = 1000000, difficulty = 0, style = PLAYER_RANDOM, check = 0, c;
+    const char *kernel_name = "auto";
+    uint64_t seed = 12345;
+
+    while ((c = getopt(argc, argv, "n:D:s:k:S:ch")) != -1) {
+        switch (c) {
+            case 'n': matches = atoi(optarg); break;
+            case 'D': difficulty = atoi(optarg); break;
+            case 's':
+                for (style = 3; style > 0 && strcmp(optarg, player_names[style]) != 0; style--) {}
+                if (strcmp(optarg, player_names[style]) != 0) { usage(argv[0]); return 1; }
+                break;
+            case 'k': kernel_name = optarg; break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            case 'c': check = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (matches < 1 || difficulty < 0 || difficulty > 3) { usage(argv[0]); return 1; }
+
+    detect_kernels();
+
+    if (check) {
+        int failed = 0;
+        printf("\n  Checking kernels against the rules reference (%d matches per case)\n", matches);
+        for (int k = 0; k < kernel_count; k++) {
+            if (!kernels[k].supported) { printf("  %-7s not supported on this CPU\n", kernels[k].name); continue; }
+            for (int d = 1; d <= 3; d++) {
+                for (int s = 0; s < 4; s++) {
+                    int bad = check_kernel(&kernels[k], matches, seed + (uint64_t)(d * 4 + s), d, s);
+                    failed += bad != 0;
+                    printf("  %-7s %-7s %-7s %s\n", kernels[k].name, diff_names[d], player_names[s],
+                        bad ? "MISMATCH" : "ok");
+                }
+            }
+        }
+        printf("\n");
+        return failed ? 1 : 0;
+    }
+
+    const KernelInfo *k = find_kernel(kernel_name);
+    if (!k) { fprintf(stderr, "Kernel %s is not available on this CPU\n", kernel_name); return 1; }
+
+    printf("\n  %d matches per difficulty, player %s, kernel %s\n\n", matches, player_names[style], k->name);
+    printf("  %-8s %8s %8s %8s %10s %11s %11s %14s\n",
+        "AI", "win%", "loss%", "tie%", "balls", "player runs", "comp runs", "matches/s");
+    for (int d = difficulty ? difficulty : 1; d <= (difficulty ? difficulty : 3); d++) {
+        Batch b;
+        Summary s;
+        batch_init(&b, matches, seed + (uint64_t)d);
+        double t0 = now_seconds();
+        k->fn(&b, d, style);
+        double secs = now_seconds() - t0;
+        summarize(&b, matches, &s);
+        printf("  %-8s %8.2f %8.2f %8.2f %10.2f %11.2f %11.2f %14.0f\n", diff_names[d],
+            pct(s.wins, s.matches), pct(s.losses, s.matches), pct(s.ties, s.matches),
+            (double)s.balls / s.matches, (double)s.player_runs / s.matches, (double)s.computer_runs / s.matches,
+            secs > 0 ? s.matches / secs : 0.0);
+        if (s.unfinished) printf("           (%llu match(es) still going after %d balls)\n",
+            (unsigned long long)s.unfinished, MAX_BALLS);
+        batch_free(&b);
+    }
+    printf("\n");
+    return 0;
+}
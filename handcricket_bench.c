@@ -0,0 +1,263 @@
+/*
+ * HAND CRICKET GAME - Micro-benchmarks
+ * Times the server's hot paths in-process: the computer AI, the rules
+ * engine and every page renderer. The server source is compiled into this
+ * binary directly so the code measured is exactly the code that ships.
+ *
+ * Compile: gcc -O2 handcricket_bench.c -o handcricket_bench -pthread
+ * Run: ./handcricket_bench                  (table on stdout)
+ *      ./handcricket_bench -o bench.json     (also write JSON lines)
+ *      ./handcricket_bench -f build_page     (only benchmarks matching a filter)
+ *      ./handcricket_bench -b old.json       (show ns/op change against an earlier run)
+ *      ./handcricket_bench -s strategy.bin   (also time the Optimal AI from a solver table)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+
+/* ==================== ALLOCATION COUNTING ==================== */
+/* Every allocation made by the server code is routed through these */
+uint64_t bench_allocs = 0;
+uint64_t bench_alloc_bytes = 0;
+
+void *bench_malloc(size_t n) { bench_allocs++; bench_alloc_bytes += n; return malloc(n); }
+void *bench_calloc(size_t c, size_t n) { bench_allocs++; bench_alloc_bytes += c * n; return calloc(c, n); }
+void *bench_realloc(void *p, size_t n) { bench_allocs++; bench_alloc_bytes += n; return realloc(p, n); }
+
+#define malloc(n) bench_malloc(n)
+#define calloc(c, n) bench_calloc(c, n)
+#define realloc(p, n) bench_realloc(p, n)
+
+#define HANDCRICKET_NO_MAIN
+#include "new_handcricket.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+/* ==================== HARNESS ==================== */
+#define MIN_BENCH_NS 200000000ull
+
+typedef struct {
+    char name[64];
+    double ns_per_op;
+    double ops_per_sec;
+    double bytes_per_op;
+    double allocs_per_op;
+    uint64_t iterations;
+} BenchResult;
+
+typedef uint64_t (*BenchFn)(void *ctx, uint64_t iters); /* returns bytes produced */
+
+const char *name_filter = NULL;
+FILE *json_out = NULL;
+volatile uint64_t bench_sink;
+
+/* Results from an earlier -o run, for side-by-side comparison */
+#define MAX_BASELINE 128
+struct { char name[64]; double ns_per_op; } baseline[MAX_BASELINE];
+int baseline_count = 0;
+
+void load_baseline(const char *file) {
+    FILE *f = fopen(file, "r");
+    char line[512];
+    if (!f) { perror(file); return; }
+    while (baseline_count < MAX_BASELINE && fgets(line, sizeof(line), f)) {
+        char *ns = strstr(line, "\"ns_per_op\":");
+        if (sscanf(line, "{\"name\":\"%63[^\"]\"", baseline[baseline_count].name) == 1 && ns) {
+            baseline[baseline_count].ns_per_op = atof(ns + 12);
+            baseline_count++;
+        }
+    }
+    fclose(f);
+}
+
+const char* baseline_delta(const char *name, double ns_per_op) {
+    static char text[32];
+    text[0] = '\0';
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) == 0 && baseline[i].ns_per_op > 0) {
+            snprintf(text, sizeof(text), " %+7.1f%%", (ns_per_op - baseline[i].ns_per_op) / baseline[i].ns_per_op * 100.0);
+            break;
+        }
+    }
+    return text;
+}
+
+/* Doubles the iteration count until one run lasts at least MIN_BENCH_NS */
+void run_bench(const char *name, BenchFn fn, void *ctx) {
+    BenchResult r;
+    uint64_t iters = 16, elapsed = 0, bytes = 0, allocs = 0;
+
+    if (name_filter && !strstr(name, name_filter)) return;
+
+    fn(ctx, iters); /* warm caches */
+    for (;;) {
+        uint64_t a0 = bench_allocs;
+        uint64_t t0 = now_ns();
+        bytes = fn(ctx, iters);
+        elapsed = now_ns() - t0;
+        allocs = bench_allocs - a0;
+        if (elapsed >= MIN_BENCH_NS || iters >= (1ull << 32)) break;
+        iters *= elapsed < MIN_BENCH_NS / 16 ? 8 : 2;
+    }
+
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    r.iterations = iters;
+    r.ns_per_op = (double)elapsed / iters;
+    r.ops_per_sec = iters * 1e9 / elapsed;
+    r.bytes_per_op = (double)bytes / iters;
+    r.allocs_per_op = (double)allocs / iters;
+
+    printf("%-34s %12.1f ns/op %14.0f ops/s %10.0f B/op %8.2f allocs/op%s\n",
+        r.name, r.ns_per_op, r.ops_per_sec, r.bytes_per_op, r.allocs_per_op,
+        baseline_delta(r.name, r.ns_per_op));
+    if (json_out) {
+        fprintf(json_out,
+            "{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.3f,\"ops_per_sec\":%.1f,"
+            "\"bytes_per_op\":%.1f,\"allocs_per_op\":%.4f}\n",
+            r.name, (unsigned long long)r.iterations, r.ns_per_op, r.ops_per_sec,
+            r.bytes_per_op, r.allocs_per_op);
+    }
+}
+
+/* A session in the middle of an innings with a given move history */
+void setup_session(GameSession *s, int difficulty, int history) {
+    memset(s, 0, sizeof(*s));
+    strcpy(s->session_id, "1700000000000042");
+    s->difficulty = difficulty;
+    reset_game(s);
+    s->game_phase = 3;
+    s->is_batting = 1;
+    for (int i = 0; i < history; i++) s->prev_moves[i] = rand() % 11;
+    s->move_count = history;
+    s->last_player_input = 4;
+    s->last_computer_move = 7;
+    s->player_score = 42;
+    s->computer_score = 17;
+    strcpy(s->message, "You: 4 | Computer: 7 | +4 runs!");
+}
+
+/* ==================== BENCHMARKS ==================== */
+uint64_t bench_ai(void *ctx, uint64_t iters) {
+    GameSession *s = ctx;
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++) acc += generate_computer_move(s);
+    bench_sink = acc;
+    return 0;
+}
+
+uint64_t bench_play(void *ctx, uint64_t iters) {
+    GameSession *s = ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        handle_play(s, (int)(i % 11));
+        if (s->game_phase == 4) { reset_game(s); s->game_phase = 3; s->is_batting = (int)(i & 1); }
+    }
+    bench_sink = (uint64_t)s->player_score;
+    return 0;
+}
+
+typedef struct {
+    void (*render)(Buf *resp, GameSession *s);
+    GameSession *s;
+} PageCtx;
+
+/* Renders into a pooled buffer per page, as client_thread does */
+uint64_t bench_page(void *ctx, uint64_t iters) {
+    PageCtx *pc = ctx;
+    uint64_t bytes = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        Buf resp = buf_get(RESPONSE_INITIAL);
+        pc->render(&resp, pc->s);
+        bytes += resp.len;
+        buf_put(&resp);
+    }
+    return bytes;
+}
+
+uint64_t bench_metrics_page(void *ctx, uint64_t iters) {
+    uint64_t bytes = 0;
+    (void)ctx;
+    for (uint64_t i = 0; i < iters; i++) {
+        Buf resp = buf_get(RESPONSE_INITIAL);
+        build_page_metrics(&resp);
+        bytes += resp.len;
+        buf_put(&resp);
+    }
+    return bytes;
+}
+
+/* ==================== MAIN FUNCTION ==================== */
+int main(int argc, char **argv) {
+    const char *out_file = NULL;
+    char name[64];
+    GameSession s;
+    int c, levels = 3;
+
+    while ((c = getopt(argc, argv, "o:f:b:s:h")) != -1) {
+        switch (c) {
+            case 'o': out_file = optarg; break;
+            case 'f': name_filter = optarg; break;
+            case 'b': load_baseline(optarg); break;
+            case 's':
+                if (strategy_load(optarg) < 0) { fprintf(stderr, "%s: not a strategy table\n", optarg); return 1; }
+                levels = DIFFICULTY_OPTIMAL;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o results.json] [-f name-filter] [-b baseline.json] [-s strategy.bin]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (out_file && !(json_out = fopen(out_file, "w"))) {
+        perror(out_file);
+        return 1;
+    }
+
+    srand(12345);
+    server_start_time = time(NULL);
+    pool_init();
+
+    /* AI cost per difficulty as the innings history grows */
+    const int histories[] = {0, 1, 10, 50, 100};
+    const char *diff_names[] = {"", "easy", "medium", "hard", "optimal"};
+    for (int d = 1; d <= levels; d++) {
+        for (size_t h = 0; h < sizeof(histories) / sizeof(histories[0]); h++) {
+            setup_session(&s, d, histories[h]);
+            snprintf(name, sizeof(name), "ai/%s/history=%d", diff_names[d], histories[h]);
+            run_bench(name, bench_ai, &s);
+        }
+    }
+
+    /* Full rules engine steps, restarting matches as they finish */
+    for (int d = 1; d <= levels; d++) {
+        setup_session(&s, d, 0);
+        snprintf(name, sizeof(name), "handle_play/%s", diff_names[d]);
+        run_bench(name, bench_play, &s);
+    }
+
+    /* Page renderers in isolation */
+    struct { const char *name; void (*render)(Buf *, GameSession *); } pages[] = {
+        {"build_page_menu", build_page_menu},
+        {"build_page_help", build_page_help},
+        {"build_page_toss", build_page_toss},
+        {"build_page_choose", build_page_choose},
+        {"build_page_game", build_page_game},
+        {"build_page_gameover", build_page_gameover},
+    };
+    for (size_t i = 0; i < sizeof(pages) / sizeof(pages[0]); i++) {
+        PageCtx pc = { pages[i].render, &s };
+        setup_session(&s, 3, 20);
+        s.second_innings = 1;
+        s.first_innings_score = 60;
+        run_bench(pages[i].name, bench_page, &pc);
+    }
+    run_bench("build_page_metrics", bench_metrics_page, NULL);
+
+    if (json_out) fclose(json_out);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * HAND CRICKET GAME - Traffic capture format
+ * Written by the web server (--capture FILE), read by handcricket_replay.
+ *
+ * A capture is a 16-byte header followed by fixed 128-byte records, one
+ * per HTTP request, appended as requests finish. Session cookies are kept
+ * as matchlog_key() hashes, which is all a replay needs to tell which
+ * requests came from the same browser.
+ */
+
+#ifndef HANDCRICKET_CAPTURE_H
+#define HANDCRICKET_CAPTURE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define CAPTURE_MAGIC "HCCAPT"
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_PATH_MAX 84     /* longer paths are truncated */
+
+/* Record flags */
+#define CAPTURE_HTTP2       0x01 /* arrived as an HTTP/2 stream */
+#define CAPTURE_TRUNCATED   0x02 /* path did not fit */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} CaptureHeader;
+
+typedef struct {
+    uint64_t timestamp_us;   /* wall clock when the request arrived, microseconds since the epoch */
+    uint64_t session;        /* matchlog_key() of the session cookie sent, 0 if none */
+    uint64_t served;         /* matchlog_key() of the session that answered, 0 if none */
+    uint64_t player;         /* player cookie sent, 0 if none */
+    uint32_t latency_us;     /* time the server spent on it */
+    uint32_t bytes;          /* response bytes */
+    uint16_t status;         /* 0 if no response line was sent */
+    uint8_t flags;
+    uint8_t reserved;
+    char path[CAPTURE_PATH_MAX]; /* NUL-terminated unless it fills the field */
+} CaptureRecord;
+
+static inline void capture_init_header(CaptureHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    h->version = CAPTURE_VERSION;
+    h->record_size = sizeof(CaptureRecord);
+}
+
+static inline int capture_header_ok(const CaptureHeader *h) {
+    return memcmp(h->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0 &&
+           h->version == CAPTURE_VERSION && h->record_size == sizeof(CaptureRecord);
+}
+
+#endif /* HANDCRICKET_CAPTURE_H */
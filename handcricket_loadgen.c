@@ -0,0 +1,438 @@
+/*
+ * HAND CRICKET GAME - HTTP Load Generator
+ * Drives full matches against a running new_handcricket server with many
+ * concurrent simulated players and reports throughput and latency.
+ *
+ * Compile: gcc -O2 handcricket_loadgen.c -o handcricket_loadgen -pthread
+ * Run: ./handcricket_loadgen -c 64 -m 20
+ *      ./handcricket_loadgen -c 64 -d 30 -k -o run.txt -b baseline.txt
+ * Every player shares one source address, so start the server with
+ * --rate-limit 0 or most requests will be answered 429.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define RESP_SIZE 262144
+#define MAX_BALLS_PER_MATCH 1000
+
+/* ==================== OPTIONS ==================== */
+typedef struct {
+    char host[64];
+    int port;
+    int concurrency;
+    int matches;        /* matches per player, 0 = run for duration */
+    int duration;       /* seconds, 0 = run for match count */
+    int keepalive;
+    int think_ms;
+    int difficulty;
+    const char *out_file;
+    const char *baseline_file;
+} Options;
+
+Options opt = { "127.0.0.1", 8080, 16, 20, 0, 0, 0, 1, NULL, NULL };
+
+/* ==================== PER-PLAYER STATE ==================== */
+typedef struct {
+    int id;
+    pthread_t tid;
+    uint64_t rng;
+    int sock;
+    char cookie[64];
+    char *resp;
+    size_t resp_len;
+    uint32_t *lat_us;   /* one entry per request */
+    size_t lat_count, lat_cap;
+    uint32_t *play_us;  /* /play/N requests only */
+    size_t play_count, play_cap;
+    uint64_t requests, errors, matches, balls, bytes, reconnects;
+} Player;
+
+volatile sig_atomic_t stop_flag = 0;
+struct sockaddr_in server_addr;
+
+/* Ctrl+C stops the run early and still prints the report */
+void on_sigint(int sig) {
+    (void)sig;
+    stop_flag = 1;
+}
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift64* - each player has its own stream */
+uint32_t next_rand(Player *p) {
+    p->rng ^= p->rng >> 12;
+    p->rng ^= p->rng << 25;
+    p->rng ^= p->rng >> 27;
+    return (uint32_t)((p->rng * 2685821657736338717ull) >> 32);
+}
+
+void push_latency(uint32_t **arr, size_t *count, size_t *cap, uint32_t v) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *arr = realloc(*arr, *cap * sizeof(uint32_t));
+    }
+    (*arr)[(*count)++] = v;
+}
+
+/* ==================== HTTP CLIENT ==================== */
+int open_connection(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Find a header value (case-insensitive name) inside the response head */
+const char* find_header(const char *head, size_t head_len, const char *name) {
+    size_t nlen = strlen(name);
+    const char *p = head, *end = head + head_len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) break;
+        if ((size_t)(eol - p) > nlen && strncasecmp(p, name, nlen) == 0 && p[nlen] == ':') {
+            p += nlen + 1;
+            while (*p == ' ') p++;
+            return p;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+/*
+ * Send one GET and read the full response into p->resp.
+ * Bodies are delimited by Content-Length when present, otherwise by the
+ * server closing the connection. Returns the HTTP status or -1.
+ */
+int http_get(Player *p, const char *path) {
+    char req[512];
+    int len = snprintf(req, sizeof(req),
+        "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUser-Agent: handcricket-loadgen\r\n%s%s%sConnection: %s\r\n\r\n",
+        path, opt.host, opt.port,
+        p->cookie[0] ? "Cookie: session=" : "", p->cookie, p->cookie[0] ? "\r\n" : "",
+        opt.keepalive ? "keep-alive" : "close");
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int reused = (p->sock >= 0);
+        if (p->sock < 0) {
+            p->sock = open_connection();
+            if (p->sock < 0) return -1;
+        }
+        if (write(p->sock, req, len) != len) {
+            close(p->sock); p->sock = -1;
+            if (reused) { p->reconnects++; continue; }
+            return -1;
+        }
+
+        size_t got = 0, head_len = 0;
+        long content_length = -1;
+        int closed = 0;
+        while (got < RESP_SIZE - 1) {
+            ssize_t n = read(p->sock, p->resp + got, RESP_SIZE - 1 - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { closed = 1; break; }
+            got += (size_t)n;
+            p->resp[got] = '\0';
+            if (!head_len) {
+                char *hdr_end = strstr(p->resp, "\r\n\r\n");
+                if (hdr_end) {
+                    head_len = (size_t)(hdr_end - p->resp) + 4;
+                    const char *cl = find_header(p->resp, head_len, "Content-Length");
+                    if (cl) content_length = atol(cl);
+                }
+            }
+            if (head_len && content_length >= 0 && got >= head_len + (size_t)content_length) break;
+        }
+        p->resp[got] = '\0';
+
+        /* A kept-alive socket the server already closed: retry once on a fresh one */
+        if (got == 0 && reused) { close(p->sock); p->sock = -1; p->reconnects++; continue; }
+        if (!head_len) { close(p->sock); p->sock = -1; return -1; }
+        p->resp_len = got;
+        p->bytes += got;
+
+        const char *conn = find_header(p->resp, head_len, "Connection");
+        if (closed || !opt.keepalive || content_length < 0 || (conn && strncasecmp(conn, "close", 5) == 0)) {
+            close(p->sock);
+            p->sock = -1;
+        }
+
+        /* With --profiles the player cookie comes first; look through every Set-Cookie line */
+        for (const char *ck = p->resp; (ck = find_header(ck, head_len - (size_t)(ck - p->resp), "Set-Cookie")); ) {
+            if (strncmp(ck, "session=", 8) == 0) {
+                int i = 0;
+                ck += 8;
+                while (ck[i] && ck[i] != ';' && ck[i] != '\r' && i < 63) { p->cookie[i] = ck[i]; i++; }
+                p->cookie[i] = '\0';
+                break;
+            }
+        }
+        return atoi(p->resp + 9);
+    }
+    return -1;
+}
+
+/* Timed request; returns 1 on a 200 response */
+int timed_get(Player *p, const char *path, int is_play) {
+    if (opt.think_ms > 0) {
+        struct timespec ts = { opt.think_ms / 1000, (opt.think_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    uint64_t t0 = now_ns();
+    int status = http_get(p, path);
+    uint32_t us = (uint32_t)((now_ns() - t0) / 1000);
+    p->requests++;
+    push_latency(&p->lat_us, &p->lat_count, &p->lat_cap, us);
+    if (is_play) push_latency(&p->play_us, &p->play_count, &p->play_cap, us);
+    if (status != 200) { p->errors++; return 0; }
+    return 1;
+}
+
+/* ==================== MATCH DRIVER ==================== */
+
+/* Plays one match: /start, /toss, optionally /choose, then /play/N until game over */
+int play_match(Player *p) {
+    char path[64];
+    int last = -1, repeats = 0;
+
+    if (!timed_get(p, "/start", 0)) return 0;
+    if (!timed_get(p, (next_rand(p) & 1) ? "/toss/head" : "/toss/tail", 0)) return 0;
+    if (strstr(p->resp, "/choose/bat")) {
+        if (!timed_get(p, (next_rand(p) & 1) ? "/choose/bat" : "/choose/bowl", 0)) return 0;
+    }
+
+    for (int ball = 0; ball < MAX_BALLS_PER_MATCH && !stop_flag; ball++) {
+        int n = (int)(next_rand(p) % 11);
+        /* Never trip the five-in-a-row rule on purpose */
+        if (n == last && ++repeats >= 4) { n = (n + 1) % 11; repeats = 1; }
+        else if (n != last) repeats = 1;
+        last = n;
+        snprintf(path, sizeof(path), "/play/%d", n);
+        if (!timed_get(p, path, 1)) return 0;
+        p->balls++;
+        if (strstr(p->resp, "Game Over!")) return 1;
+    }
+    return 0;
+}
+
+void *player_thread(void *arg) {
+    Player *p = arg;
+    char path[32];
+    uint64_t deadline = opt.duration ? now_ns() + (uint64_t)opt.duration * 1000000000ull : 0;
+
+    snprintf(path, sizeof(path), "/diff/%d", opt.difficulty);
+    timed_get(p, path, 0);
+
+    for (int m = 0; !stop_flag; m++) {
+        if (opt.matches && m >= opt.matches) break;
+        if (deadline && now_ns() >= deadline) break;
+        if (play_match(p)) p->matches++;
+    }
+    if (p->sock >= 0) close(p->sock);
+    return NULL;
+}
+
+/* ==================== REPORTING ==================== */
+int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+double percentile(const uint32_t *sorted, size_t n, double q) {
+    if (n == 0) return 0;
+    size_t idx = (size_t)(q * (double)(n - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+typedef struct {
+    const char *key;
+    double value;
+} Result;
+
+#define MAX_RESULTS 32
+Result results[MAX_RESULTS];
+int result_count = 0;
+
+void add_result(const char *key, double value) {
+    if (result_count < MAX_RESULTS) {
+        results[result_count].key = key;
+        results[result_count].value = value;
+        result_count++;
+    }
+}
+
+/* Baseline files are the key=value files written by -o */
+void compare_baseline(const char *file) {
+    FILE *f = fopen(file, "r");
+    char line[256], key[128];
+    double value;
+    if (!f) { fprintf(stderr, "cannot open baseline %s\n", file); return; }
+    printf("\n  Compared with baseline %s:\n", file);
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%127[^=]=%lf", key, &value) != 2) continue;
+        for (int i = 0; i < result_count; i++) {
+            if (strcmp(results[i].key, key) != 0) continue;
+            double delta = value != 0 ? (results[i].value - value) / value * 100.0 : 0;
+            printf("    %-22s %12.3f -> %12.3f  (%+.1f%%)\n", key, value, results[i].value, delta);
+        }
+    }
+    fclose(f);
+}
+
+void report(Player *players, double elapsed_s) {
+    uint64_t requests = 0, errors = 0, matches = 0, balls = 0, bytes = 0, reconnects = 0;
+    size_t n = 0, np = 0;
+    for (int i = 0; i < opt.concurrency; i++) {
+        requests += players[i].requests; errors += players[i].errors;
+        matches += players[i].matches; balls += players[i].balls;
+        bytes += players[i].bytes; reconnects += players[i].reconnects;
+        n += players[i].lat_count; np += players[i].play_count;
+    }
+
+    uint32_t *all = malloc((n ? n : 1) * sizeof(uint32_t));
+    uint32_t *play = malloc((np ? np : 1) * sizeof(uint32_t));
+    size_t off = 0, poff = 0;
+    double sum = 0;
+    for (int i = 0; i < opt.concurrency; i++) {
+        memcpy(all + off, players[i].lat_us, players[i].lat_count * sizeof(uint32_t));
+        memcpy(play + poff, players[i].play_us, players[i].play_count * sizeof(uint32_t));
+        off += players[i].lat_count;
+        poff += players[i].play_count;
+    }
+    for (size_t i = 0; i < n; i++) sum += all[i];
+    qsort(all, n, sizeof(uint32_t), cmp_u32);
+    qsort(play, np, sizeof(uint32_t), cmp_u32);
+
+    add_result("requests_per_sec", requests / elapsed_s);
+    add_result("matches_per_sec", matches / elapsed_s);
+    add_result("error_rate", requests ? (double)errors / requests : 0);
+    add_result("latency_mean_ms", n ? sum / n / 1000.0 : 0);
+    add_result("latency_p50_ms", percentile(all, n, 0.50));
+    add_result("latency_p99_ms", percentile(all, n, 0.99));
+    add_result("latency_p999_ms", percentile(all, n, 0.999));
+    add_result("latency_max_ms", n ? all[n - 1] / 1000.0 : 0);
+    add_result("play_p50_ms", percentile(play, np, 0.50));
+    add_result("play_p99_ms", percentile(play, np, 0.99));
+    add_result("play_p999_ms", percentile(play, np, 0.999));
+
+    printf("\n");
+    printf("  Target:        %s:%d (%d players, keep-alive %s, think %d ms)\n",
+        opt.host, opt.port, opt.concurrency, opt.keepalive ? "on" : "off", opt.think_ms);
+    printf("  Elapsed:       %.2f s\n", elapsed_s);
+    printf("  Requests:      %llu (%llu errors, %llu reconnects)\n",
+        (unsigned long long)requests, (unsigned long long)errors, (unsigned long long)reconnects);
+    printf("  Matches:       %llu complete, %llu balls\n", (unsigned long long)matches, (unsigned long long)balls);
+    printf("  Throughput:    %.1f req/s, %.1f matches/s, %.2f MB/s\n",
+        requests / elapsed_s, matches / elapsed_s, bytes / elapsed_s / 1e6);
+    printf("  Latency (ms):  p50 %.3f  p99 %.3f  p999 %.3f  max %.3f  mean %.3f\n",
+        percentile(all, n, 0.50), percentile(all, n, 0.99), percentile(all, n, 0.999),
+        n ? all[n - 1] / 1000.0 : 0, n ? sum / n / 1000.0 : 0);
+    printf("  /play (ms):    p50 %.3f  p99 %.3f  p999 %.3f\n",
+        percentile(play, np, 0.50), percentile(play, np, 0.99), percentile(play, np, 0.999));
+
+    if (opt.out_file) {
+        FILE *f = fopen(opt.out_file, "w");
+        if (f) {
+            for (int i = 0; i < result_count; i++) fprintf(f, "%s=%.6f\n", results[i].key, results[i].value);
+            fclose(f);
+        } else fprintf(stderr, "cannot write %s\n", opt.out_file);
+    }
+    if (opt.baseline_file) compare_baseline(opt.baseline_file);
+
+    free(all);
+    free(play);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -H host     server address (default 127.0.0.1)\n"
+        "  -p port     server port (default 8080)\n"
+        "  -c n        concurrent players (default 16)\n"
+        "  -m n        matches per player (default 20)\n"
+        "  -d secs     run for a fixed duration instead of a match count\n"
+        "  -k          use HTTP keep-alive when the server allows it\n"
+        "  -t ms       think time before each request (default 0)\n"
+        "  -D 1|2|3    difficulty to play at (default 1)\n"
+        "  -o file     write results as key=value lines\n"
+        "  -b file     compare against a previous -o file\n", prog);
+}
+
+/* ==================== MAIN FUNCTION ==================== */
+int main(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "H:p:c:m:d:kt:D:o:b:h")) != -1) {
+        switch (c) {
+            case 'H': snprintf(opt.host, sizeof(opt.host), "%s", optarg); break;
+            case 'p': opt.port = atoi(optarg); break;
+            case 'c': opt.concurrency = atoi(optarg); break;
+            case 'm': opt.matches = atoi(optarg); break;
+            case 'd': opt.duration = atoi(optarg); opt.matches = 0; break;
+            case 'k': opt.keepalive = 1; break;
+            case 't': opt.think_ms = atoi(optarg); break;
+            case 'D': opt.difficulty = atoi(optarg); break;
+            case 'o': opt.out_file = optarg; break;
+            case 'b': opt.baseline_file = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (opt.concurrency < 1 || (opt.matches < 1 && opt.duration < 1) || opt.difficulty < 1 || opt.difficulty > 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "invalid address %s\n", opt.host);
+        return 1;
+    }
+
+    signal(SIGINT, on_sigint);
+    signal(SIGPIPE, SIG_IGN);
+
+    Player *players = calloc(opt.concurrency, sizeof(Player));
+    uint64_t seed = now_ns();
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < opt.concurrency; i++) {
+        players[i].id = i;
+        players[i].sock = -1;
+        players[i].rng = (seed + (uint64_t)i * 0x9E3779B97F4A7C15ull) | 1;
+        players[i].resp = malloc(RESP_SIZE);
+        pthread_create(&players[i].tid, NULL, player_thread, &players[i]);
+    }
+    for (int i = 0; i < opt.concurrency; i++) pthread_join(players[i].tid, NULL);
+
+    report(players, (now_ns() - t0) / 1e9);
+
+    for (int i = 0; i < opt.concurrency; i++) {
+        free(players[i].resp);
+        free(players[i].lat_us);
+        free(players[i].play_us);
+    }
+    free(players);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * HAND CRICKET GAME - Match log reader
+ * Memory-maps a match log written by new_handcricket or handcricket
+ * (--match-log FILE) and scans it for analytics and AI tuning.
+ *
+ * Compile: gcc -O2 handcricket_matchlog.c -o handcricket_matchlog
+ * Run: ./handcricket_matchlog balls.log              (summary)
+ *      ./handcricket_matchlog -d 3 balls.log         (hard difficulty only)
+ *      ./handcricket_matchlog -n 20 balls.log        (also dump the last 20 balls)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "handcricket_matchlog.h"
+
+/* ==================== AGGREGATES ==================== */
+typedef struct {
+    uint64_t balls;
+    uint64_t outs;
+    uint64_t repeat_outs;
+    uint64_t runs;
+    uint64_t batting_balls;     /* balls where the human batted */
+    uint64_t batting_outs;      /* ...and was caught by the computer's pick */
+    uint64_t bowling_balls;
+    uint64_t bowling_outs;      /* computer out while the human bowled */
+    uint64_t matches;           /* balls flagged MATCHLOG_GAME_OVER */
+    uint64_t player_picks[11];
+    uint64_t computer_picks[11];
+    uint64_t transitions[11][11]; /* human pick -> next human pick, same session */
+} Stats;
+
+Stats by_difficulty[5];
+
+/* Open-addressing set of session keys, used for distinct counts and transitions */
+typedef struct {
+    uint64_t key;
+    int last_pick;
+} SessionSlot;
+
+SessionSlot *session_table = NULL;
+uint64_t session_mask = 0;
+uint64_t session_count = 0;
+
+SessionSlot* session_slot(uint64_t key) {
+    uint64_t i = (key * 0x9E3779B97F4A7C15ull) & session_mask;
+    if (key == 0) key = 1; /* 0 marks an empty slot */
+    while (session_table[i].key && session_table[i].key != key) i = (i + 1) & session_mask;
+    if (!session_table[i].key) {
+        session_table[i].key = key;
+        session_table[i].last_pick = -1;
+        session_count++;
+    }
+    return &session_table[i];
+}
+
+void scan(const MatchLogRecord *rec, uint64_t n, int difficulty) {
+    for (uint64_t i = 0; i < n; i++) {
+        const MatchLogRecord *r = &rec[i];
+        if (difficulty && r->difficulty != difficulty) continue;
+        Stats *st = &by_difficulty[r->difficulty <= 4 ? r->difficulty : 0];
+        int batting = (r->flags & MATCHLOG_PLAYER_BATTING) != 0;
+        int out = (r->flags & MATCHLOG_OUT) != 0;
+
+        st->balls++;
+        st->runs += r->runs;
+        st->outs += out;
+        st->repeat_outs += (r->flags & MATCHLOG_REPEAT_OUT) != 0;
+        st->matches += (r->flags & MATCHLOG_GAME_OVER) != 0;
+        if (batting) { st->batting_balls++; st->batting_outs += out && !(r->flags & MATCHLOG_REPEAT_OUT); }
+        else { st->bowling_balls++; st->bowling_outs += out; }
+        if (r->player_number <= 10) st->player_picks[r->player_number]++;
+        if (r->computer_number <= 10) st->computer_picks[r->computer_number]++;
+
+        SessionSlot *slot = session_slot(r->session);
+        if (slot->last_pick >= 0 && r->player_number <= 10) st->transitions[slot->last_pick][r->player_number]++;
+        slot->last_pick = (r->flags & MATCHLOG_GAME_OVER) ? -1 : r->player_number;
+    }
+}
+
+double pct(uint64_t a, uint64_t b) {
+    return b ? 100.0 * (double)a / (double)b : 0.0;
+}
+
+void print_stats(const char *label, const Stats *st) {
+    if (!st->balls) return;
+    printf("\n  [%s]\n", label);
+    printf("    Balls: %llu   Runs/ball: %.3f   Completed matches: %llu\n",
+        (unsigned long long)st->balls, (double)st->runs / st->balls, (unsigned long long)st->matches);
+    printf("    Human batting: %llu balls, computer took %llu wickets (%.2f%% per ball), %llu repeat outs\n",
+        (unsigned long long)st->batting_balls, (unsigned long long)st->batting_outs,
+        pct(st->batting_outs, st->batting_balls), (unsigned long long)st->repeat_outs);
+    printf("    Human bowling: %llu balls, %llu wickets (%.2f%% per ball)\n",
+        (unsigned long long)st->bowling_balls, (unsigned long long)st->bowling_outs,
+        pct(st->bowling_outs, st->bowling_balls));
+
+    uint64_t total_picks = 0, total_comp = 0;
+    for (int i = 0; i <= 10; i++) { total_picks += st->player_picks[i]; total_comp += st->computer_picks[i]; }
+    printf("    Pick      ");
+    for (int i = 0; i <= 10; i++) printf("%6d", i);
+    printf("\n    Human %%   ");
+    for (int i = 0; i <= 10; i++) printf("%6.1f", pct(st->player_picks[i], total_picks));
+    printf("\n    Computer %%");
+    for (int i = 0; i <= 10; i++) printf("%6.1f", pct(st->computer_picks[i], total_comp));
+    printf("\n");
+
+    /* How often the human repeats or moves to a neighbour: what the AI can exploit */
+    uint64_t trans = 0, same = 0, adjacent = 0;
+    for (int a = 0; a <= 10; a++) {
+        for (int b = 0; b <= 10; b++) {
+            trans += st->transitions[a][b];
+            if (a == b) same += st->transitions[a][b];
+            else if (abs(a - b) == 1) adjacent += st->transitions[a][b];
+        }
+    }
+    printf("    Human repeats last pick %.2f%%, moves to a neighbour %.2f%% (of %llu transitions)\n",
+        pct(same, trans), pct(adjacent, trans), (unsigned long long)trans);
+}
+
+void dump(const MatchLogRecord *rec, uint64_t n, uint64_t count, int difficulty) {
+    uint64_t start = n > count ? n - count : 0;
+    printf("\n  %-26s %-16s %3s %4s %4s %4s %-5s %s\n", "time", "session", "inn", "you", "comp", "runs", "diff", "flags");
+    for (uint64_t i = start; i < n; i++) {
+        const MatchLogRecord *r = &rec[i];
+        char when[32], comp[8];
+        time_t secs = (time_t)(r->timestamp_us / 1000000);
+        if (difficulty && r->difficulty != difficulty) continue;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&secs));
+        if (r->computer_number == MATCHLOG_NO_NUMBER) strcpy(comp, "-");
+        else snprintf(comp, sizeof(comp), "%d", r->computer_number);
+        printf("  %s.%06llu %016llx %3d %4d %4s %4d %-5d %s%s%s%s%s\n",
+            when, (unsigned long long)(r->timestamp_us % 1000000), (unsigned long long)r->session,
+            r->innings, r->player_number, comp, r->runs, r->difficulty,
+            r->source == MATCHLOG_SOURCE_CONSOLE ? "console " : "web ",
+            (r->flags & MATCHLOG_PLAYER_BATTING) ? "bat " : "bowl ",
+            (r->flags & MATCHLOG_OUT) ? "OUT " : "",
+            (r->flags & MATCHLOG_REPEAT_OUT) ? "REPEAT " : "",
+            (r->flags & MATCHLOG_GAME_OVER) ? "END" : "");
+    }
+}
+
+/* ==================== MAIN FUNCTION ==================== */
+int main(int argc, char **argv) {
+    int difficulty = 0, c;
+    long dump_count = 0;
+
+    while ((c = getopt(argc, argv, "d:n:h")) != -1) {
+        switch (c) {
+            case 'd': difficulty = atoi(optarg); break;
+            case 'n': dump_count = atol(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-d difficulty] [-n last-N-balls] FILE\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-d difficulty] [-n last-N-balls] FILE\n", argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) { perror(path); return 1; }
+    if ((size_t)st.st_size < sizeof(MatchLogHeader)) { fprintf(stderr, "%s: too short to be a match log\n", path); return 1; }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror("mmap"); return 1; }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    const MatchLogHeader *h = map;
+    if (!matchlog_header_ok(h)) { fprintf(stderr, "%s: not a match log (or a different version)\n", path); return 1; }
+    const MatchLogRecord *rec = (const MatchLogRecord *)(h + 1);
+    /* A writer may be mid-append; ignore a trailing partial record */
+    uint64_t n = (st.st_size - sizeof(MatchLogHeader)) / sizeof(MatchLogRecord);
+
+    /* Size the session set for the worst case of one session per ball */
+    uint64_t cap = 1024;
+    while (cap < n * 2) cap <<= 1;
+    session_table = calloc(cap, sizeof(SessionSlot));
+    session_mask = cap - 1;
+    if (!session_table) { fprintf(stderr, "out of memory\n"); return 1; }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    scan(rec, n, difficulty);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("\n  Match log: %s\n", path);
+    printf("  Records: %llu (%.1f MB) in %.3f s = %.1f M records/s\n",
+        (unsigned long long)n, st.st_size / 1e6, secs, secs > 0 ? n / secs / 1e6 : 0.0);
+    printf("  Distinct sessions: %llu\n", (unsigned long long)session_count);
+    if (n) {
+        time_t first = (time_t)(rec[0].timestamp_us / 1000000), last = (time_t)(rec[n - 1].timestamp_us / 1000000);
+        char a[32], b[32];
+        strftime(a, sizeof(a), "%Y-%m-%d %H:%M:%S", localtime(&first));
+        strftime(b, sizeof(b), "%Y-%m-%d %H:%M:%S", localtime(&last));
+        printf("  Span: %s .. %s\n", a, b);
+    }
+
+    print_stats("EASY", &by_difficulty[1]);
+    print_stats("MEDIUM", &by_difficulty[2]);
+    print_stats("HARD", &by_difficulty[3]);
+    print_stats("OPTIMAL", &by_difficulty[4]);
+    print_stats("OTHER", &by_difficulty[0]);
+
+    if (dump_count > 0) dump(rec, n, (uint64_t)dump_count, difficulty);
+    printf("\n");
+
+    free(session_table);
+    munmap(map, st.st_size);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * HAND CRICKET GAME - Match log format
+ * Shared by the web server, the console game and the log reader.
+ *
+ * A match log is a 16-byte header followed by fixed 24-byte records, one
+ * per ball, appended in the order they were played. Records never change
+ * once written, so readers can mmap a log that is still being appended to.
+ */
+
+#ifndef HANDCRICKET_MATCHLOG_H
+#define HANDCRICKET_MATCHLOG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define MATCHLOG_MAGIC "HCBALLS"
+#define MATCHLOG_VERSION 1
+
+/* Record flags */
+#define MATCHLOG_OUT            0x01 /* the batsman was out on this ball */
+#define MATCHLOG_REPEAT_OUT     0x02 /* out for picking the same number 5 times */
+#define MATCHLOG_PLAYER_BATTING 0x04 /* the human was batting */
+#define MATCHLOG_GAME_OVER      0x08 /* this ball ended the match */
+
+/* Record sources */
+#define MATCHLOG_SOURCE_WEB     0
+#define MATCHLOG_SOURCE_CONSOLE 1
+
+#define MATCHLOG_NO_NUMBER 0xFF /* computer never picked (repeat out) */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} MatchLogHeader;
+
+typedef struct {
+    uint64_t timestamp_us;   /* wall clock, microseconds since the epoch */
+    uint64_t session;        /* matchlog_key() of the session id */
+    uint8_t innings;         /* 1 or 2 */
+    uint8_t player_number;   /* 0-10 */
+    uint8_t computer_number; /* 0-10 or MATCHLOG_NO_NUMBER */
+    uint8_t runs;            /* runs scored off this ball */
+    uint8_t flags;
+    uint8_t difficulty;      /* 1 = easy, 2 = medium, 3 = hard, 4 = optimal */
+    uint8_t source;
+    uint8_t reserved;
+} MatchLogRecord;
+
+/* 64-bit FNV-1a, used to turn session ids into fixed-size keys */
+static inline uint64_t matchlog_key(const char *id) {
+    uint64_t h = 1469598103934665603ull;
+    while (*id) { h ^= (unsigned char)*id++; h *= 1099511628211ull; }
+    return h;
+}
+
+static inline void matchlog_init_header(MatchLogHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MATCHLOG_MAGIC, sizeof(MATCHLOG_MAGIC));
+    h->version = MATCHLOG_VERSION;
+    h->record_size = sizeof(MatchLogRecord);
+}
+
+static inline int matchlog_header_ok(const MatchLogHeader *h) {
+    return memcmp(h->magic, MATCHLOG_MAGIC, sizeof(MATCHLOG_MAGIC)) == 0 &&
+           h->version == MATCHLOG_VERSION && h->record_size == sizeof(MatchLogRecord);
+}
+
+#endif /* HANDCRICKET_MATCHLOG_H */
@@ -0,0 +1,516 @@
+/*
+ * HAND CRICKET GAME - Traffic replay
+ * Re-issues the requests in a capture written by new_handcricket
+ * (--capture FILE) against a running server, at the original pace or
+ * faster, and compares statuses, response sizes and latency per route
+ * with what was captured.
+ *
+ * Compile: gcc -O2 handcricket_replay.c -o handcricket_replay -pthread
+ * Run: ./handcricket_replay traffic.cap                     (original speed)
+ *      ./handcricket_replay -x 10 traffic.cap               (ten times faster)
+ *      ./handcricket_replay -x 0 -w 1 -o run.txt traffic.cap (flat out, in order)
+ *      ./handcricket_replay -x 0 -b run.txt traffic.cap     (compare with an earlier -o run)
+ * Each browser's requests are replayed in order on one worker, with its
+ * captured session mapped to the one the replay server hands out. For
+ * repeatable games start the server with --seed N and replay with -w 1.
+ * Start the server with --rate-limit 0, as every request comes from one address.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <signal.h>
+#include "handcricket_capture.h"
+
+#define RESP_SIZE 262144
+#define MAX_GROUPS 32
+#define SIZE_SLACK 64       /* response size differences up to this many bytes (or 5%) are not mismatches */
+
+/* ==================== OPTIONS ==================== */
+typedef struct {
+    char host[64];
+    int port;
+    double speed;       /* 1 = original pace, 0 = as fast as possible */
+    int workers;
+    const char *out_file;
+    const char *baseline_file;
+} Options;
+
+Options opt = { "127.0.0.1", 8080, 1.0, 16, NULL, NULL };
+
+volatile sig_atomic_t stop_flag = 0;
+struct sockaddr_in server_addr;
+
+/* Ctrl+C stops the replay early and still prints the report */
+void on_sigint(int sig) {
+    (void)sig;
+    stop_flag = 1;
+}
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void push_latency(uint32_t **arr, size_t *count, size_t *cap, uint32_t v) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *arr = realloc(*arr, *cap * sizeof(uint32_t));
+    }
+    (*arr)[(*count)++] = v;
+}
+
+/* ==================== ROUTE GROUPS ==================== */
+/* Requests are grouped by the first path segment: "/", "/play", "/toss", ... */
+typedef struct {
+    char name[CAPTURE_PATH_MAX + 1];
+    uint64_t requests, status_mismatches, size_mismatches, errors;
+    uint32_t *captured_us, *replay_us;
+    size_t captured_count, captured_cap, replay_count, replay_cap;
+} Group;
+
+Group groups[MAX_GROUPS];
+int group_count = 0;
+pthread_mutex_t groups_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void group_name(const char *path, char *out) {
+    size_t i = 1;
+    out[0] = '/';
+    while (i < CAPTURE_PATH_MAX && path[i] && path[i] != '/' && path[i] != '?') { out[i] = path[i]; i++; }
+    out[i] = '\0';
+}
+
+/* groups_mutex held; the last group collects everything past MAX_GROUPS */
+Group* find_group(const char *name) {
+    for (int g = 0; g < group_count; g++) if (strcmp(groups[g].name, name) == 0) return &groups[g];
+    if (group_count == MAX_GROUPS) return &groups[MAX_GROUPS - 1];
+    snprintf(groups[group_count].name, sizeof(groups[group_count].name), "%s", group_count == MAX_GROUPS - 1 ? "(other)" : name);
+    return &groups[group_count++];
+}
+
+/* ==================== CAPTURE ==================== */
+const CaptureRecord *records = NULL;
+uint64_t record_count = 0;
+uint32_t *order = NULL;         /* record indices by arrival time */
+
+int cmp_arrival(const void *a, const void *b) {
+    const CaptureRecord *x = &records[*(const uint32_t*)a], *y = &records[*(const uint32_t*)b];
+    if (x->timestamp_us != y->timestamp_us) return x->timestamp_us < y->timestamp_us ? -1 : 1;
+    return (*(const uint32_t*)a > *(const uint32_t*)b) - (*(const uint32_t*)a < *(const uint32_t*)b);
+}
+
+/* The browser a request came from: the session that answered it, else the one it asked for */
+uint64_t client_key(const CaptureRecord *r, uint32_t index) {
+    if (r->served) return r->served;
+    if (r->session) return r->session;
+    return (uint64_t)index * 0x9E3779B97F4A7C15ull;    /* no session: spread over the workers */
+}
+
+/* Streaming pages hold the connection open and are not replayed */
+int replayable(const CaptureRecord *r) {
+    return strncmp(r->path, "/ws", 3) != 0 && strncmp(r->path, "/events/", 8) != 0 && !(r->flags & CAPTURE_TRUNCATED);
+}
+
+/* ==================== PER-WORKER STATE ==================== */
+/* Captured session key -> session id handed out by the replay server */
+typedef struct {
+    uint64_t key;
+    char cookie[64];
+} SessionMap;
+
+typedef struct {
+    pthread_t tid;
+    int id;
+    uint32_t *todo;
+    size_t todo_count, todo_cap;
+    SessionMap *map;
+    uint64_t map_mask, map_count;
+    char *resp;
+    size_t resp_len;
+    uint64_t requests, errors, bytes, late;
+    uint64_t max_lag_us;
+} Worker;
+
+uint64_t replay_start_ns, capture_start_us;
+
+SessionMap* map_slot(Worker *w, uint64_t key) {
+    uint64_t i = (key * 0x9E3779B97F4A7C15ull) & w->map_mask;
+    while (w->map[i].key && w->map[i].key != key) i = (i + 1) & w->map_mask;
+    return &w->map[i];
+}
+
+void map_set(Worker *w, uint64_t key, const char *cookie) {
+    if ((w->map_count + 1) * 2 > w->map_mask + 1) {
+        SessionMap *old = w->map;
+        uint64_t old_size = w->map_mask + 1;
+        w->map_mask = old_size * 2 - 1;
+        w->map = calloc(old_size * 2, sizeof(SessionMap));
+        for (uint64_t i = 0; i < old_size; i++) if (old[i].key) *map_slot(w, old[i].key) = old[i];
+        free(old);
+    }
+    SessionMap *m = map_slot(w, key);
+    if (!m->key) { m->key = key; w->map_count++; }
+    snprintf(m->cookie, sizeof(m->cookie), "%s", cookie);
+}
+
+/* ==================== HTTP CLIENT ==================== */
+int open_connection(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Find a header value (case-insensitive name) inside the response head */
+const char* find_header(const char *head, size_t head_len, const char *name) {
+    size_t nlen = strlen(name);
+    const char *p = head, *end = head + head_len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) break;
+        if ((size_t)(eol - p) > nlen && strncasecmp(p, name, nlen) == 0 && p[nlen] == ':') {
+            p += nlen + 1;
+            while (*p == ' ') p++;
+            return p;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+/*
+ * Sends one GET on a fresh connection and reads the whole response into
+ * w->resp; a new session cookie is copied to new_session. Returns the HTTP
+ * status or -1.
+ */
+int http_get(Worker *w, const char *path, const char *session, uint64_t player, char *new_session) {
+    char req[512], cookie[128] = "";
+    size_t got = 0;
+    new_session[0] = '\0';
+    if (session && player) snprintf(cookie, sizeof(cookie), "Cookie: session=%s; player=%016llx\r\n", session, (unsigned long long)player);
+    else if (session) snprintf(cookie, sizeof(cookie), "Cookie: session=%s\r\n", session);
+    else if (player) snprintf(cookie, sizeof(cookie), "Cookie: player=%016llx\r\n", (unsigned long long)player);
+    int len = snprintf(req, sizeof(req),
+        "GET %.*s HTTP/1.1\r\nHost: %s:%d\r\nUser-Agent: handcricket-replay\r\n%sConnection: close\r\n\r\n",
+        CAPTURE_PATH_MAX, path, opt.host, opt.port, cookie);
+
+    int sock = open_connection();
+    if (sock < 0) return -1;
+    if (write(sock, req, len) != len) { close(sock); return -1; }
+    while (got < RESP_SIZE - 1) {
+        ssize_t n = read(sock, w->resp + got, RESP_SIZE - 1 - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(sock);
+    w->resp[got] = '\0';
+    w->resp_len = got;
+    w->bytes += got;
+
+    char *hdr_end = strstr(w->resp, "\r\n\r\n");
+    if (got < 12 || !hdr_end) return -1;
+    size_t head_len = (size_t)(hdr_end - w->resp) + 4;
+    /* The player cookie may come first; look through every Set-Cookie line */
+    for (const char *p = w->resp; (p = find_header(p, head_len - (size_t)(p - w->resp), "Set-Cookie")); ) {
+        if (strncmp(p, "session=", 8) == 0) {
+            int i = 0;
+            p += 8;
+            while (p[i] && p[i] != ';' && p[i] != '\r' && i < 63) { new_session[i] = p[i]; i++; }
+            new_session[i] = '\0';
+            break;
+        }
+    }
+    return atoi(w->resp + 9);
+}
+
+/* ==================== REPLAY ==================== */
+void wait_until(uint64_t target_ns) {
+    uint64_t now = now_ns();
+    if (target_ns <= now) return;
+    struct timespec ts = { (time_t)((target_ns - now) / 1000000000ull), (long)((target_ns - now) % 1000000000ull) };
+    nanosleep(&ts, NULL);
+}
+
+void replay_one(Worker *w, const CaptureRecord *r) {
+    char name[CAPTURE_PATH_MAX + 1], fresh[64];
+    const char *session = NULL;
+    if (r->session) {
+        SessionMap *m = map_slot(w, r->session);
+        if (m->key) session = m->cookie;    /* a session from before the capture starts afresh */
+    }
+    if (opt.speed > 0) {
+        uint64_t target = replay_start_ns + (uint64_t)((double)(r->timestamp_us - capture_start_us) * 1000.0 / opt.speed);
+        uint64_t now = now_ns();
+        if (now > target + 1000000) {
+            w->late++;
+            if ((now - target) / 1000 > w->max_lag_us) w->max_lag_us = (now - target) / 1000;
+        }
+        wait_until(target);
+    }
+
+    uint64_t t0 = now_ns();
+    int status = http_get(w, r->path, session, r->player, fresh);
+    uint32_t us = (uint32_t)((now_ns() - t0) / 1000);
+    w->requests++;
+    if (status < 0) w->errors++;
+    if (fresh[0] && (r->served || r->session)) map_set(w, r->served ? r->served : r->session, fresh);
+
+    uint64_t diff = w->resp_len > r->bytes ? w->resp_len - r->bytes : r->bytes - w->resp_len;
+    group_name(r->path, name);
+    pthread_mutex_lock(&groups_mutex);
+    Group *g = find_group(name);
+    g->requests++;
+    if (status < 0) g->errors++;
+    else if (r->status && status != r->status) g->status_mismatches++;
+    if (status >= 0 && diff > SIZE_SLACK && diff * 20 > r->bytes) g->size_mismatches++;
+    push_latency(&g->captured_us, &g->captured_count, &g->captured_cap, r->latency_us);
+    push_latency(&g->replay_us, &g->replay_count, &g->replay_cap, us);
+    pthread_mutex_unlock(&groups_mutex);
+}
+
+void *worker_thread(void *arg) {
+    Worker *w = arg;
+    for (size_t i = 0; i < w->todo_count && !stop_flag; i++) replay_one(w, &records[w->todo[i]]);
+    return NULL;
+}
+
+/* ==================== REPORTING ==================== */
+int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+double percentile(const uint32_t *sorted, size_t n, double q) {
+    if (n == 0) return 0;
+    size_t idx = (size_t)(q * (double)(n - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+typedef struct {
+    char key[96];
+    double value;
+} Result;
+
+#define MAX_RESULTS (8 + 4 * MAX_GROUPS)
+Result results[MAX_RESULTS];
+int result_count = 0;
+
+void add_result(const char *key, double value) {
+    if (result_count < MAX_RESULTS) {
+        snprintf(results[result_count].key, sizeof(results[result_count].key), "%s", key);
+        results[result_count].value = value;
+        result_count++;
+    }
+}
+
+/* Baseline files are the key=value files written by -o */
+void compare_baseline(const char *file) {
+    FILE *f = fopen(file, "r");
+    char line[256], key[128];
+    double value;
+    if (!f) { fprintf(stderr, "cannot open baseline %s\n", file); return; }
+    printf("\n  Compared with baseline %s:\n", file);
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%127[^=]=%lf", key, &value) != 2) continue;
+        for (int i = 0; i < result_count; i++) {
+            if (strcmp(results[i].key, key) != 0) continue;
+            double delta = value != 0 ? (results[i].value - value) / value * 100.0 : 0;
+            printf("    %-28s %12.3f -> %12.3f  (%+.1f%%)\n", key, value, results[i].value, delta);
+        }
+    }
+    fclose(f);
+}
+
+void report(Worker *workers, uint64_t skipped, double elapsed_s, double captured_s) {
+    uint64_t requests = 0, errors = 0, bytes = 0, late = 0, max_lag_us = 0, status_mismatches = 0, size_mismatches = 0;
+    size_t n = 0;
+    char key[96];
+    for (int i = 0; i < opt.workers; i++) {
+        requests += workers[i].requests; errors += workers[i].errors;
+        bytes += workers[i].bytes; late += workers[i].late;
+        if (workers[i].max_lag_us > max_lag_us) max_lag_us = workers[i].max_lag_us;
+    }
+    for (int g = 0; g < group_count; g++) {
+        status_mismatches += groups[g].status_mismatches;
+        size_mismatches += groups[g].size_mismatches;
+        n += groups[g].replay_count;
+    }
+
+    uint32_t *all = malloc((n ? n : 1) * sizeof(uint32_t));
+    size_t off = 0;
+    for (int g = 0; g < group_count; g++) {
+        memcpy(all + off, groups[g].replay_us, groups[g].replay_count * sizeof(uint32_t));
+        off += groups[g].replay_count;
+    }
+    qsort(all, n, sizeof(uint32_t), cmp_u32);
+
+    add_result("requests_per_sec", requests / elapsed_s);
+    add_result("error_rate", requests ? (double)errors / requests : 0);
+    add_result("status_mismatch_rate", requests ? (double)status_mismatches / requests : 0);
+    add_result("latency_p50_ms", percentile(all, n, 0.50));
+    add_result("latency_p99_ms", percentile(all, n, 0.99));
+    add_result("latency_p999_ms", percentile(all, n, 0.999));
+    add_result("latency_max_ms", n ? all[n - 1] / 1000.0 : 0);
+
+    printf("\n");
+    if (opt.speed > 0) printf("  Target:        %s:%d (%d workers, %gx the captured pace)\n", opt.host, opt.port, opt.workers, opt.speed);
+    else printf("  Target:        %s:%d (%d workers, unthrottled)\n", opt.host, opt.port, opt.workers);
+    printf("  Elapsed:       %.2f s for %.2f s of captured traffic\n", elapsed_s, captured_s);
+    printf("  Requests:      %llu replayed, %llu skipped (streams), %llu errors\n",
+        (unsigned long long)requests, (unsigned long long)skipped, (unsigned long long)errors);
+    printf("  Mismatches:    %llu status, %llu size\n", (unsigned long long)status_mismatches, (unsigned long long)size_mismatches);
+    if (opt.speed > 0) printf("  Behind:        %llu requests more than 1 ms late, worst %.3f ms\n", (unsigned long long)late, max_lag_us / 1000.0);
+    printf("  Throughput:    %.1f req/s, %.2f MB/s\n", requests / elapsed_s, bytes / elapsed_s / 1e6);
+    printf("  Latency (ms):  p50 %.3f  p99 %.3f  p999 %.3f  max %.3f\n",
+        percentile(all, n, 0.50), percentile(all, n, 0.99), percentile(all, n, 0.999), n ? all[n - 1] / 1000.0 : 0);
+
+    /* Captured times are the server's own; replay times include the connection, as a client sees them */
+    printf("\n  %-16s %8s %8s %8s   %-21s %-21s\n", "route", "requests", "status", "size", "captured p50/p99 ms", "replay p50/p99 ms");
+    for (int g = 0; g < group_count; g++) {
+        Group *gr = &groups[g];
+        qsort(gr->captured_us, gr->captured_count, sizeof(uint32_t), cmp_u32);
+        qsort(gr->replay_us, gr->replay_count, sizeof(uint32_t), cmp_u32);
+        printf("  %-16s %8llu %8llu %8llu   %9.3f %9.3f   %9.3f %9.3f\n", gr->name,
+            (unsigned long long)gr->requests, (unsigned long long)gr->status_mismatches, (unsigned long long)gr->size_mismatches,
+            percentile(gr->captured_us, gr->captured_count, 0.50), percentile(gr->captured_us, gr->captured_count, 0.99),
+            percentile(gr->replay_us, gr->replay_count, 0.50), percentile(gr->replay_us, gr->replay_count, 0.99));
+        snprintf(key, sizeof(key), "route%.80s_p50_ms", gr->name);
+        add_result(key, percentile(gr->replay_us, gr->replay_count, 0.50));
+        snprintf(key, sizeof(key), "route%.80s_p99_ms", gr->name);
+        add_result(key, percentile(gr->replay_us, gr->replay_count, 0.99));
+    }
+
+    if (opt.out_file) {
+        FILE *f = fopen(opt.out_file, "w");
+        if (f) {
+            for (int i = 0; i < result_count; i++) fprintf(f, "%s=%.6f\n", results[i].key, results[i].value);
+            fclose(f);
+        } else fprintf(stderr, "cannot write %s\n", opt.out_file);
+    }
+    if (opt.baseline_file) compare_baseline(opt.baseline_file);
+    free(all);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] CAPTURE\n"
+        "  -H host     server address (default 127.0.0.1)\n"
+        "  -p port     server port (default 8080)\n"
+        "  -x speed    pace relative to the capture (default 1, 0 = as fast as possible)\n"
+        "  -w n        workers; each browser stays on one (default 16, 1 = strictly in order)\n"
+        "  -o file     write results as key=value lines\n"
+        "  -b file     compare against a previous -o file\n", prog);
+}
+
+/* ==================== MAIN FUNCTION ==================== */
+int main(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "H:p:x:w:o:b:h")) != -1) {
+        switch (c) {
+            case 'H': snprintf(opt.host, sizeof(opt.host), "%s", optarg); break;
+            case 'p': opt.port = atoi(optarg); break;
+            case 'x': opt.speed = atof(optarg); break;
+            case 'w': opt.workers = atoi(optarg); break;
+            case 'o': opt.out_file = optarg; break;
+            case 'b': opt.baseline_file = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1 || opt.workers < 1 || opt.speed < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "invalid address %s\n", opt.host);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) { perror(path); return 1; }
+    if ((size_t)st.st_size < sizeof(CaptureHeader)) { fprintf(stderr, "%s: too short to be a capture\n", path); return 1; }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror("mmap"); return 1; }
+    if (!capture_header_ok(map)) { fprintf(stderr, "%s: not a capture (or a different version)\n", path); return 1; }
+    records = (const CaptureRecord *)((const CaptureHeader *)map + 1);
+    /* The server may be mid-append; ignore a trailing partial record */
+    record_count = (st.st_size - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+    if (record_count > UINT32_MAX) record_count = UINT32_MAX;
+
+    /* Records are written as requests finish; replay them in the order they arrived */
+    order = malloc((record_count ? record_count : 1) * sizeof(uint32_t));
+    for (uint64_t i = 0; i < record_count; i++) order[i] = (uint32_t)i;
+    qsort(order, record_count, sizeof(uint32_t), cmp_arrival);
+
+    Worker *workers = calloc(opt.workers, sizeof(Worker));
+    uint64_t skipped = 0;
+    for (int i = 0; i < opt.workers; i++) {
+        workers[i].id = i;
+        workers[i].map_mask = 1023;
+        workers[i].map = calloc(1024, sizeof(SessionMap));
+        workers[i].resp = malloc(RESP_SIZE);
+    }
+    for (uint64_t i = 0; i < record_count; i++) {
+        const CaptureRecord *r = &records[order[i]];
+        if (!replayable(r)) { skipped++; continue; }
+        Worker *w = &workers[(client_key(r, order[i]) >> 32) % (uint64_t)opt.workers];
+        if (w->todo_count == w->todo_cap) {
+            w->todo_cap = w->todo_cap ? w->todo_cap * 2 : 1024;
+            w->todo = realloc(w->todo, w->todo_cap * sizeof(uint32_t));
+        }
+        w->todo[w->todo_count++] = order[i];
+    }
+    double captured_s = record_count ? (records[order[record_count - 1]].timestamp_us - records[order[0]].timestamp_us) / 1e6 : 0;
+    capture_start_us = record_count ? records[order[0]].timestamp_us : 0;
+
+    signal(SIGINT, on_sigint);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("\n  Capture: %s (%llu requests over %.2f s)\n", path, (unsigned long long)record_count, captured_s);
+    replay_start_ns = now_ns();
+    for (int i = 0; i < opt.workers; i++) pthread_create(&workers[i].tid, NULL, worker_thread, &workers[i]);
+    for (int i = 0; i < opt.workers; i++) pthread_join(workers[i].tid, NULL);
+
+    report(workers, skipped, (now_ns() - replay_start_ns) / 1e9, captured_s);
+    printf("\n");
+
+    for (int i = 0; i < opt.workers; i++) {
+        free(workers[i].todo);
+        free(workers[i].map);
+        free(workers[i].resp);
+    }
+    for (int g = 0; g < group_count; g++) {
+        free(groups[g].captured_us);
+        free(groups[g].replay_us);
+    }
+    free(workers);
+    free(order);
+    munmap(map, st.st_size);
+    return 0;
+}
@@ -0,0 +1,324 @@
+/*
+ * HAND CRICKET GAME - Strategy solver
+ * Works out the computer's optimal play for the web game's rules and
+ * writes it as a strategy table for the server's Optimal difficulty.
+ *
+ * Every ball is a simultaneous-move game: both sides pick 0-10 at once.
+ * For each state (innings, runs scored or needed, who bats, and the human
+ * batsman's run of repeated picks) the solver finds the computer's mixed
+ * strategy that maximises its chance of winning against any human, by
+ * linear programming on the 11x11 payoff matrix. States are solved from
+ * the end of the match backwards, so each payoff is the already-solved
+ * value of the state the ball leads to. A computer 0 while batting scores
+ * nothing and repeats the state; those states are solved by iterating the
+ * game to its fixed point.
+ *
+ * Compile: gcc -O2 handcricket_solver.c -o handcricket_solver
+ * Run: ./handcricket_solver                   (writes strategy.bin)
+ *      ./handcricket_solver -o /srv/hc.bin    (then: new_handcricket --strategy /srv/hc.bin)
+ *      ./handcricket_solver -v                (also print the opening strategies)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "handcricket_strategy.h"
+
+/*
+ * The solver looks further ahead than the table stores so that states at
+ * the table's edges are solved with their real continuations. Past these
+ * limits a batting side is treated as out on the spot: reaching them takes
+ * long enough that the approximation does not show in the stored values.
+ */
+#define SOLVE_MAX_NEED 512
+#define SOLVE_MAX_SCORE 500
+#define FIXED_POINT_EPS 1e-12
+#define FIXED_POINT_ROUNDS 1000
+#define LP_EPS 1e-12
+
+typedef struct {
+    double value;
+    double p[11];
+} Solution;
+
+/* ==================== MATRIX GAMES ==================== */
+/*
+ * Solves max over p of min over j of sum_i p[i] a[i][j]: the computer
+ * picks row i, the human column j, payoffs are the computer's value.
+ * With a' = a + 1 > 0 this is the LP max sum(y) s.t. a'y <= 1, y >= 0;
+ * the row player's strategy is read off the slack columns' reduced costs.
+ * Bland's rule keeps the simplex from cycling on degenerate pivots.
+ */
+void solve_matrix_game(const double a[11][11], Solution *out) {
+    double t[12][23];
+    int basis[11];
+
+    memset(t, 0, sizeof(t));
+    for (int r = 0; r < 11; r++) {
+        for (int c = 0; c < 11; c++) t[r][c] = a[r][c] + 1.0;
+        t[r][11 + r] = 1.0;
+        t[r][22] = 1.0;
+        basis[r] = 11 + r;
+    }
+    for (int c = 0; c < 11; c++) t[11][c] = -1.0;
+
+    for (;;) {
+        int enter = -1, leave = -1;
+        double best = 0;
+        for (int c = 0; c < 22; c++) if (t[11][c] < -LP_EPS) { enter = c; break; }
+        if (enter < 0) break;
+        for (int r = 0; r < 11; r++) {
+            if (t[r][enter] <= LP_EPS) continue;
+            double ratio = t[r][22] / t[r][enter];
+            if (leave < 0 || ratio < best - LP_EPS || (ratio < best + LP_EPS && basis[r] < basis[leave])) {
+                leave = r;
+                best = ratio;
+            }
+        }
+        double pivot = t[leave][enter];
+        for (int c = 0; c < 23; c++) t[leave][c] /= pivot;
+        for (int r = 0; r < 12; r++) {
+            if (r == leave || t[r][enter] == 0) continue;
+            double f = t[r][enter];
+            for (int c = 0; c < 23; c++) t[r][c] -= f * t[leave][c];
+        }
+        basis[leave] = enter;
+    }
+
+    double sum = t[11][22];
+    for (int i = 0; i < 11; i++) out->p[i] = t[11][11 + i] / sum;
+    out->value = 1.0 / sum - 1.0;
+}
+
+/* ==================== GAME STATES ==================== */
+/*
+ * Values are the computer's probability of winning plus half a tie.
+ *   human_chase[r][h]   the human needs r more runs, with repeat history h
+ *   computer_chase[r]   the computer needs r more runs
+ *   human_first[s][h]   the human has s runs in the first innings
+ *   computer_first[s]   the computer has s runs in the first innings
+ */
+Solution human_chase[SOLVE_MAX_NEED + 1][STRATEGY_HISTORIES];
+Solution computer_chase[SOLVE_MAX_NEED + 1];
+Solution human_first[SOLVE_MAX_SCORE + 1][STRATEGY_HISTORIES];
+Solution computer_first[SOLVE_MAX_SCORE + 1];
+
+/* Repeat history as (last pick, times in a row), from strategy_history() */
+void history_parts(int h, int *last, int *repeats) {
+    *last = h ? (h - 1) / (STRATEGY_REPEAT_LIMIT - 1) : -1;
+    *repeats = h ? (h - 1) % (STRATEGY_REPEAT_LIMIT - 1) + 1 : 0;
+}
+
+/* The human batsman picks j: is it a repeat out, and what history follows */
+int human_pick(int h, int j, int *next) {
+    int last, repeats;
+    history_parts(h, &last, &repeats);
+    if (j != last) { *next = strategy_history(j, 1); return 0; }
+    if (repeats + 1 >= STRATEGY_REPEAT_LIMIT) return 1;
+    *next = strategy_history(j, repeats + 1);
+    return 0;
+}
+
+double chase_start_human(int need) {
+    return human_chase[need < SOLVE_MAX_NEED ? need : SOLVE_MAX_NEED][0].value;
+}
+
+double chase_start_computer(int need) {
+    return computer_chase[need < SOLVE_MAX_NEED ? need : SOLVE_MAX_NEED].value;
+}
+
+/* Human batting: a 0 scores the computer's number, so every ball ends or moves on */
+void solve_human_chase(void) {
+    double a[11][11];
+    for (int r = 1; r <= SOLVE_MAX_NEED; r++) {
+        double out = r == 1 ? 0.5 : 1.0;   /* out one short of the target is a tie */
+        for (int h = 0; h < STRATEGY_HISTORIES; h++) {
+            for (int j = 0; j <= 10; j++) {
+                int next = 0, repeat_out = human_pick(h, j, &next);
+                for (int i = 0; i <= 10; i++) {
+                    int runs = j == 0 ? i : j;
+                    if (repeat_out || i == j) a[i][j] = out;
+                    else if (runs >= r) a[i][j] = 0.0;
+                    else a[i][j] = human_chase[r - runs][next].value;
+                }
+            }
+            solve_matrix_game(a, &human_chase[r][h]);
+        }
+    }
+}
+
+void solve_human_first(void) {
+    double a[11][11];
+    for (int s = SOLVE_MAX_SCORE; s >= 0; s--) {
+        double out = chase_start_computer(s + 1);
+        for (int h = 0; h < STRATEGY_HISTORIES; h++) {
+            for (int j = 0; j <= 10; j++) {
+                int next = 0, repeat_out = human_pick(h, j, &next);
+                for (int i = 0; i <= 10; i++) {
+                    int total = s + (j == 0 ? i : j);
+                    if (repeat_out || i == j) a[i][j] = out;
+                    else if (total > SOLVE_MAX_SCORE) a[i][j] = chase_start_computer(total + 1);
+                    else a[i][j] = human_first[total][next].value;
+                }
+            }
+            solve_matrix_game(a, &human_first[s][h]);
+        }
+    }
+}
+
+/*
+ * Computer batting: a 0 scores nothing and the ball is replayed from the
+ * same state, so the state's value appears in its own matrix. Iterating
+ * v = value(matrix(v)) converges because every other cell ends or
+ * advances the innings.
+ */
+void solve_with_replay(double a[11][11], Solution *sol, double start) {
+    double v = start;
+    for (int round = 0; round < FIXED_POINT_ROUNDS; round++) {
+        for (int j = 1; j <= 10; j++) a[0][j] = v;
+        solve_matrix_game(a, sol);
+        if (fabs(sol->value - v) < FIXED_POINT_EPS) break;
+        v = sol->value;
+    }
+}
+
+void solve_computer_chase(void) {
+    double a[11][11];
+    for (int r = 1; r <= SOLVE_MAX_NEED; r++) {
+        double out = r == 1 ? 0.5 : 0.0;
+        for (int i = 0; i <= 10; i++) {
+            for (int j = 0; j <= 10; j++) {
+                if (i == j) a[i][j] = out;
+                else if (i >= r) a[i][j] = 1.0;
+                else if (i > 0) a[i][j] = computer_chase[r - i].value;
+            }
+        }
+        solve_with_replay(a, &computer_chase[r], r > 1 ? computer_chase[r - 1].value : 0.5);
+    }
+}
+
+void solve_computer_first(void) {
+    double a[11][11];
+    for (int s = SOLVE_MAX_SCORE; s >= 0; s--) {
+        double out = chase_start_human(s + 1);
+        for (int i = 0; i <= 10; i++) {
+            for (int j = 0; j <= 10; j++) {
+                int total = s + i;
+                if (i == j) a[i][j] = out;
+                else if (i == 0) continue;
+                else if (total > SOLVE_MAX_SCORE) a[i][j] = chase_start_human(total + 1);
+                else a[i][j] = computer_first[total].value;
+            }
+        }
+        solve_with_replay(a, &computer_first[s], out);
+    }
+}
+
+/* ==================== TABLE OUTPUT ==================== */
+/* Cumulative probabilities in 1/65536ths; returns the largest rounding error */
+double encode(const Solution *sol, StrategyEntry *e) {
+    double cum = 0, worst = 0;
+    int last = 10;
+    while (last > 0 && sol->p[last] < 1e-9) last--;
+    for (int k = 0; k <= 10; k++) {
+        cum += sol->p[k] > 0 ? sol->p[k] : 0;
+        if (k >= last) { e->cdf[k] = 0xFFFF; continue; }
+        long q = lround(cum * 65536.0);
+        if (q > 0xFFFE) q = 0xFFFE;
+        e->cdf[k] = (uint16_t)q;
+        if (fabs(q / 65536.0 - cum) > worst) worst = fabs(q / 65536.0 - cum);
+    }
+    return worst;
+}
+
+void print_strategy(const char *label, const Solution *sol) {
+    printf("  %-34s %.4f ", label, sol->value);
+    for (int k = 0; k <= 10; k++) printf(" %5.3f", sol->p[k]);
+    printf("\n");
+}
+
+/* ==================== MAIN FUNCTION ==================== */
+int main(int argc, char **argv) {
+    const char *out_file = "strategy.bin";
+    int verbose = 0, c;
+
+    while ((c = getopt(argc, argv, "o:vh")) != -1) {
+        switch (c) {
+            case 'o': out_file = optarg; break;
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-o strategy.bin] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    solve_human_chase();
+    solve_computer_chase();
+    solve_human_first();
+    solve_computer_first();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    size_t size = strategy_file_size();
+    StrategyHeader *h = calloc(1, size);
+    if (!h) { fprintf(stderr, "out of memory\n"); return 1; }
+    strategy_init_header(h);
+    h->value_computer_bats_first = computer_first[0].value;
+    h->value_human_bats_first = human_first[0][0].value;
+
+    double worst = 0, err;
+    for (int s = 0; s <= STRATEGY_MAX_SCORE; s++) {
+        err = encode(&computer_first[s], (StrategyEntry *)strategy_entry(h, 1, 0, s, 0));
+        if (err > worst) worst = err;
+        for (int k = 0; k < STRATEGY_HISTORIES; k++) {
+            err = encode(&human_first[s][k], (StrategyEntry *)strategy_entry(h, 0, 0, s, k));
+            if (err > worst) worst = err;
+        }
+    }
+    for (int r = 1; r <= STRATEGY_MAX_NEED; r++) {
+        err = encode(&computer_chase[r], (StrategyEntry *)strategy_entry(h, 1, 1, r, 0));
+        if (err > worst) worst = err;
+        for (int k = 0; k < STRATEGY_HISTORIES; k++) {
+            err = encode(&human_chase[r][k], (StrategyEntry *)strategy_entry(h, 0, 1, r, k));
+            if (err > worst) worst = err;
+        }
+    }
+
+    FILE *f = fopen(out_file, "wb");
+    if (!f || fwrite(h, 1, size, f) != size || fclose(f) != 0) { perror(out_file); return 1; }
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("\n  Solved %d states in %.2f s\n",
+        (SOLVE_MAX_NEED + SOLVE_MAX_SCORE + 1) * (STRATEGY_HISTORIES + 1), secs);
+    printf("  Computer's chance of winning (ties count half) under optimal play:\n");
+    printf("    computer bats first: %.4f\n", h->value_computer_bats_first);
+    printf("    human bats first:    %.4f\n", h->value_human_bats_first);
+    printf("  Wrote %s (%zu bytes, largest probability rounding %.6f)\n", out_file, size, worst);
+
+    if (verbose) {
+        char label[64];
+        printf("\n  %-34s %-6s ", "state", "value");
+        for (int k = 0; k <= 10; k++) printf(" %5d", k);
+        printf("\n");
+        print_strategy("computer bats first, 0 runs", &computer_first[0]);
+        print_strategy("human bats first, 0 runs", &human_first[0][0]);
+        for (int k = 1; k < STRATEGY_REPEAT_LIMIT; k++) {
+            snprintf(label, sizeof(label), "human bats first, 0 runs, 6 x%d", k);
+            print_strategy(label, &human_first[0][strategy_history(6, k)]);
+        }
+        const int needs[] = {1, 2, 6, 11, 30, 60};
+        for (size_t n = 0; n < sizeof(needs) / sizeof(needs[0]); n++) {
+            snprintf(label, sizeof(label), "computer needs %d", needs[n]);
+            print_strategy(label, &computer_chase[needs[n]]);
+            snprintf(label, sizeof(label), "human needs %d", needs[n]);
+            print_strategy(label, &human_chase[needs[n]][0]);
+        }
+    }
+    printf("\n");
+    free(h);
+    return 0;
+}
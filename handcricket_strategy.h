@@ -0,0 +1,129 @@
+/*
+ * HAND CRICKET GAME - Strategy table format
+ * Written by handcricket_solver, memory-mapped by the web server for the
+ * Optimal difficulty.
+ *
+ * A strategy table is a header followed by four arrays of entries. Each
+ * entry is the computer's equilibrium mixed strategy for one game state,
+ * stored as cumulative probabilities in 1/65536ths so a move is one
+ * lookup and one 16-bit random draw. Values are from the computer's side:
+ * the probability of winning plus half the probability of a tie.
+ */
+
+#ifndef HANDCRICKET_STRATEGY_H
+#define HANDCRICKET_STRATEGY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define STRATEGY_MAGIC "HCSTRAT"
+#define STRATEGY_VERSION 1
+
+#define STRATEGY_MAX_SCORE 240  /* first innings scores 0..240; higher scores use 240 */
+#define STRATEGY_MAX_NEED 256   /* second innings targets 1..256 runs away; further uses 256 */
+#define STRATEGY_REPEAT_LIMIT 5 /* the batsman's fifth identical pick in a row is out */
+
+/*
+ * What the computer knows about a human batsman's repeats: no pick yet
+ * this innings, or the last pick and how many times in a row it was made
+ * (1 to STRATEGY_REPEAT_LIMIT - 1).
+ */
+#define STRATEGY_HISTORIES (1 + 11 * (STRATEGY_REPEAT_LIMIT - 1))
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t max_score;
+    uint32_t max_need;
+    uint32_t histories;
+    uint32_t reserved;
+    double value_computer_bats_first;   /* equilibrium value of the whole match */
+    double value_human_bats_first;
+} StrategyHeader;
+
+typedef struct {
+    uint16_t cdf[11];   /* P(move <= k) * 65536; 0xFFFF once every remaining move has P = 0 */
+} StrategyEntry;
+
+/* Array order after the header */
+enum {
+    STRATEGY_BAT_FIRST,     /* computer batting first: [score] */
+    STRATEGY_BOWL_FIRST,    /* human batting first: [score][history] */
+    STRATEGY_BAT_CHASE,     /* computer chasing: [need - 1] */
+    STRATEGY_BOWL_CHASE,    /* human chasing: [need - 1][history] */
+    STRATEGY_TABLES
+};
+
+static inline uint32_t strategy_table_entries(int table) {
+    uint32_t scores = STRATEGY_MAX_SCORE + 1;
+    switch (table) {
+        case STRATEGY_BAT_FIRST: return scores;
+        case STRATEGY_BOWL_FIRST: return scores * STRATEGY_HISTORIES;
+        case STRATEGY_BAT_CHASE: return STRATEGY_MAX_NEED;
+        default: return STRATEGY_MAX_NEED * STRATEGY_HISTORIES;
+    }
+}
+
+/* Entry offset of a table from the first entry */
+static inline uint32_t strategy_table_offset(int table) {
+    uint32_t off = 0;
+    for (int t = 0; t < table; t++) off += strategy_table_entries(t);
+    return off;
+}
+
+static inline size_t strategy_file_size(void) {
+    return sizeof(StrategyHeader) + (size_t)strategy_table_offset(STRATEGY_TABLES) * sizeof(StrategyEntry);
+}
+
+/* last = the batsman's previous pick this innings or -1, repeats = times in a row */
+static inline int strategy_history(int last, int repeats) {
+    if (last < 0 || last > 10 || repeats < 1) return 0;
+    if (repeats > STRATEGY_REPEAT_LIMIT - 1) repeats = STRATEGY_REPEAT_LIMIT - 1;
+    return 1 + last * (STRATEGY_REPEAT_LIMIT - 1) + (repeats - 1);
+}
+
+/*
+ * The entry for a game state. runs is the batting side's score in the
+ * first innings, or the runs still needed to win in the second.
+ */
+static inline const StrategyEntry* strategy_entry(const StrategyHeader *h, int computer_batting,
+                                                  int second_innings, int runs, int history) {
+    const StrategyEntry *e = (const StrategyEntry *)(h + 1);
+    if (second_innings) {
+        if (runs < 1) runs = 1;
+        if (runs > STRATEGY_MAX_NEED) runs = STRATEGY_MAX_NEED;
+        if (computer_batting) return e + strategy_table_offset(STRATEGY_BAT_CHASE) + (runs - 1);
+        return e + strategy_table_offset(STRATEGY_BOWL_CHASE) + (uint32_t)(runs - 1) * STRATEGY_HISTORIES + history;
+    }
+    if (runs < 0) runs = 0;
+    if (runs > STRATEGY_MAX_SCORE) runs = STRATEGY_MAX_SCORE;
+    if (computer_batting) return e + strategy_table_offset(STRATEGY_BAT_FIRST) + runs;
+    return e + strategy_table_offset(STRATEGY_BOWL_FIRST) + (uint32_t)runs * STRATEGY_HISTORIES + history;
+}
+
+/* Samples a move with 16 random bits */
+static inline int strategy_pick(const StrategyEntry *e, unsigned draw16) {
+    int k = 0;
+    while (k < 10 && e->cdf[k] != 0xFFFF && draw16 >= e->cdf[k]) k++;
+    return k;
+}
+
+static inline void strategy_init_header(StrategyHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, STRATEGY_MAGIC, sizeof(STRATEGY_MAGIC));
+    h->version = STRATEGY_VERSION;
+    h->entry_size = sizeof(StrategyEntry);
+    h->max_score = STRATEGY_MAX_SCORE;
+    h->max_need = STRATEGY_MAX_NEED;
+    h->histories = STRATEGY_HISTORIES;
+}
+
+static inline int strategy_header_ok(const StrategyHeader *h) {
+    return memcmp(h->magic, STRATEGY_MAGIC, sizeof(STRATEGY_MAGIC)) == 0 &&
+           h->version == STRATEGY_VERSION && h->entry_size == sizeof(StrategyEntry) &&
+           h->max_score == STRATEGY_MAX_SCORE && h->max_need == STRATEGY_MAX_NEED &&
+           h->histories == STRATEGY_HISTORIES;
+}
+
+#endif /* HANDCRICKET_STRATEGY_H */
@@ -3,10 +3,25 @@
  * With full UI: Grid, Panels, Buttons, Animations
  * 
  * Compile: gcc new_handcricket.c -o new_handcricket -pthread
- * Run: ./new_handcricket
+ * Run: ./new_handcricket [--snapshot FILE] [--snapshot-interval SECS] [--match-log FILE]
  * Open: http://localhost:8080
+ * Metrics: http://localhost:8080/metrics (Prometheus text format)
+ * Spectate: http://localhost:8080/watch/<session> (live via /events/<session>, Server-Sent Events)
+ * Moves: the game page plays over a WebSocket at /ws when the browser supports it
+ * Leaderboard: http://localhost:8080/leaderboard (JSON at /leaderboard.json)
+ * Two players: http://localhost:8080/pvp (matchmaking queue, player vs player)
+ * Limits: [--rate-limit REQS_PER_SEC] [--max-connections N] (per-IP/session token buckets, 503 shedding)
+ * Optimal AI: [--strategy FILE] (table written by handcricket_solver, adds the Optimal difficulty)
+ * Access log: [--access-log FILE] [--access-log-max-mb N] (one logfmt line per request, rotated by size)
+ * Spill: [--spill FILE] [--spill-idle SECS] (idle matches move to an mmapped slab, back on the next request)
+ * Profiles: [--profiles FILE] (per-player pick habits kept across visits, used by the Hard AI)
+ * Cores: [--cores N] (sessions owned by N pinned threads; requests are handed to the owner)
+ * Capture: [--capture FILE] [--seed N] (requests recorded for handcricket_replay; fixed seed for repeatable runs)
+ * HTTP/2: h2c on the same port, by prior knowledge or Upgrade (curl --http2-prior-knowledge http://localhost:8080/)
+ * Upgrade: install the new binary at the same path, then kill -USR2 <pid> (no dropped connections or sessions)
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,10 +30,44 @@
 #include <netinet/in.h>
 #include <pthread.h>
 #include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <sys/random.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <errno.h>
+#include <strings.h>
+#include <stdarg.h>
+#include "handcricket_matchlog.h"
+#include "handcricket_strategy.h"
+#include "handcricket_capture.h"
 
 #define PORT 8080
-#define BUFFER_SIZE 131072
 #define MAX_SESSIONS 100
+#define SESSION_TTL 3600
+#define DIFFICULTY_OPTIMAL 4    /* only offered when a strategy table is loaded */
+#define DIFFICULTY_LEVELS 5     /* per-difficulty arrays: 1-4, and 0 for all/other */
+
+/* Token bucket in thousandths of a token, refilled lazily on each take */
+typedef struct {
+    int64_t tokens;
+    uint64_t last_ns;       /* 0 = never used, starts full */
+} TokenBucket;
+
+/* A player's pick habits (see PLAYER PROFILES) */
+typedef struct {
+    uint16_t picks[2][11];          /* [0] while batting, [1] while bowling */
+    uint16_t transitions[11][11];   /* pick -> next pick in the same innings */
+} ProfileCounts;
 
 typedef struct {
     char session_id[64];
@@ -37,10 +86,157 @@ typedef struct {
     int is_out;
     char message[512];
     time_t last_activity;
+    int pvp_match;          /* PvP match index + 1, 0 when not in one */
+    uint32_t pvp_gen;       /* generation of that match slot when joined */
+    int pvp_side;           /* 0 or 1 */
+    TokenBucket rate;       /* requests and WebSocket moves for this session */
+    uint64_t player;        /* long-lived player cookie, 0 without a profile */
+    ProfileCounts profile;  /* the player's profile, this session's balls included */
+    ProfileCounts profile_delta;    /* balls not yet merged into the profile file */
+    int profile_pending;
+    int profile_matches;    /* matches finished since the last merge */
 } GameSession;
 
-GameSession sessions[MAX_SESSIONS];
-pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* The server moves these into memory shared with its successor (see LIVE UPGRADE) */
+GameSession local_sessions[MAX_SESSIONS];
+pthread_mutex_t local_sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
+GameSession *sessions = local_sessions;
+pthread_mutex_t *sessions_mutex = &local_sessions_mutex;
+
+/* ==================== METRICS ==================== */
+/*
+ * Counters live in cache-line aligned shards. Each thread is bound to one
+ * shard on first use and only ever does relaxed atomic adds on it, so the
+ * hot path takes no locks. /metrics sums the shards when scraped.
+ */
+enum { ROUTE_MENU, ROUTE_HELP, ROUTE_START, ROUTE_RESET, ROUTE_DIFF, ROUTE_TOSS,
+       ROUTE_CHOOSE, ROUTE_PLAY, ROUTE_GAME, ROUTE_METRICS, ROUTE_EVENTS, ROUTE_WATCH, ROUTE_WS,
+       ROUTE_WS_PLAY, ROUTE_LEADERBOARD, ROUTE_PVP, ROUTE_OTHER, ROUTE_COUNT };
+const char *route_names[ROUTE_COUNT] = {
+    "menu", "help", "start", "reset", "diff", "toss", "choose", "play", "game", "metrics", "events", "watch", "ws",
+    "ws_play", "leaderboard", "pvp", "other"
+};
+
+/* Upper bounds of the latency buckets in microseconds (+Inf is implicit) */
+const uint64_t latency_bounds_us[] = {
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+};
+#define LATENCY_BUCKETS (int)(sizeof(latency_bounds_us) / sizeof(latency_bounds_us[0]))
+#define METRIC_SHARDS 64
+
+typedef struct {
+    uint64_t latency_hist[ROUTE_COUNT][LATENCY_BUCKETS + 1];
+    uint64_t latency_sum_ns[ROUTE_COUNT];
+    uint64_t lock_wait_ns;
+    uint64_t lock_contended;
+    uint64_t lock_acquired;
+    uint64_t bytes_sent;
+    uint64_t ai_moves[DIFFICULTY_LEVELS];
+    uint64_t ai_move_ns[DIFFICULTY_LEVELS];
+    uint64_t match_log_records;
+    uint64_t match_log_dropped;
+    uint64_t sse_events;
+    uint64_t sse_dropped;
+    uint64_t sse_queue_full;
+    uint64_t leaderboard_recorded;
+    uint64_t leaderboard_busy;
+    uint64_t pvp_matches;
+    uint64_t pvp_balls;
+    uint64_t rate_limited[3];   /* RATE_SCOPE_* */
+    uint64_t connections_shed;
+    uint64_t access_log_records;
+    uint64_t access_log_dropped;
+    uint64_t h2_connections;
+    uint64_t h2_streams;
+    uint64_t sessions_spilled;
+    uint64_t sessions_faulted_in;
+    uint64_t profile_merges;
+    uint64_t owner_handoffs;
+    uint64_t capture_records;
+    uint64_t capture_dropped;
+} __attribute__((aligned(64))) MetricShard;
+
+MetricShard metric_shards[METRIC_SHARDS];
+unsigned int metric_next_shard = 0;
+__thread MetricShard *metric_shard = NULL;
+time_t server_start_time;
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+MetricShard* metrics_local(void) {
+    if (!metric_shard) {
+        unsigned int idx = __atomic_fetch_add(&metric_next_shard, 1, __ATOMIC_RELAXED);
+        metric_shard = &metric_shards[idx % METRIC_SHARDS];
+    }
+    return metric_shard;
+}
+
+void metric_add(uint64_t *counter, uint64_t v) {
+    __atomic_fetch_add(counter, v, __ATOMIC_RELAXED);
+}
+
+uint64_t metric_read(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/* What the access log records about the request this thread is serving */
+typedef struct {
+    uint64_t session;       /* matchlog_key() of the session, 0 if none */
+    uint64_t bytes;
+    uint32_t ip;
+    int status;             /* from the first response line sent, 0 if none */
+} RequestNote;
+
+__thread RequestNote request_note;
+
+/* Counts bytes written to a client, for /metrics and the access log */
+void note_sent(const char *data, uint64_t n) {
+    metric_add(&metrics_local()->bytes_sent, n);
+    request_note.bytes += n;
+    if (!request_note.status && n > 12 && memcmp(data, "HTTP/1.1 ", 9) == 0) request_note.status = atoi(data + 9);
+}
+
+void access_log_request(int route, uint64_t elapsed_ns); /* with the access log below */
+void capture_request(uint64_t elapsed_ns);              /* with the traffic capture below */
+
+/* Called once at the end of every request (and every WebSocket move) */
+void metrics_observe_request(int route, uint64_t elapsed_ns) {
+    MetricShard *m = metrics_local();
+    uint64_t us = elapsed_ns / 1000;
+    int b = 0;
+    while (b < LATENCY_BUCKETS && us > latency_bounds_us[b]) b++;
+    metric_add(&m->latency_hist[route][b], 1);
+    metric_add(&m->latency_sum_ns[route], elapsed_ns);
+    capture_request(elapsed_ns);
+    access_log_request(route, elapsed_ns);
+}
+
+__thread int sessions_lock_depth = 0;  /* nested holds, as in owner jobs run under the lock (see LIVE UPGRADE) */
+
+/* Lock the session table, accounting for time spent waiting on it; a thread that holds it already just nests */
+void sessions_lock(void) {
+    if (sessions_lock_depth++) return;
+    MetricShard *m = metrics_local();
+    int rc = pthread_mutex_trylock(sessions_mutex);
+    if (rc == EBUSY) {
+        uint64_t t0 = now_ns();
+        rc = pthread_mutex_lock(sessions_mutex);
+        metric_add(&m->lock_wait_ns, now_ns() - t0);
+        metric_add(&m->lock_contended, 1);
+    }
+    /* A process sharing the table died holding the lock; the table is still usable */
+    if (rc == EOWNERDEAD) pthread_mutex_consistent(sessions_mutex);
+    metric_add(&m->lock_acquired, 1);
+}
+
+void sessions_unlock(void) {
+    if (--sessions_lock_depth) return;
+    pthread_mutex_unlock(sessions_mutex);
+}
 
 /* CSS Styles embedded in C */
 const char *CSS_STYLES = 
@@ -94,504 +290,4846 @@ const char *CSS_STYLES =
 ".difficulty-active{background:linear-gradient(135deg,#e94560,#ff6b6b) !important;color:#fff !important;}"
 "@keyframes pulse{0%%,100%%{transform:scale(1);}50%%{transform:scale(1.02);}}"
 ".pulse{animation:pulse 0.3s;}"
+".lb-table{width:100%;border-collapse:collapse;font-size:13px;}"
+".lb-table th{text-align:left;color:#666;font-size:11px;text-transform:uppercase;padding:6px;border-bottom:2px solid #e94560;}"
+".lb-table td{padding:6px;border-bottom:1px solid #eee;}"
+".lb-empty{color:#999;font-size:13px;text-align:center;padding:10px;}"
 "</style>";
 
-void generate_session_id(char *sid) {
-    sprintf(sid, "%ld%d", time(NULL), rand() % 10000);
+/* ==================== BUFFER POOL ==================== */
+/*
+ * Requests and responses are built in pooled heap buffers in four size
+ * classes. A page is a few KB, so a connection normally holds one small
+ * request buffer and one page-sized response buffer; buf_printf() moves
+ * to the next class (or an exact-size malloc past the largest) only when
+ * a response outgrows the one it has. Free buffers sit in per-shard
+ * stacks and threads bind to a shard on first use, like metric shards,
+ * so the shard lock is almost never contended.
+ */
+#define POOL_CLASSES 4
+#define POOL_SHARDS 16
+#define POOL_KEEP 32                /* free buffers kept per class per shard */
+#define REQUEST_INITIAL 4096
+#define REQUEST_MAX 65536
+#define RESPONSE_INITIAL 16384
+const size_t pool_class_size[POOL_CLASSES] = { 4096, 16384, 65536, 262144 };
+
+typedef struct {
+    char *data;
+    size_t len;     /* bytes used, not counting the terminating NUL */
+    size_t cap;
+    int cls;        /* size class, -1 for an unpooled oversize buffer */
+} Buf;
+
+typedef struct {
+    pthread_mutex_t lock;
+    char *free_list[POOL_CLASSES][POOL_KEEP];
+    int free_count[POOL_CLASSES];
+} __attribute__((aligned(64))) PoolShard;
+
+PoolShard pool_shards[POOL_SHARDS];
+unsigned int pool_next_shard = 0;
+__thread PoolShard *pool_shard = NULL;
+
+PoolShard* pool_local(void) {
+    if (!pool_shard) {
+        unsigned int idx = __atomic_fetch_add(&pool_next_shard, 1, __ATOMIC_RELAXED);
+        pool_shard = &pool_shards[idx % POOL_SHARDS];
+    }
+    return pool_shard;
 }
 
-GameSession* find_session(const char *sid) {
-    pthread_mutex_lock(&sessions_mutex);
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (strcmp(sessions[i].session_id, sid) == 0) {
-            sessions[i].last_activity = time(NULL);
-            pthread_mutex_unlock(&sessions_mutex);
-            return &sessions[i];
+void pool_init(void) {
+    for (int i = 0; i < POOL_SHARDS; i++) pthread_mutex_init(&pool_shards[i].lock, NULL);
+}
+
+/* An empty buffer with room for at least want bytes, the terminating NUL included */
+Buf buf_get(size_t want) {
+    Buf b = { NULL, 0, want, -1 };
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        if (want > pool_class_size[c]) continue;
+        PoolShard *sh = pool_local();
+        b.cls = c;
+        b.cap = pool_class_size[c];
+        pthread_mutex_lock(&sh->lock);
+        if (sh->free_count[c]) b.data = sh->free_list[c][--sh->free_count[c]];
+        pthread_mutex_unlock(&sh->lock);
+        break;
+    }
+    if (!b.data && !(b.data = malloc(b.cap))) { fprintf(stderr, "Out of memory\n"); abort(); }
+    b.data[0] = '\0';
+    return b;
+}
+
+void buf_put(Buf *b) {
+    if (!b->data) return;
+    if (b->cls >= 0) {
+        PoolShard *sh = pool_local();
+        pthread_mutex_lock(&sh->lock);
+        if (sh->free_count[b->cls] < POOL_KEEP) {
+            sh->free_list[b->cls][sh->free_count[b->cls]++] = b->data;
+            b->data = NULL;
         }
+        pthread_mutex_unlock(&sh->lock);
     }
-    pthread_mutex_unlock(&sessions_mutex);
-    return NULL;
+    free(b->data);
+    b->data = NULL;
 }
 
-GameSession* create_session(void) {
-    pthread_mutex_lock(&sessions_mutex);
-    time_t now = time(NULL);
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (sessions[i].session_id[0] == '\0' || (now - sessions[i].last_activity) > 3600) {
-            memset(&sessions[i], 0, sizeof(GameSession));
-            generate_session_id(sessions[i].session_id);
-            sessions[i].difficulty = 1;
-            sessions[i].last_player_input = -1;
-            sessions[i].last_computer_move = -1;
-            sessions[i].last_activity = now;
-            strcpy(sessions[i].message, "Welcome! Click 'New Game' to start playing!");
-            pthread_mutex_unlock(&sessions_mutex);
-            return &sessions[i];
-        }
-    }
-    pthread_mutex_unlock(&sessions_mutex);
-    return NULL;
+/* Moves the contents into a buffer with room for at least want bytes */
+void buf_grow(Buf *b, size_t want) {
+    if (want <= b->cap) return;
+    if (want < b->cap * 2) want = b->cap * 2;
+    Buf bigger = buf_get(want);
+    memcpy(bigger.data, b->data, b->len + 1);
+    bigger.len = b->len;
+    buf_put(b);
+    *b = bigger;
 }
 
-int generate_computer_move(GameSession *s) {
-    int move, freq[11] = {0};
-    switch (s->difficulty) {
-        case 1: move = rand() % 11; break;
-        case 2:
-            if (rand() % 100 < 30 && s->move_count > 0)
-                move = s->prev_moves[s->move_count - 1];
-            else move = rand() % 11;
-            break;
-        case 3:
-            if (s->move_count == 0) { move = rand() % 11; }
-            else {
-                int max_f = 0, pred = rand() % 11;
-                for (int i = 0; i < s->move_count; i++) freq[s->prev_moves[i]]++;
-                for (int i = 0; i < 11; i++) if (freq[i] > max_f) { max_f = freq[i]; pred = i; }
-                move = pred;
-            }
-            break;
-        default: move = rand() % 11;
+void buf_append(Buf *b, const char *data, size_t len) {
+    if (b->len + len + 1 > b->cap) buf_grow(b, b->len + len + 1);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+void buf_printf(Buf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= b->cap - b->len) {
+        buf_grow(b, b->len + (size_t)n + 1);
+        va_start(ap, fmt);
+        vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
     }
-    return move;
+    b->len += (size_t)n;
 }
 
-void reset_game(GameSession *s) {
-    s->player_score = 0;
-    s->computer_score = 0;
-    s->game_phase = 1;
-    s->is_batting = 0;
-    s->second_innings = 0;
-    s->first_innings_score = 0;
-    s->move_count = 0;
-    s->same_choice_count = 0;
-    s->last_player_input = -1;
-    s->last_computer_move = -1;
-    s->is_out = 0;
-    strcpy(s->message, "Choose HEAD or TAILS for the toss!");
+/* Set while an HTTP/2 stream is being served: responses are collected here, not written */
+__thread Buf *response_capture = NULL;
+
+/* Write the whole response and count the bytes that went out */
+void send_response(int sock, const char *buf, size_t len) {
+    size_t off = 0;
+    if (response_capture) {
+        buf_append(response_capture, buf, len);
+        note_sent(buf, len);
+        return;
+    }
+    while (off < len) {
+        ssize_t n = write(sock, buf + off, len - off);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    note_sent(buf, off);
 }
 
-char* get_session_cookie(const char *req) {
-    static char sid[64];
-    char *p = strstr(req, "session=");
-    if (p) {
-        p += 8;
-        int i = 0;
-        while (p[i] && p[i] != ';' && p[i] != ' ' && p[i] != '\r' && i < 63) {
-            sid[i] = p[i]; i++;
-        }
-        sid[i] = '\0';
-        return sid;
+/* ==================== ADMISSION CONTROL ==================== */
+/*
+ * Every request takes a token from its source address's bucket, every
+ * request on a session from the session's bucket, and every request that
+ * would create a session from a much slower per-address creation bucket.
+ * Addresses live in a small 4-way set-associative table (least recently
+ * seen entry is replaced), so a check is a hash, a striped lock and at
+ * most four compares. Connections past --max-connections are answered
+ * with 503 straight from the accept loop, before a thread is spawned.
+ */
+#define RATE_SETS 1024
+#define RATE_WAYS 4
+#define RATE_LOCKS 64
+#define RATE_BURST_SECS 2           /* a full bucket holds this many seconds of rate */
+#define SESSION_RATE 20             /* requests per second per session */
+#define CREATE_RATE_PERIOD_S 10     /* one new session per address every 10 s... */
+#define CREATE_BURST 10             /* ...after an initial allowance of 10 */
+#define DEFAULT_IP_RATE 100
+#define DEFAULT_MAX_CONNECTIONS 512
+
+enum { RATE_SCOPE_IP, RATE_SCOPE_SESSION, RATE_SCOPE_CREATE };
+const char *rate_scope_names[3] = { "ip", "session", "create" };
+
+typedef struct {
+    uint32_t ip;                    /* network byte order; 0 = unused */
+    uint64_t seen_ns;
+    TokenBucket requests;
+    TokenBucket creates;
+} RateEntry;
+
+RateEntry rate_table[RATE_SETS][RATE_WAYS];
+pthread_mutex_t rate_locks[RATE_LOCKS];
+int ip_rate = DEFAULT_IP_RATE;      /* 0 disables all per-client limits */
+int max_connections = DEFAULT_MAX_CONNECTIONS;
+int active_connections = 0;
+
+void rate_init(void) {
+    for (int i = 0; i < RATE_LOCKS; i++) pthread_mutex_init(&rate_locks[i], NULL);
+}
+
+/* Takes one token if available; rate is tokens per period_ns, burst in whole tokens */
+int bucket_take(TokenBucket *b, uint64_t now, uint64_t period_ns, int64_t rate, int64_t burst) {
+    int64_t cap = burst * 1000;
+    if (!b->last_ns) b->tokens = cap;
+    else {
+        uint64_t dt = now - b->last_ns;
+        if (dt > period_ns * (uint64_t)burst) dt = period_ns * (uint64_t)burst; /* long idle: just refill */
+        int64_t add = (int64_t)(dt * (uint64_t)rate * 1000 / period_ns);
+        b->tokens = b->tokens + add > cap ? cap : b->tokens + add;
     }
-    return NULL;
+    b->last_ns = now;
+    if (b->tokens < 1000) return 0;
+    b->tokens -= 1000;
+    return 1;
 }
 
-void build_html_head(char *buf) {
-    sprintf(buf,
-        "<!DOCTYPE html><html lang=\"en\"><head>"
-        "<meta charset=\"UTF-8\">"
-        "<meta name=\"viewport\" content=\"width=device-width,initial-scale=1\">"
-        "<title>Hand Cricket Game</title>%s</head><body>", CSS_STYLES);
+/* Finds or claims the address's entry; caller holds its stripe lock */
+RateEntry* rate_entry(uint32_t ip, uint64_t now) {
+    unsigned int set = (ip * 2654435761u) >> 22; /* top 10 bits: RATE_SETS */
+    RateEntry *ways = rate_table[set], *oldest = &ways[0];
+    for (int w = 0; w < RATE_WAYS; w++) {
+        if (ways[w].ip == ip) { ways[w].seen_ns = now; return &ways[w]; }
+        if (ways[w].seen_ns < oldest->seen_ns) oldest = &ways[w];
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    oldest->ip = ip;
+    oldest->seen_ns = now;
+    return oldest;
 }
 
-void build_page_menu(char *resp, GameSession *s) {
-    char html[BUFFER_SIZE];
-    char head[8192];
-    const char *diff_names[] = {"", "Easy", "Medium", "Hard"};
-    
-    build_html_head(head);
-    
-    sprintf(html,
-        "%s<div class=\"container\">"
-        "<div class=\"header\"><h1>Hand Cricket Game</h1><p>Odd or Even Cricket</p></div>"
-        "<div class=\"message-box\">%s</div>"
-        "<div class=\"panel\"><div class=\"panel-title\">Main Menu</div>"
-        "<div class=\"btn-grid-2\">"
-        "<a href=\"/start\" class=\"btn btn-success\">New Game</a>"
-        "<a href=\"/help\" class=\"btn btn-info\">How to Play</a>"
-        "</div></div>"
-        "<div class=\"panel\"><div class=\"panel-title\">Difficulty: %s</div>"
-        "<div class=\"btn-grid-3\">"
-        "<a href=\"/diff/1\" class=\"btn btn-number %s\">Easy</a>"
-        "<a href=\"/diff/2\" class=\"btn btn-number %s\">Medium</a>"
-        "<a href=\"/diff/3\" class=\"btn btn-number %s\">Hard</a>"
-        "</div></div>"
-        "<div class=\"footer\">Made with C | Hand Cricket v2.0</div>"
-        "</div></body></html>",
-        head, s->message, diff_names[s->difficulty],
-        s->difficulty == 1 ? "difficulty-active" : "",
-        s->difficulty == 2 ? "difficulty-active" : "",
-        s->difficulty == 3 ? "difficulty-active" : "");
-    
-    sprintf(resp,
-        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
-        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n%s",
-        s->session_id, html);
+/* Takes a request (RATE_SCOPE_IP) or session creation (RATE_SCOPE_CREATE) token; returns 0 if refused */
+int rate_check_ip(uint32_t ip, int scope) {
+    if (!ip_rate) return 1;
+    uint64_t now = now_ns();
+    unsigned int set = (ip * 2654435761u) >> 22;
+    pthread_mutex_t *lock = &rate_locks[set % RATE_LOCKS];
+    int ok;
+    pthread_mutex_lock(lock);
+    RateEntry *e = rate_entry(ip, now);
+    if (scope == RATE_SCOPE_CREATE) ok = bucket_take(&e->creates, now, CREATE_RATE_PERIOD_S * 1000000000ull, 1, CREATE_BURST);
+    else ok = bucket_take(&e->requests, now, 1000000000ull, ip_rate, (int64_t)ip_rate * RATE_BURST_SECS);
+    pthread_mutex_unlock(lock);
+    if (!ok) metric_add(&metrics_local()->rate_limited[scope], 1);
+    return ok;
 }
 
-void build_page_help(char *resp, GameSession *s) {
-    char html[BUFFER_SIZE];
-    char head[8192];
-    build_html_head(head);
-    
-    sprintf(html,
-        "%s<div class=\"container\">"
-        "<div class=\"header\"><h1>How to Play</h1></div>"
-        "<div class=\"panel\">"
-        "<p><b>1. TOSS:</b> Pick HEAD or TAILS. Winner chooses role.</p><br>"
-        "<p><b>2. GAMEPLAY:</b> Pick a number 0-10. Computer picks too.</p><br>"
-        "<p><b>3. OUT:</b> If both pick the same number, batsman is OUT!</p><br>"
-        "<p><b>4. SCORING:</b> Batting? Your number = runs. Bowling? Computer's number = their runs.</p><br>"
-        "<p><b>5. SPECIAL:</b> Pick 0 to steal computer's number as your runs!</p><br>"
-        "<p><b>6. TWO INNINGS:</b> After out, roles swap. Chase or defend!</p>"
-        "</div>"
-        "<div class=\"btn-grid-2\"><a href=\"/\" class=\"btn btn-primary\">Back to Menu</a>"
-        "<a href=\"/start\" class=\"btn btn-success\">Start Game</a></div>"
-        "<div class=\"footer\">Made with C</div>"
-        "</div></body></html>", head);
-    
-    sprintf(resp,
-        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
-        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n%s",
-        s->session_id, html);
+int rate_check_session(GameSession *s) {
+    if (!ip_rate) return 1;
+    uint64_t now = now_ns();
+    pthread_mutex_t *lock = &rate_locks[(s - sessions) % RATE_LOCKS];
+    pthread_mutex_lock(lock);
+    int ok = bucket_take(&s->rate, now, 1000000000ull, SESSION_RATE, SESSION_RATE * RATE_BURST_SECS);
+    pthread_mutex_unlock(lock);
+    if (!ok) metric_add(&metrics_local()->rate_limited[RATE_SCOPE_SESSION], 1);
+    return ok;
 }
 
-void build_page_toss(char *resp, GameSession *s) {
-    char html[BUFFER_SIZE];
-    char head[8192];
-    build_html_head(head);
-    
-    sprintf(html,
-        "%s<div class=\"container\">"
-        "<div class=\"header\"><h1>Toss Time!</h1></div>"
-        "<div class=\"message-box\">%s</div>"
-        "<div class=\"panel\"><div class=\"panel-title\">Make Your Call</div>"
-        "<div class=\"btn-grid-2\">"
-        "<a href=\"/toss/head\" class=\"btn btn-primary\" style=\"padding:25px;font-size:18px;\">HEAD</a>"
-        "<a href=\"/toss/tail\" class=\"btn btn-warning\" style=\"padding:25px;font-size:18px;\">TAILS</a>"
-        "</div></div>"
-        "<a href=\"/\" class=\"btn btn-danger\" style=\"width:100%%;\">Back to Menu</a>"
-        "<div class=\"footer\">Made with C</div>"
-        "</div></body></html>", head, s->message);
-    
-    sprintf(resp,
-        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
-        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n%s",
-        s->session_id, html);
+const char RATE_LIMITED_RESPONSE[] = "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\nContent-Type: text/plain\r\n"
+                                     "Connection: close\r\n\r\nToo many requests, slow down.\n";
+
+void send_rate_limited(int sock) {
+    send_response(sock, RATE_LIMITED_RESPONSE, sizeof(RATE_LIMITED_RESPONSE) - 1);
 }
 
-void build_page_choose(char *resp, GameSession *s) {
-    char html[BUFFER_SIZE];
-    char head[8192];
-    build_html_head(head);
-    
-    sprintf(html,
-        "%s<div class=\"container\">"
-        "<div class=\"header\"><h1>You Won the Toss!</h1></div>"
-        "<div class=\"message-box\">%s</div>"
-        "<div class=\"panel\"><div class=\"panel-title\">Choose Your Role</div>"
-        "<div class=\"btn-grid-2\">"
-        "<a href=\"/choose/bat\" class=\"btn btn-success\" style=\"padding:25px;font-size:18px;\">BAT First</a>"
-        "<a href=\"/choose/bowl\" class=\"btn btn-danger\" style=\"padding:25px;font-size:18px;\">BOWL First</a>"
-        "</div></div>"
-        "<div class=\"footer\">Made with C</div>"
-        "</div></body></html>", head, s->message);
-    
-    sprintf(resp,
-        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
-        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n%s",
-        s->session_id, html);
+/* Claims a connection slot; on overload answers 503 without blocking and returns 0 */
+int admit_connection(int sock) {
+    if (__atomic_add_fetch(&active_connections, 1, __ATOMIC_RELAXED) <= max_connections) return 1;
+    __atomic_sub_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Type: text/plain\r\n"
+                               "Connection: close\r\n\r\nServer busy, try again.\n";
+    send(sock, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    metric_add(&metrics_local()->connections_shed, 1);
+    return 0;
 }
 
-void build_page_game(char *resp, GameSession *s) {
-    char html[BUFFER_SIZE];
-    char head[8192];
-    char your_choice[8], comp_choice[8];
-    char target_html[256] = "";
-    char innings_text[64];
-    
-    build_html_head(head);
-    
-    if (s->last_player_input >= 0) sprintf(your_choice, "%d", s->last_player_input);
-    else strcpy(your_choice, "-");
-    if (s->last_computer_move >= 0) sprintf(comp_choice, "%d", s->last_computer_move);
-    else strcpy(comp_choice, "-");
-    
-    if (s->second_innings) {
-        sprintf(innings_text, "%s - 2nd Innings", s->is_batting ? "CHASING" : "DEFENDING");
-        if (s->is_batting) {
-            sprintf(target_html, "<div class=\"target-info\">Target: %d | Need: %d more to win</div>",
-                s->first_innings_score + 1, (s->first_innings_score + 1) - s->player_score);
-        } else {
-            sprintf(target_html, "<div class=\"target-info\">Target: %d | Computer needs: %d more</div>",
-                s->first_innings_score + 1, (s->first_innings_score + 1) - s->computer_score);
-        }
-    } else {
-        sprintf(innings_text, "%s - 1st Innings", s->is_batting ? "BATTING" : "BOWLING");
+void release_connection(void) {
+    __atomic_sub_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+}
+
+/* ==================== MATCH LOG ==================== */
+/*
+ * Balls are appended to one of two in-memory batches under a short mutex;
+ * matchlog_thread swaps the batches and writes the full one with a single
+ * write() (group commit), so no request ever waits on disk. If the writer
+ * falls a whole batch behind, new records are dropped and counted. A
+ * session owner (see SESSION OWNERS) first collects its balls in a private
+ * batch and moves it over in one go, when it fills, when the owner goes
+ * idle and otherwise every MATCHLOG_FLUSH_MS, so the ball path of an owner
+ * takes no shared lock. Records stay in order per session, not overall.
+ */
+#define MATCHLOG_BATCH 4096
+#define MATCHLOG_FLUSH_MS 20
+#define MATCHLOG_OWNED 256              /* records in an owner's private batch */
+
+const char *match_log_path = NULL;
+int match_log_fd = -1;
+MatchLogRecord match_log_batch[2][MATCHLOG_BATCH];
+int match_log_fill = 0;
+int match_log_active = 0;
+pthread_mutex_t match_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t match_log_cond = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t match_log_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+__thread MatchLogRecord *match_log_owned = NULL;   /* set on owner threads only */
+__thread int match_log_owned_fill = 0;
+
+int matchlog_open(const char *path) {
+    MatchLogHeader h;
+    struct stat st;
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    if (st.st_size == 0) {
+        matchlog_init_header(&h);
+        if (write(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)) { close(fd); return -1; }
+        return fd;
     }
-    
-    sprintf(html,
-        "%s<div class=\"container\">"
-        "<div class=\"header\"><h1>Hand Cricket</h1></div>"
-        "<div class=\"message-box\">%s</div>"
-        "<div style=\"text-align:center;\">"
-        "<span class=\"status-badge %s\">%s</span>"
-        "</div>"
-        "%s"
-        "<div class=\"scoreboard\">"
-        "<div class=\"score-card player\"><div class=\"label\">Your Score</div><div class=\"score\">%d</div></div>"
-        "<div class=\"score-card computer\"><div class=\"label\">Computer</div><div class=\"score\">%d</div></div>"
-        "</div>"
-        "<div class=\"choices\">"
-        "<div class=\"choice-box\"><div class=\"label\">Your Pick</div><div class=\"value\">%s</div></div>"
-        "<div class=\"choice-box\"><div class=\"label\">Computer</div><div class=\"value\">%s</div></div>"
-        "</div>"
-        "<div class=\"panel\"><div class=\"panel-title\">Pick a Number (0-10)</div>"
-        "<div class=\"btn-grid\">"
-        "<a href=\"/play/0\" class=\"btn btn-number\">0</a>"
-        "<a href=\"/play/1\" class=\"btn btn-number\">1</a>"
-        "<a href=\"/play/2\" class=\"btn btn-number\">2</a>"
-        "<a href=\"/play/3\" class=\"btn btn-number\">3</a>"
-        "<a href=\"/play/4\" class=\"btn btn-number\">4</a>"
-        "<a href=\"/play/5\" class=\"btn btn-number\">5</a>"
-        "<a href=\"/play/6\" class=\"btn btn-number\">6</a>"
-        "<a href=\"/play/7\" class=\"btn btn-number\">7</a>"
-        "<a href=\"/play/8\" class=\"btn btn-number\">8</a>"
-        "<a href=\"/play/9\" class=\"btn btn-number\">9</a>"
-        "<a href=\"/play/10\" class=\"btn btn-number btn-wide\">10</a>"
-        "<a href=\"/reset\" class=\"btn btn-danger btn-wide\">Reset Game</a>"
-        "</div></div>"
-        "<div class=\"footer\">Made with C</div>"
-        "</div></body></html>",
-        head, s->message,
-        s->is_batting ? "status-batting" : "status-bowling",
-        innings_text, target_html,
-        s->player_score, s->computer_score,
-        your_choice, comp_choice);
-    
-    sprintf(resp,
-        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
-        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n%s",
-        s->session_id, html);
+    int rfd = open(path, O_RDONLY);
+    int ok = rfd >= 0 && read(rfd, &h, sizeof(h)) == (ssize_t)sizeof(h) && matchlog_header_ok(&h) &&
+             (st.st_size - (off_t)sizeof(h)) % (off_t)sizeof(MatchLogRecord) == 0;
+    if (rfd >= 0) close(rfd);
+    if (!ok) { close(fd); return -1; }
+    return fd;
 }
 
-void build_page_gameover(char *resp, GameSession *s) {
-    char html[BUFFER_SIZE];
-    char head[8192];
-    char result_class[32], result_icon[16], result_text[32], result_detail[64];
-    
-    build_html_head(head);
-    
-    if (s->player_score > s->computer_score) {
-        strcpy(result_class, "result-win");
-        strcpy(result_icon, "🎉");
-        strcpy(result_text, "YOU WIN!");
-        sprintf(result_detail, "Won by %d run(s)!", s->player_score - s->computer_score);
-    } else if (s->computer_score > s->player_score) {
-        strcpy(result_class, "result-lose");
-        strcpy(result_icon, "😔");
-        strcpy(result_text, "YOU LOST");
-        sprintf(result_detail, "Lost by %d run(s)", s->computer_score - s->player_score);
+/* Moves the calling owner's private batch into the shared one */
+void matchlog_push_owned(void) {
+    int n = match_log_owned_fill, room;
+    if (n == 0) return;
+    MetricShard *m = metrics_local();
+    pthread_mutex_lock(&match_log_mutex);
+    room = MATCHLOG_BATCH - match_log_fill;
+    if (room > n) room = n;
+    memcpy(&match_log_batch[match_log_active][match_log_fill], match_log_owned, room * sizeof(MatchLogRecord));
+    match_log_fill += room;
+    if (match_log_fill >= MATCHLOG_BATCH / 2) pthread_cond_signal(&match_log_cond);
+    pthread_mutex_unlock(&match_log_mutex);
+    match_log_owned_fill = 0;
+    metric_add(&m->match_log_records, room);
+    metric_add(&m->match_log_dropped, n - room);
+}
+
+void matchlog_append(const MatchLogRecord *r) {
+    if (match_log_owned) {
+        match_log_owned[match_log_owned_fill++] = *r;
+        if (match_log_owned_fill == MATCHLOG_OWNED) matchlog_push_owned();
+        return;
+    }
+    MetricShard *m = metrics_local();
+    pthread_mutex_lock(&match_log_mutex);
+    if (match_log_fill < MATCHLOG_BATCH) {
+        match_log_batch[match_log_active][match_log_fill++] = *r;
+        if (match_log_fill == MATCHLOG_BATCH / 2) pthread_cond_signal(&match_log_cond);
+        pthread_mutex_unlock(&match_log_mutex);
+        metric_add(&m->match_log_records, 1);
     } else {
-        strcpy(result_class, "result-tie");
-        strcpy(result_icon, "🤝");
-        strcpy(result_text, "IT'S A TIE!");
-        sprintf(result_detail, "Both scored %d runs", s->player_score);
+        pthread_mutex_unlock(&match_log_mutex);
+        metric_add(&m->match_log_dropped, 1);
     }
+}
+
+/* Swaps batches and writes out everything queued so far */
+void matchlog_flush(void) {
+    pthread_mutex_lock(&match_log_write_mutex);
+    pthread_mutex_lock(&match_log_mutex);
+    int full = match_log_active, n = match_log_fill;
+    match_log_active ^= 1;
+    match_log_fill = 0;
+    pthread_mutex_unlock(&match_log_mutex);
+    if (n > 0 && write(match_log_fd, match_log_batch[full], n * sizeof(MatchLogRecord)) < 0)
+        perror("match log");
+    pthread_mutex_unlock(&match_log_write_mutex);
+}
+
+void *matchlog_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += MATCHLOG_FLUSH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+        pthread_mutex_lock(&match_log_mutex);
+        while (match_log_fill < MATCHLOG_BATCH / 2 &&
+               pthread_cond_timedwait(&match_log_cond, &match_log_mutex, &deadline) == 0);
+        pthread_mutex_unlock(&match_log_mutex);
+        matchlog_flush();
+    }
+    return NULL;
+}
+
+void matchlog_ball(const GameSession *s, int innings, int player_batting, int num, int comp, int runs, int flags) {
+    struct timeval tv;
+    MatchLogRecord r;
+    if (match_log_fd < 0) return;
+    gettimeofday(&tv, NULL);
+    memset(&r, 0, sizeof(r));
+    r.timestamp_us = (uint64_t)tv.tv_sec * 1000000ull + (uint64_t)tv.tv_usec;
+    r.session = matchlog_key(s->session_id);
+    r.innings = (uint8_t)innings;
+    r.player_number = (uint8_t)num;
+    r.computer_number = (uint8_t)comp;
+    r.runs = (uint8_t)runs;
+    r.flags = (uint8_t)(flags | (player_batting ? MATCHLOG_PLAYER_BATTING : 0) | (s->game_phase == 4 ? MATCHLOG_GAME_OVER : 0));
+    r.difficulty = (uint8_t)s->difficulty;
+    r.source = MATCHLOG_SOURCE_WEB;
+    matchlog_append(&r);
+}
+
+/* ==================== ACCESS LOG ==================== */
+/*
+ * Each finished request becomes a fixed-size record in one of a set of
+ * single-producer rings. Connection threads are short-lived, so a thread
+ * binds to a preferred ring on first use (like metric shards) and claims
+ * it with an atomic flag only for the few stores of one append; a busy or
+ * full ring moves on to the next, and after a few tries the record is
+ * dropped and counted. Nothing on the request path waits or writes.
+ * access_log_thread drains every ring on a timer, formats logfmt lines
+ * into one batch and writes it with a single write(), rotating the file
+ * by size. Lines are ordered per ring, so only roughly by time overall.
+ */
+#define ACCESS_RINGS 64
+#define ACCESS_RING_SIZE 1024           /* records per ring, a power of two */
+#define ACCESS_CLAIM_TRIES 4
+#define ACCESS_FLUSH_MS 100
+#define ACCESS_BATCH_BYTES (256 * 1024)
+#define ACCESS_LINE_MAX 192
+#define ACCESS_LOG_KEEP 5               /* rotated files kept: FILE.1 .. FILE.5 */
+#define DEFAULT_ACCESS_LOG_MAX_MB 64
+
+typedef struct {
+    uint64_t timestamp_us;  /* wall clock */
+    uint64_t session;
+    uint64_t latency_ns;
+    uint32_t bytes;
+    uint32_t ip;
+    uint16_t status;
+    uint8_t route;
+} AccessRecord;
+
+typedef struct {
+    uint32_t busy;          /* 1 while a producer is appending */
+    uint32_t head;          /* next slot to fill; published with release */
+    uint32_t tail __attribute__((aligned(64))); /* next slot to drain; owned by the writer */
+    AccessRecord rec[ACCESS_RING_SIZE];
+} __attribute__((aligned(64))) AccessRing;
+
+const char *access_log_path = NULL;
+int access_log_fd = -1;
+int access_log_max_mb = DEFAULT_ACCESS_LOG_MAX_MB;     /* 0 = never rotate */
+off_t access_log_size = 0;
+AccessRing access_rings[ACCESS_RINGS];
+unsigned int access_next_ring = 0;
+__thread int access_ring = -1;
+pthread_mutex_t access_log_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int access_log_open(void) {
+    struct stat st;
+    int fd = open(access_log_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    access_log_size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    return fd;
+}
+
+void access_log_request(int route, uint64_t elapsed_ns) {
+    RequestNote note = request_note;
+    request_note.status = 0;
+    request_note.bytes = 0;
+    if (access_log_fd < 0) return;
+    
+    struct timespec ts;
+    AccessRecord rec;
+    MetricShard *m = metrics_local();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec.timestamp_us = (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+    rec.session = note.session;
+    rec.latency_ns = elapsed_ns;
+    rec.bytes = note.bytes > UINT32_MAX ? UINT32_MAX : (uint32_t)note.bytes;
+    rec.ip = note.ip;
+    rec.status = (uint16_t)note.status;
+    rec.route = (uint8_t)route;
+    
+    if (access_ring < 0)
+        access_ring = (int)(__atomic_fetch_add(&access_next_ring, 1, __ATOMIC_RELAXED) % ACCESS_RINGS);
+    for (int t = 0; t < ACCESS_CLAIM_TRIES; t++) {
+        AccessRing *r = &access_rings[(access_ring + t) % ACCESS_RINGS];
+        if (__atomic_exchange_n(&r->busy, 1, __ATOMIC_ACQUIRE)) continue;
+        uint32_t head = r->head;
+        int room = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) < ACCESS_RING_SIZE;
+        if (room) {
+            r->rec[head & (ACCESS_RING_SIZE - 1)] = rec;
+            __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&r->busy, 0, __ATOMIC_RELEASE);
+        if (room) { metric_add(&m->access_log_records, 1); return; }
+    }
+    metric_add(&m->access_log_dropped, 1);
+}
+
+int access_log_format(char *out, const AccessRecord *r) {
+    static char stamp[32];
+    static time_t stamp_secs = -1;
+    time_t secs = (time_t)(r->timestamp_us / 1000000);
+    const unsigned char *ip = (const unsigned char *)&r->ip;
+    char status[8] = "-";
+    if (secs != stamp_secs) {
+        struct tm tm;
+        gmtime_r(&secs, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+        stamp_secs = secs;
+    }
+    if (r->status) snprintf(status, sizeof(status), "%u", r->status);
+    return snprintf(out, ACCESS_LINE_MAX,
+        "ts=%s.%06uZ ip=%u.%u.%u.%u route=%s status=%s bytes=%u us=%llu session=%016llx\n",
+        stamp, (unsigned)(r->timestamp_us % 1000000), ip[0], ip[1], ip[2], ip[3],
+        r->route < ROUTE_COUNT ? route_names[r->route] : "other", status, r->bytes,
+        (unsigned long long)(r->latency_ns / 1000), (unsigned long long)r->session);
+}
+
+/* Renames FILE to FILE.1 (shifting older copies up) and starts a new FILE */
+void access_log_rotate(void) {
+    char from[512], to[512];
+    for (int k = ACCESS_LOG_KEEP - 1; k >= 1; k--) {
+        snprintf(from, sizeof(from), "%s.%d", access_log_path, k);
+        snprintf(to, sizeof(to), "%s.%d", access_log_path, k + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", access_log_path);
+    rename(access_log_path, to);
+    int fd = access_log_open();
+    if (fd < 0) { perror("access log"); return; }  /* keep appending to the renamed file */
+    close(access_log_fd);
+    access_log_fd = fd;
+}
+
+void access_log_write(const char *buf, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(access_log_fd, buf + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { perror("access log"); return; }
+        off += (size_t)n;
+    }
+    access_log_size += (off_t)len;
+    if (access_log_max_mb > 0 && access_log_size >= (off_t)access_log_max_mb << 20) access_log_rotate();
+}
+
+/* Drains every ring into the file */
+void access_log_flush(void) {
+    static char batch[ACCESS_BATCH_BYTES];
+    size_t len = 0;
+    pthread_mutex_lock(&access_log_write_mutex);
+    for (int i = 0; i < ACCESS_RINGS; i++) {
+        AccessRing *r = &access_rings[i];
+        uint32_t tail = r->tail, head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (; tail != head; tail++) {
+            if (len + ACCESS_LINE_MAX > sizeof(batch)) { access_log_write(batch, len); len = 0; }
+            len += (size_t)access_log_format(batch + len, &r->rec[tail & (ACCESS_RING_SIZE - 1)]);
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    if (len) access_log_write(batch, len);
+    pthread_mutex_unlock(&access_log_write_mutex);
+}
+
+void *access_log_thread(void *arg) {
+    (void)arg;
+    struct timespec wait = { 0, ACCESS_FLUSH_MS * 1000000L };
+    for (;;) {
+        nanosleep(&wait, NULL);
+        access_log_flush();
+    }
+    return NULL;
+}
+
+/* ==================== TRAFFIC CAPTURE ==================== */
+/*
+ * With --capture FILE every HTTP request (HTTP/2 streams included) is
+ * recorded for handcricket_replay: path, cookies, arrival time, status,
+ * size and server time, in the fixed records of handcricket_capture.h.
+ * handle_request notes the path and cookies when it starts, and the
+ * record is finished next to the access log entry when the request is
+ * observed. Records go through the same two-batch group commit as the
+ * match log, so capturing never puts a disk write on the request path.
+ * WebSocket moves are not requests and are not captured.
+ */
+#define CAPTURE_BATCH 4096
+#define CAPTURE_FLUSH_MS 50
+
+char* get_session_cookie(const char *req);     /* with the sessions and profiles below */
+uint64_t get_player_cookie(const char *req);
+
+typedef struct {
+    int active;             /* set by capture_begin, cleared when the record is taken */
+    uint64_t session, player;
+    uint8_t flags;
+    char path[CAPTURE_PATH_MAX];
+} CaptureNote;
+
+const char *capture_path = NULL;
+int capture_fd = -1;
+CaptureRecord capture_batch[2][CAPTURE_BATCH];
+int capture_fill = 0;
+int capture_active = 0;
+pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t capture_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+__thread CaptureNote capture_note;
+
+int capture_open(void) {
+    CaptureHeader h;
+    struct stat st;
+    int fd = open(capture_path, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) { if (fd >= 0) close(fd); return -1; }
+    if (st.st_size == 0) {
+        capture_init_header(&h);
+        if (write(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)) { close(fd); return -1; }
+        return fd;
+    }
+    if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || !capture_header_ok(&h) ||
+        (st.st_size - (off_t)sizeof(h)) % (off_t)sizeof(CaptureRecord) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Called by handle_request once the path is known */
+void capture_begin(const char *req, const char *path) {
+    const char *sid;
+    if (capture_fd < 0) return;
+    capture_note.active = 1;
+    sid = get_session_cookie(req);
+    capture_note.session = sid ? matchlog_key(sid) : 0;
+    capture_note.player = get_player_cookie(req);
+    capture_note.flags = response_capture ? CAPTURE_HTTP2 : 0;
+    size_t len = strnlen(path, CAPTURE_PATH_MAX + 1);
+    if (len > CAPTURE_PATH_MAX) { capture_note.flags |= CAPTURE_TRUNCATED; len = CAPTURE_PATH_MAX; }
+    memset(capture_note.path, 0, CAPTURE_PATH_MAX);
+    memcpy(capture_note.path, path, len);
+}
+
+/* Finishes the record for the request this thread just served */
+void capture_request(uint64_t elapsed_ns) {
+    struct timespec ts;
+    CaptureRecord r;
+    MetricShard *m = metrics_local();
+    if (!capture_note.active) return;
+    capture_note.active = 0;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r.timestamp_us = (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000 - elapsed_ns / 1000;
+    r.session = capture_note.session;
+    r.served = request_note.session;
+    r.player = capture_note.player;
+    r.latency_us = elapsed_ns / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(elapsed_ns / 1000);
+    r.bytes = request_note.bytes > UINT32_MAX ? UINT32_MAX : (uint32_t)request_note.bytes;
+    r.status = (uint16_t)request_note.status;
+    r.flags = capture_note.flags;
+    r.reserved = 0;
+    memcpy(r.path, capture_note.path, CAPTURE_PATH_MAX);
+    
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_fill < CAPTURE_BATCH) {
+        capture_batch[capture_active][capture_fill++] = r;
+        pthread_mutex_unlock(&capture_mutex);
+        metric_add(&m->capture_records, 1);
+    } else {
+        pthread_mutex_unlock(&capture_mutex);
+        metric_add(&m->capture_dropped, 1);
+    }
+}
+
+/* Swaps batches and writes out everything captured so far */
+void capture_flush(void) {
+    pthread_mutex_lock(&capture_write_mutex);
+    pthread_mutex_lock(&capture_mutex);
+    int full = capture_active, n = capture_fill;
+    capture_active ^= 1;
+    capture_fill = 0;
+    pthread_mutex_unlock(&capture_mutex);
+    if (n > 0 && write(capture_fd, capture_batch[full], n * sizeof(CaptureRecord)) < 0)
+        perror("capture");
+    pthread_mutex_unlock(&capture_write_mutex);
+}
+
+void *capture_thread(void *arg) {
+    struct timespec wait = { 0, CAPTURE_FLUSH_MS * 1000000L };
+    (void)arg;
+    for (;;) {
+        nanosleep(&wait, NULL);
+        capture_flush();
+    }
+    return NULL;
+}
+
+/* ==================== STRATEGY TABLE ==================== */
+/*
+ * The Optimal difficulty plays the equilibrium strategies precomputed by
+ * handcricket_solver. The table is mapped read-only at startup and shared
+ * by every thread, so a move is one lookup into it and one random draw.
+ */
+const char *strategy_path = NULL;
+const StrategyHeader *strategy_table = NULL;
+
+int strategy_load(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != strategy_file_size()) { close(fd); return -1; }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    if (!strategy_header_ok(map)) { munmap(map, st.st_size); return -1; }
+    madvise(map, st.st_size, MADV_WILLNEED);
+    strategy_table = map;
+    return 0;
+}
+
+int strategy_move(const GameSession *s) {
+    int computer_batting = !s->is_batting, history = 0, runs;
+    int score = computer_batting ? s->computer_score : s->player_score;
+    /* The repeat rule only binds a human batsman; it compares with the last stored pick */
+    if (s->is_batting && s->move_count > 0)
+        history = strategy_history(s->prev_moves[s->move_count - 1], s->same_choice_count);
+    runs = s->second_innings ? s->first_innings_score + 1 - score : score;
+    return strategy_pick(strategy_entry(strategy_table, computer_batting, s->second_innings, runs, history),
+                         (unsigned)rand() & 0xFFFF);
+}
+
+/* ==================== LIVE EVENTS (SSE) ==================== */
+/*
+ * Spectators open /events/<session> and keep a text/event-stream open. The
+ * request thread hands the socket over to a watcher table bucketed by
+ * session key; every ball is serialized once, straight into a slot of a
+ * bounded lock-free queue, and a single epoll thread writes that one payload
+ * to all of the session's watchers with non-blocking sends. The same thread
+ * notices disconnects and sends keep-alives, so watchers cost a table slot
+ * each, not a thread, and a publisher never waits on sse_mutex or a socket.
+ * A watcher that cannot keep up is disconnected (EventSource reconnects and
+ * gets the current state); an event that finds the queue full is dropped
+ * and counted. The queue is Vyukov's bounded MPMC array with one consumer.
+ */
+#define SSE_MAX_WATCHERS 1024
+#define SSE_BUCKETS 256
+#define SSE_HEARTBEAT_MS 15000
+#define SSE_EVENT_SIZE 1024
+#define SSE_QUEUE 256                   /* queued events, a power of two */
+#define SSE_WAKE_TAG UINT64_MAX         /* epoll data of the queue's eventfd */
+
+typedef struct {
+    int fd;             /* -1 when the slot is free */
+    uint32_t gen;       /* bumped when the slot is freed, so stale epoll events are ignored */
+    uint64_t key;       /* matchlog_key() of the watched session id */
+    int next;           /* next watcher in the same bucket, -1 ends the list */
+} Watcher;
+
+Watcher sse_watchers[SSE_MAX_WATCHERS];
+int sse_bucket[SSE_BUCKETS];
+int sse_watcher_count = 0;
+int sse_epoll_fd = -1;
+pthread_mutex_t sse_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    uint32_t seq;       /* == position: free for it; == position + 1: filled */
+    int len;
+    uint64_t key;
+    char data[SSE_EVENT_SIZE];
+} SseSlot;
+
+SseSlot sse_queue[SSE_QUEUE];
+uint32_t sse_enqueue_pos __attribute__((aligned(64))) = 0;
+uint32_t sse_dequeue_pos __attribute__((aligned(64))) = 0;     /* sse_thread only */
+uint32_t sse_wake_pending = 0;      /* 1 once the eventfd has been written and not yet drained */
+int sse_wake_fd = -1;
+
+void sse_init(void) {
+    struct epoll_event ev;
+    for (int i = 0; i < SSE_MAX_WATCHERS; i++) { sse_watchers[i].fd = -1; sse_watchers[i].next = -1; }
+    for (int b = 0; b < SSE_BUCKETS; b++) sse_bucket[b] = -1;
+    for (uint32_t i = 0; i < SSE_QUEUE; i++) sse_queue[i].seq = i;
+    sse_epoll_fd = epoll_create1(0);
+    sse_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = SSE_WAKE_TAG;
+    epoll_ctl(sse_epoll_fd, EPOLL_CTL_ADD, sse_wake_fd, &ev);
+}
+
+/* All or nothing: a partial event would corrupt the stream */
+int sse_send(int fd, const char *buf, size_t len) {
+    return send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)len ? 0 : -1;
+}
+
+/* Caller holds sse_mutex */
+void sse_drop_locked(int i) {
+    Watcher *w = &sse_watchers[i];
+    int *link = &sse_bucket[w->key % SSE_BUCKETS];
+    while (*link != i) link = &sse_watchers[*link].next;
+    *link = w->next;
+    epoll_ctl(sse_epoll_fd, EPOLL_CTL_DEL, w->fd, NULL);
+    close(w->fd);
+    w->fd = -1;
+    w->next = -1;
+    w->gen++;
+    __atomic_sub_fetch(&sse_watcher_count, 1, __ATOMIC_RELAXED);
+}
+
+/* Takes ownership of fd on success; the hello (headers + first event) is sent first */
+int sse_subscribe(int fd, uint64_t key, const char *hello, size_t len) {
+    struct epoll_event ev;
+    int i;
+    if (sse_epoll_fd < 0) return -1;
+    pthread_mutex_lock(&sse_mutex);
+    for (i = 0; i < SSE_MAX_WATCHERS && sse_watchers[i].fd >= 0; i++);
+    if (i == SSE_MAX_WATCHERS || sse_send(fd, hello, len) < 0) { pthread_mutex_unlock(&sse_mutex); return -1; }
+    Watcher *w = &sse_watchers[i];
+    w->fd = fd;
+    w->key = key;
+    w->next = sse_bucket[key % SSE_BUCKETS];
+    sse_bucket[key % SSE_BUCKETS] = i;
+    __atomic_add_fetch(&sse_watcher_count, 1, __ATOMIC_RELAXED);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u64 = ((uint64_t)w->gen << 32) | (uint32_t)i;
+    epoll_ctl(sse_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    pthread_mutex_unlock(&sse_mutex);
+    return 0;
+}
+
+/* One SSE event describing the session; runs/out describe the last ball */
+int sse_format(char *buf, size_t cap, const char *event, const GameSession *s, int runs, int out) {
+    char msg[512], *m = msg;
+    for (const char *c = s->message; *c && m < msg + sizeof(msg) - 2; c++) {
+        if (*c == '"' || *c == '\\') *m++ = '\\';
+        *m++ = *c;
+    }
+    *m = '\0';
+    return snprintf(buf, cap,
+        "event: %s\ndata: {\"phase\":%d,\"innings\":%d,\"batting\":%s,\"player\":%d,\"computer\":%d,"
+        "\"target\":%d,\"you\":%d,\"comp\":%d,\"runs\":%d,\"out\":%s,\"difficulty\":%d,\"message\":\"%s\"}\n\n",
+        event, s->game_phase, s->second_innings + 1, s->is_batting ? "true" : "false",
+        s->player_score, s->computer_score, s->second_innings ? s->first_innings_score + 1 : 0,
+        s->last_player_input, s->last_computer_move, runs, out ? "true" : "false", s->difficulty, msg);
+}
+
+/* Queues one serialized event for everyone watching this session; never blocks */
+void sse_publish(const GameSession *s, const char *event, int runs, int out) {
+    SseSlot *slot;
+    uint32_t pos;
+    if (__atomic_load_n(&sse_watcher_count, __ATOMIC_RELAXED) == 0) return;
+    pos = __atomic_load_n(&sse_enqueue_pos, __ATOMIC_RELAXED);
+    while (1) {
+        slot = &sse_queue[pos & (SSE_QUEUE - 1)];
+        int32_t lag = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (lag == 0) {
+            if (__atomic_compare_exchange_n(&sse_enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (lag < 0) {
+            metric_add(&metrics_local()->sse_queue_full, 1);
+            return;
+        } else pos = __atomic_load_n(&sse_enqueue_pos, __ATOMIC_RELAXED);
+    }
+    slot->key = matchlog_key(s->session_id);
+    slot->len = sse_format(slot->data, sizeof(slot->data), event, s, runs, out);
+    if (slot->len >= (int)sizeof(slot->data)) slot->len = 0;   /* skipped by the fan-out */
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    if (!__atomic_exchange_n(&sse_wake_pending, 1, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(sse_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) perror("sse wake");
+    }
+}
+
+/* Caller holds sse_mutex; writes every queued event to its session's watchers */
+void sse_fan_out_locked(void) {
+    int sent = 0, dropped = 0;
+    while (1) {
+        SseSlot *slot = &sse_queue[sse_dequeue_pos & (SSE_QUEUE - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != sse_dequeue_pos + 1) break;
+        for (int i = sse_bucket[slot->key % SSE_BUCKETS], next; i >= 0 && slot->len > 0; i = next) {
+            next = sse_watchers[i].next;
+            if (sse_watchers[i].key != slot->key) continue;
+            if (sse_send(sse_watchers[i].fd, slot->data, slot->len) == 0) sent++;
+            else { sse_drop_locked(i); dropped++; }
+        }
+        __atomic_store_n(&slot->seq, sse_dequeue_pos + SSE_QUEUE, __ATOMIC_RELEASE);
+        sse_dequeue_pos++;
+    }
+    MetricShard *m = metrics_local();
+    metric_add(&m->sse_events, sent);
+    metric_add(&m->sse_dropped, dropped);
+}
+
+/* Fans queued events out, notices closed watchers and keeps idle streams alive through proxies */
+void *sse_thread(void *arg) {
+    struct epoll_event ev[64];
+    uint64_t next_beat = now_ns() + SSE_HEARTBEAT_MS * 1000000ull;
+    (void)arg;
+    while (1) {
+        uint64_t now = now_ns();
+        int timeout = next_beat > now ? (int)((next_beat - now) / 1000000) + 1 : 0;
+        int n = epoll_wait(sse_epoll_fd, ev, 64, timeout);
+        pthread_mutex_lock(&sse_mutex);
+        for (int e = 0; e < n; e++) {
+            if (ev[e].data.u64 == SSE_WAKE_TAG) {
+                uint64_t count;
+                if (read(sse_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("sse wake");
+                /* Clear before draining: an event queued after this point writes the eventfd again */
+                __atomic_store_n(&sse_wake_pending, 0, __ATOMIC_SEQ_CST);
+                sse_fan_out_locked();
+                continue;
+            }
+            int i = (int)(ev[e].data.u64 & 0xffffffffu);
+            char junk[256];
+            if (sse_watchers[i].fd < 0 || sse_watchers[i].gen != (uint32_t)(ev[e].data.u64 >> 32)) continue;
+            ssize_t r = recv(sse_watchers[i].fd, junk, sizeof(junk), MSG_DONTWAIT);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) ||
+                (ev[e].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                sse_drop_locked(i);
+        }
+        if (now_ns() >= next_beat) {
+            for (int i = 0; i < SSE_MAX_WATCHERS; i++)
+                if (sse_watchers[i].fd >= 0 && sse_send(sse_watchers[i].fd, ": ping\n\n", 8) < 0) sse_drop_locked(i);
+            next_beat = now_ns() + SSE_HEARTBEAT_MS * 1000000ull;
+        }
+        pthread_mutex_unlock(&sse_mutex);
+    }
+    return NULL;
+}
+
+/* ==================== LEADERBOARD ==================== */
+/*
+ * Finished matches are recorded into one of a few shards, each holding the
+ * top-K lists and counters collected since the last merge. A recorder only
+ * ever trylocks, moving on to the next shard if one is busy, so it never
+ * waits. Once a second leaderboard_thread drains the shards into the
+ * global board and publishes a copy under a sequence counter, which the
+ * pages read without taking any lock. Results show up within a second. A
+ * session owner records into a board of its own and folds it into a
+ * shard between jobs, so its ball path takes no lock at all.
+ */
+#define LEADERBOARD_K 10
+#define LEADERBOARD_SHARDS 16
+#define LEADERBOARD_MERGE_MS 1000
+
+enum { BOARD_HIGH_SCORE, BOARD_BIGGEST_WIN, BOARD_KINDS };
+
+typedef struct {
+    int player_score;
+    int computer_score;
+    int difficulty;
+    int64_t finished_at;
+    char player[8];         /* short tag derived from the session id */
+} LeaderEntry;
+
+typedef struct {
+    LeaderEntry top[BOARD_KINDS][DIFFICULTY_LEVELS][LEADERBOARD_K];     /* [kind][difficulty, 0 = all] best first */
+    int count[BOARD_KINDS][DIFFICULTY_LEVELS];
+    uint64_t matches[DIFFICULTY_LEVELS], wins[DIFFICULTY_LEVELS], losses[DIFFICULTY_LEVELS], ties[DIFFICULTY_LEVELS];
+} Leaderboard;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Leaderboard pending;
+} __attribute__((aligned(64))) LeaderShard;
+
+LeaderShard leader_shards[LEADERBOARD_SHARDS];
+unsigned int leader_next_shard = 0;
+__thread int leader_shard = -1;
+__thread Leaderboard *leader_owned = NULL;     /* set on owner threads only */
+Leaderboard leader_global;          /* owned by leaderboard_thread */
+Leaderboard leader_published;       /* read by the pages */
+unsigned int leader_seq = 0;        /* odd while leader_published is being rewritten */
+
+void leaderboard_init(void) {
+    for (int i = 0; i < LEADERBOARD_SHARDS; i++) pthread_mutex_init(&leader_shards[i].lock, NULL);
+}
+
+int board_key(int kind, const LeaderEntry *e) {
+    return kind == BOARD_HIGH_SCORE ? e->player_score : e->player_score - e->computer_score;
+}
+
+/* Insert into a best-first list of at most K entries; earlier entries win ties */
+void board_offer(LeaderEntry *list, int *count, int kind, const LeaderEntry *e) {
+    int key = board_key(kind, e), i = *count;
+    if (i == LEADERBOARD_K && key <= board_key(kind, &list[i - 1])) return;
+    if (i == LEADERBOARD_K) i--;
+    while (i > 0 && key > board_key(kind, &list[i - 1])) { list[i] = list[i - 1]; i--; }
+    list[i] = *e;
+    if (*count < LEADERBOARD_K) (*count)++;
+}
+
+void board_add_result(Leaderboard *b, const LeaderEntry *e) {
+    int ds[2] = {0, e->difficulty};
+    for (int j = 0; j < 2; j++) {
+        int d = ds[j];
+        b->matches[d]++;
+        if (e->player_score > e->computer_score) b->wins[d]++;
+        else if (e->player_score < e->computer_score) b->losses[d]++;
+        else b->ties[d]++;
+        board_offer(b->top[BOARD_HIGH_SCORE][d], &b->count[BOARD_HIGH_SCORE][d], BOARD_HIGH_SCORE, e);
+        if (e->player_score > e->computer_score)
+            board_offer(b->top[BOARD_BIGGEST_WIN][d], &b->count[BOARD_BIGGEST_WIN][d], BOARD_BIGGEST_WIN, e);
+    }
+}
+
+/* Adds everything in src to dst */
+void board_fold(Leaderboard *dst, const Leaderboard *src) {
+    for (int d = 0; d < DIFFICULTY_LEVELS; d++) {
+        dst->matches[d] += src->matches[d];
+        dst->wins[d] += src->wins[d];
+        dst->losses[d] += src->losses[d];
+        dst->ties[d] += src->ties[d];
+        for (int k = 0; k < BOARD_KINDS; k++)
+            for (int j = 0; j < src->count[k][d]; j++)
+                board_offer(dst->top[k][d], &dst->count[k][d], k, &src->top[k][d][j]);
+    }
+}
+
+void leaderboard_pick_shard(void) {
+    if (leader_shard < 0)
+        leader_shard = (int)(__atomic_fetch_add(&leader_next_shard, 1, __ATOMIC_RELAXED) % LEADERBOARD_SHARDS);
+}
+
+/* Called once per finished match, by handle_play on the ball that ends it */
+void leaderboard_record(const GameSession *s) {
+    LeaderEntry e;
+    MetricShard *m = metrics_local();
+    uint64_t key = matchlog_key(s->session_id);
+    memset(&e, 0, sizeof(e));
+    e.player_score = s->player_score;
+    e.computer_score = s->computer_score;
+    e.difficulty = (s->difficulty >= 1 && s->difficulty <= DIFFICULTY_OPTIMAL) ? s->difficulty : 1;
+    e.finished_at = (int64_t)time(NULL);
+    snprintf(e.player, sizeof(e.player), "%04X", (unsigned)(key & 0xffff));
+    
+    if (leader_owned) {
+        board_add_result(leader_owned, &e);
+        metric_add(&m->leaderboard_recorded, 1);
+        return;
+    }
+    leaderboard_pick_shard();
+    for (int t = 0; t < LEADERBOARD_SHARDS; t++) {
+        LeaderShard *sh = &leader_shards[(leader_shard + t) % LEADERBOARD_SHARDS];
+        if (pthread_mutex_trylock(&sh->lock) == 0) {
+            board_add_result(&sh->pending, &e);
+            pthread_mutex_unlock(&sh->lock);
+            metric_add(&m->leaderboard_recorded, 1);
+            return;
+        }
+        metric_add(&m->leaderboard_busy, 1);
+    }
+    /* Every shard busy at once: wait on our own rather than lose the result */
+    pthread_mutex_lock(&leader_shards[leader_shard].lock);
+    board_add_result(&leader_shards[leader_shard].pending, &e);
+    pthread_mutex_unlock(&leader_shards[leader_shard].lock);
+    metric_add(&m->leaderboard_recorded, 1);
+}
+
+/* Folds the calling owner's board into its shard; off the ball path, so it may wait */
+void leaderboard_push_owned(void) {
+    if (!leader_owned || leader_owned->matches[0] == 0) return;
+    leaderboard_pick_shard();
+    pthread_mutex_lock(&leader_shards[leader_shard].lock);
+    board_fold(&leader_shards[leader_shard].pending, leader_owned);
+    pthread_mutex_unlock(&leader_shards[leader_shard].lock);
+    memset(leader_owned, 0, sizeof(Leaderboard));
+}
+
+/* Drains the shards into the global board; returns the number of new matches */
+uint64_t leaderboard_merge(void) {
+    static Leaderboard batch;
+    uint64_t merged = 0;
+    for (int i = 0; i < LEADERBOARD_SHARDS; i++) {
+        LeaderShard *sh = &leader_shards[i];
+        pthread_mutex_lock(&sh->lock);
+        if (sh->pending.matches[0] == 0) { pthread_mutex_unlock(&sh->lock); continue; }
+        batch = sh->pending;
+        memset(&sh->pending, 0, sizeof(sh->pending));
+        pthread_mutex_unlock(&sh->lock);
+        board_fold(&leader_global, &batch);
+        merged += batch.matches[0];
+    }
+    if (merged) {
+        __atomic_add_fetch(&leader_seq, 1, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        leader_published = leader_global;
+        __atomic_add_fetch(&leader_seq, 1, __ATOMIC_RELEASE);
+    }
+    return merged;
+}
+
+/* Lock-free consistent copy of the published board */
+void leaderboard_read(Leaderboard *out) {
+    unsigned int before, after;
+    do {
+        before = __atomic_load_n(&leader_seq, __ATOMIC_ACQUIRE);
+        *out = leader_published;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&leader_seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+void *leaderboard_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        usleep(LEADERBOARD_MERGE_MS * 1000);
+        leaderboard_merge();
+    }
+    return NULL;
+}
+
+/* ==================== PLAYER PROFILES ==================== */
+/*
+ * With --profiles FILE each browser gets a long-lived "player" cookie and
+ * a profile: how often the player picks each number while batting and
+ * while bowling, and which pick tends to follow which. Profiles are
+ * fixed-size records in an mmapped file laid out as an open-addressing
+ * table keyed by player id, so a lookup is a short probe with no index to
+ * rebuild; when a key's probe window is full its stalest record is reused.
+ * A session copies the profile when the player is attached, counts each
+ * ball into both the copy (which Hard reads) and a pending delta, and
+ * merges the delta into the file every PROFILE_BATCH balls, at the end of
+ * a match, and before the session is spilled, reused or the server stops.
+ * File access happens under sessions_mutex, like the spill slab; with
+ * --cores the owner merges its range between jobs instead of in the
+ * request, so the request path stays free of the lock.
+ */
+#define PROFILE_MAGIC "HCPROF"
+#define PROFILE_VERSION 1
+#define PROFILE_SLOTS (1u << 20)        /* a power of two; the file is sparse until used */
+#define PROFILE_PROBES 16
+#define PROFILE_BATCH 16                /* balls per merge into the file */
+#define PROFILE_ROW_LIMIT 2000          /* rows are halved past this, so recent play counts most */
+#define PROFILE_COOKIE_AGE (365 * 24 * 3600)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;
+    uint32_t reserved;
+} ProfileHeader;
+
+typedef struct {
+    uint64_t player;        /* 0: empty */
+    int64_t updated;
+    uint32_t balls;
+    uint32_t matches;
+    ProfileCounts counts;
+} PlayerProfile;
+
+const char *profile_path = NULL;
+ProfileHeader *profile_map = NULL;
+size_t profile_map_size = 0;
+
+int profile_open(void) {
+    size_t size = sizeof(ProfileHeader) + (size_t)PROFILE_SLOTS * sizeof(PlayerProfile);
+    struct stat st;
+    int fd = open(profile_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) { if (fd >= 0) close(fd); return -1; }
+    if (st.st_size == 0) {
+        ProfileHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, PROFILE_MAGIC, sizeof(PROFILE_MAGIC));
+        h.version = PROFILE_VERSION;
+        h.record_size = sizeof(PlayerProfile);
+        h.capacity = PROFILE_SLOTS;
+        if (ftruncate(fd, (off_t)size) != 0 || pwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) { close(fd); return -1; }
+        st.st_size = (off_t)size;
+    }
+    void *map = (size_t)st.st_size == size ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    ProfileHeader *h = map;
+    if (memcmp(h->magic, PROFILE_MAGIC, sizeof(PROFILE_MAGIC)) != 0 || h->version != PROFILE_VERSION ||
+        h->record_size != sizeof(PlayerProfile) || h->capacity != PROFILE_SLOTS) {
+        munmap(map, size);
+        return -1;
+    }
+    profile_map = h;
+    profile_map_size = size;
+    return 0;
+}
+
+/* The player's record, claiming one (the stalest in the probe window if all are taken) when create is set */
+PlayerProfile* profile_find(uint64_t player, int create) {
+    PlayerProfile *rec = (PlayerProfile *)(profile_map + 1), *stalest = NULL;
+    uint32_t home = (uint32_t)((player * 0x9E3779B97F4A7C15ull) >> 32);
+    for (int p = 0; p < PROFILE_PROBES; p++) {
+        PlayerProfile *r = &rec[(home + p) & (PROFILE_SLOTS - 1)];
+        if (r->player == player) return r;
+        if (r->player == 0) { stalest = r; break; }    /* records are never removed, so the key is not further on */
+        if (!stalest || r->updated < stalest->updated) stalest = r;
+    }
+    if (!create) return NULL;
+    memset(stalest, 0, sizeof(*stalest));
+    stalest->player = player;
+    return stalest;
+}
+
+/* Adds a row of counts, halving it once its total passes PROFILE_ROW_LIMIT */
+void profile_add_row(uint16_t *row, const uint16_t *delta) {
+    uint32_t total = 0;
+    for (int k = 0; k < 11; k++) {
+        uint32_t v = (uint32_t)row[k] + delta[k];
+        row[k] = (uint16_t)(v > 65535 ? 65535 : v);
+        total += row[k];
+    }
+    if (total > PROFILE_ROW_LIMIT)
+        for (int k = 0; k < 11; k++) row[k] /= 2;
+}
+
+/* Merges the session's pending balls and matches into its profile record; sessions_mutex held */
+void profile_merge_locked(GameSession *s) {
+    if (!profile_map || !s->player || (!s->profile_pending && !s->profile_matches)) return;
+    PlayerProfile *r = profile_find(s->player, 1);
+    for (int role = 0; role < 2; role++) profile_add_row(r->counts.picks[role], s->profile_delta.picks[role]);
+    for (int k = 0; k < 11; k++) profile_add_row(r->counts.transitions[k], s->profile_delta.transitions[k]);
+    r->balls += (uint32_t)s->profile_pending;
+    r->matches += (uint32_t)s->profile_matches;
+    r->updated = time(NULL);
+    s->profile = r->counts;     /* also picks up other sessions of the same player */
+    memset(&s->profile_delta, 0, sizeof(s->profile_delta));
+    s->profile_pending = 0;
+    s->profile_matches = 0;
+    metric_add(&metrics_local()->profile_merges, 1);
+}
+
+/* Points a session at a player's profile, merging what it holds for a previous one */
+void profile_attach(GameSession *s, uint64_t player) {
+    sessions_lock();
+    if (s->player != player) {
+        profile_merge_locked(s);
+        PlayerProfile *r = profile_find(player, 0);
+        s->player = player;
+        if (r) s->profile = r->counts;
+        else memset(&s->profile, 0, sizeof(s->profile));
+        memset(&s->profile_delta, 0, sizeof(s->profile_delta));
+        s->profile_pending = 0;
+        s->profile_matches = 0;
+    }
+    sessions_unlock();
+}
+
+extern __thread int owner_self;
+
+/* Counts a ball the player just played in phase 3; prev is their previous pick this innings or -1, finished marks the ball that ended the match */
+void profile_ball(GameSession *s, int batting, int prev, int num, int finished) {
+    int role = batting ? 0 : 1;
+    uint16_t one[11] = {0};
+    if (!profile_map || !s->player) return;
+    one[num] = 1;
+    profile_add_row(s->profile.picks[role], one);
+    s->profile_delta.picks[role][num]++;
+    if (prev >= 0) {
+        profile_add_row(s->profile.transitions[prev], one);
+        s->profile_delta.transitions[prev][num]++;
+    }
+    s->profile_pending++;
+    s->profile_matches += finished;
+    /* An owner leaves the merge to profile_merge_range between its jobs */
+    if (owner_self < 0 && (s->profile_pending >= PROFILE_BATCH || finished)) {
+        sessions_lock();
+        profile_merge_locked(s);
+        sessions_unlock();
+    }
+}
+
+/* Merges the sessions in [lo, hi) with at least min_pending balls or a finished match, taking the lock only if one is due */
+void profile_merge_range(int lo, int hi, int min_pending) {
+    int due = 0;
+    if (!profile_map) return;
+    for (int i = lo; i < hi && !due; i++) due = sessions[i].player && (sessions[i].profile_pending >= min_pending || sessions[i].profile_matches);
+    if (!due) return;
+    sessions_lock();
+    for (int i = lo; i < hi; i++)
+        if (sessions[i].profile_pending >= min_pending || sessions[i].profile_matches) profile_merge_locked(&sessions[i]);
+    sessions_unlock();
+}
+
+/* Everything pending in [lo, hi), for owners_each on the way out */
+void profile_flush_range(int lo, int hi, void *arg) {
+    (void)arg;
+    profile_merge_range(lo, hi, 1);
+}
+
+/* The player's likeliest next pick: this innings so far, their habits in this role, and what usually follows their last pick */
+int profile_predict(const GameSession *s) {
+    uint32_t freq[11] = {0}, picks = 0, trans = 0, best = 0;
+    const uint16_t *row = s->profile.picks[s->is_batting ? 0 : 1];
+    const uint16_t *next = s->move_count ? s->profile.transitions[s->prev_moves[s->move_count - 1]] : NULL;
+    int pred = rand() % 11;
+    for (int i = 0; i < s->move_count; i++) freq[s->prev_moves[i]]++;
+    for (int k = 0; k < 11; k++) { picks += row[k]; trans += next ? next[k] : 0; }
+    for (int k = 0; k < 11; k++) {
+        uint32_t score = (s->move_count ? freq[k] * 1024 / (uint32_t)s->move_count : 0) +
+                         (picks ? row[k] * 1024u / picks : 0) + (trans ? next[k] * 2048u / trans : 0);
+        if (score > best) { best = score; pred = k; }
+    }
+    return pred;
+}
+
+/* The long-lived player id from the cookie, 0 if none or malformed */
+int get_header(const char *req, const char *name, char *out, size_t cap);
+
+/* The player cookie from the Cookie header only; "xplayer=" or a ?player= in the URL is not it */
+uint64_t get_player_cookie(const char *req) {
+    char cookies[2048], *end;
+    if (!get_header(req, "Cookie", cookies, sizeof(cookies))) return 0;
+    for (char *p = cookies; (p = strstr(p, "player=")); p += 7) {
+        if (p != cookies && p[-1] != ' ' && p[-1] != ';') continue;
+        uint64_t id = strtoull(p + 7, &end, 16);
+        return end == p + 23 ? id : 0;
+    }
+    return 0;
+}
+
+uint64_t new_player_id(void) {
+    uint64_t id = 0;
+    if (getrandom(&id, sizeof(id), 0) != (ssize_t)sizeof(id) || !id)
+        id = now_ns() ^ ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+    return id ? id : 1;
+}
+
+/* Adds the player cookie to a finished response, after its status line */
+void add_player_cookie(Buf *resp, uint64_t player) {
+    char line[96];
+    char *eol = strstr(resp->data, "\r\n");
+    if (!eol) return;
+    int n = snprintf(line, sizeof(line), "\r\nSet-Cookie: player=%016llx; Path=/; Max-Age=%d",
+                     (unsigned long long)player, PROFILE_COOKIE_AGE);
+    size_t at = (size_t)(eol - resp->data);
+    buf_grow(resp, resp->len + (size_t)n + 1);
+    memmove(resp->data + at + n, resp->data + at, resp->len - at + 1);
+    memcpy(resp->data + at, line, (size_t)n);
+    resp->len += (size_t)n;
+}
+
+void generate_session_id(char *sid) {
+    sprintf(sid, "%ld%d", time(NULL), rand() % 10000);
+}
+
+/* ==================== SESSION OWNERS ==================== */
+/*
+ * With --cores N the session table is split into N ranges, one per owner
+ * thread pinned to its own core, and a session belongs to the owner chosen
+ * by a hash of its id (new ids are drawn until they hash to the creating
+ * owner). Connection threads still parse HTTP, but everything that reads
+ * or changes a session runs on its owner: the caller pushes a job onto the
+ * owner's lock-free inbox and waits for it on a futex. Only an owner
+ * claims, expires or spills slots in its range, so a lookup that hits is
+ * a scan of its own slots with no lock; sessions_mutex is taken only for a
+ * miss (fault-in from the spill slab, adopting a session restored into
+ * another range) and for creation, to stay exclusive with snapshots, the
+ * slab and live upgrades. While a live upgrade's old process drains, both
+ * processes share the table, so each runs every job under sessions_mutex
+ * and the old one skips its housekeeping until it exits. Readers of the whole table (snapshots, /metrics,
+ * spectators, the final profile merge) visit each range on its owner with
+ * owners_each, so they never copy a session its owner is changing. A
+ * ball on an owner takes no shared lock either: its match log records and
+ * leaderboard results collect in owner-private buffers that housekeeping
+ * hands over, and spectator events go through the SSE queue.
+ * Requests without a session go to the owner of the core they arrived
+ * on. The inbox is a Vyukov intrusive MPSC queue: connection threads come
+ * and go, so one SPSC ring per producer and owner is not an option, and a
+ * push is still a single atomic exchange.
+ */
+#define OWNER_MAX 64
+#define OWNER_MIN_SLOTS 4           /* --cores is capped at MAX_SESSIONS / OWNER_MIN_SLOTS */
+#define OWNER_SCAN_SECS 10          /* idle spill scan of the owner's own range */
+#define OWNER_MERGE_SECS 1          /* due profile merges of the owner's own range */
+#define OWNER_SPIN 50               /* yields while waiting for a job before sleeping on it */
+#define OWNER_PUSH_NS (MATCHLOG_FLUSH_MS * 1000000ull)     /* private buffers handed over at least this often */
+
+typedef struct OwnerJob {
+    struct OwnerJob *next;
+    void (*fn)(void *arg);
+    void *arg;
+    uint32_t done;                  /* 0 pending, 1 done, 2 caller asleep */
+} OwnerJob;
+
+typedef struct {
+    OwnerJob *head;                 /* last job pushed; producers swap it */
+    char pad[64 - sizeof(OwnerJob *)];
+    OwnerJob *tail;                 /* owner only */
+    OwnerJob stub;
+    uint32_t sleeping;              /* futex word: 1 while the owner waits for work */
+    int lo, hi;                     /* table range */
+    int cpu;
+} __attribute__((aligned(64))) SessionOwner;
+
+SessionOwner session_owners[OWNER_MAX];
+int owner_count = 0;                /* 0: no owners, any thread uses the whole table under the lock */
+__thread int owner_self = -1;
+
+void spill_idle_sessions(int lo, int hi);
+int upgrade_handover(void);
+extern volatile int server_draining;
+
+long futex(uint32_t *addr, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+int session_owner_of(const char *sid) {
+    return (int)(((matchlog_key(sid) * 0x9E3779B97F4A7C15ull) >> 32) % (uint64_t)owner_count);
+}
+
+/* The slots the calling thread may claim and expire */
+void session_range(int *lo, int *hi) {
+    if (owner_self >= 0) { *lo = session_owners[owner_self].lo; *hi = session_owners[owner_self].hi; }
+    else { *lo = 0; *hi = MAX_SESSIONS; }
+}
+
+void owner_push(SessionOwner *o, OwnerJob *job) {
+    job->next = NULL;
+    OwnerJob *prev = __atomic_exchange_n(&o->head, job, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, job, __ATOMIC_RELEASE);
+}
+
+/* Next job, or NULL if empty or a producer is between its exchange and its link */
+OwnerJob* owner_pop(SessionOwner *o) {
+    OwnerJob *tail = o->tail, *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &o->stub) {
+        if (!next) return NULL;
+        o->tail = tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) { o->tail = next; return tail; }
+    if (tail != __atomic_load_n(&o->head, __ATOMIC_ACQUIRE)) return NULL;
+    owner_push(o, &o->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) { o->tail = next; return tail; }
+    return NULL;
+}
+
+/* Hands the calling owner's private match log and leaderboard buffers over */
+void owner_push_buffers(void) {
+    matchlog_push_owned();
+    leaderboard_push_owned();
+}
+
+void owner_push_range(int lo, int hi, void *arg) {
+    (void)lo; (void)hi; (void)arg;
+    owner_push_buffers();
+}
+
+void *owner_thread(void *arg) {
+    SessionOwner *o = arg;
+    struct timespec tick = { 1, 0 };
+    time_t last_scan = time(NULL), last_merge = last_scan;
+    uint64_t last_push = now_ns();
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(o->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);   /* best effort: a cpuset may forbid it */
+    owner_self = (int)(o - session_owners);
+    /* Without them (no --match-log, or out of memory) this owner uses the shared paths */
+    if (match_log_fd >= 0) match_log_owned = calloc(MATCHLOG_OWNED, sizeof(MatchLogRecord));
+    leader_owned = calloc(1, sizeof(Leaderboard));
+    while (1) {
+        OwnerJob *job = owner_pop(o);
+        int locked = upgrade_handover();
+        time_t now;
+        if (locked) sessions_lock();
+        if (job) {
+            job->fn(job->arg);
+            if (__atomic_exchange_n(&job->done, 1, __ATOMIC_ACQ_REL) == 2) futex(&job->done, FUTEX_WAKE_PRIVATE, 1, NULL);
+        }
+        /* Housekeeping runs between jobs too, so a busy owner still gets to it */
+        if (!job || now_ns() - last_push >= OWNER_PUSH_NS) {
+            owner_push_buffers();
+            last_push = now_ns();
+        }
+        now = time(NULL);
+        if (now - last_merge >= OWNER_MERGE_SECS && !server_draining) {
+            profile_merge_range(o->lo, o->hi, PROFILE_BATCH);
+            last_merge = now;
+        }
+        if (now - last_scan >= OWNER_SCAN_SECS && !server_draining) {
+            spill_idle_sessions(o->lo, o->hi);
+            last_scan = time(NULL);
+        }
+        if (locked) sessions_unlock();
+        if (job) continue;
+        /* Announce the sleep, then look again so a push racing with it is not missed */
+        __atomic_store_n(&o->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&o->head, __ATOMIC_SEQ_CST) != o->tail || __atomic_load_n(&o->tail->next, __ATOMIC_SEQ_CST))
+            __atomic_store_n(&o->sleeping, 0, __ATOMIC_RELAXED);
+        else futex(&o->sleeping, FUTEX_WAIT_PRIVATE, 1, &tick);
+        __atomic_store_n(&o->sleeping, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* Runs fn(arg) on the owner and waits for it; runs it in place when there are no owners or this is the owner */
+void owner_run(int owner, void (*fn)(void *), void *arg) {
+    if (!owner_count) {
+        int locked = upgrade_handover();
+        if (locked) sessions_lock();
+        fn(arg);
+        if (locked) sessions_unlock();
+        return;
+    }
+    if (owner == owner_self) { fn(arg); return; }
+    SessionOwner *o = &session_owners[owner];
+    OwnerJob job = { NULL, fn, arg, 0 };
+    metric_add(&metrics_local()->owner_handoffs, 1);
+    owner_push(o, &job);
+    if (__atomic_exchange_n(&o->sleeping, 0, __ATOMIC_SEQ_CST)) futex(&o->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL);
+    for (int i = 0; i < OWNER_SPIN && !__atomic_load_n(&job.done, __ATOMIC_ACQUIRE); i++) sched_yield();
+    uint32_t pending = 0;
+    if (__atomic_compare_exchange_n(&job.done, &pending, 2, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&job.done, __ATOMIC_ACQUIRE) != 1) futex(&job.done, FUTEX_WAIT_PRIVATE, 2, NULL);
+}
+
+typedef struct {
+    void (*fn)(int lo, int hi, void *arg);
+    void *arg;
+    int lo, hi;
+} OwnerRange;
+
+void owner_range_job(void *arg) {
+    OwnerRange *r = arg;
+    r->fn(r->lo, r->hi, r->arg);
+}
+
+/* Runs fn over each owner's range on that owner, or over the whole table in place without owners; not for owner threads */
+void owners_each(void (*fn)(int lo, int hi, void *arg), void *arg) {
+    if (!owner_count) { fn(0, MAX_SESSIONS, arg); return; }
+    for (int k = 0; k < owner_count; k++) {
+        OwnerRange r = { fn, arg, session_owners[k].lo, session_owners[k].hi };
+        owner_run(k, owner_range_job, &r);
+    }
+}
+
+/* The owner for a request: its session's, else the one on the core it arrived on */
+int owner_for(const char *sid) {
+    if (!owner_count) return -1;
+    if (sid) return session_owner_of(sid);
+    int cpu = sched_getcpu();
+    return cpu >= 0 ? cpu % owner_count : 0;
+}
+
+void owners_start(int n) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > OWNER_MAX) n = OWNER_MAX;
+    if (n > MAX_SESSIONS / OWNER_MIN_SLOTS) n = MAX_SESSIONS / OWNER_MIN_SLOTS;
+    for (int k = 0; k < n; k++) {
+        SessionOwner *o = &session_owners[k];
+        o->head = o->tail = &o->stub;
+        o->lo = MAX_SESSIONS * k / n;
+        o->hi = MAX_SESSIONS * (k + 1) / n;
+        o->cpu = (int)(k % (cpus > 0 ? cpus : 1));
+    }
+    owner_count = n;
+    for (int k = 0; k < n; k++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, owner_thread, &session_owners[k]);
+        pthread_detach(tid);
+    }
+}
+
+/* With --spill, idle sessions move to disk and back (see SESSION SPILL); both run under sessions_mutex */
+int spill_evict_lru(time_t now);
+int spill_fault_in(const char *sid, time_t now);
+int spill_holds(const char *sid);
+extern uint64_t spill_count;
+
+/* A free or expired slot in the caller's range, else one freed by spilling the least recently used session */
+int session_free_slot(time_t now) {
+    int lo, hi;
+    session_range(&lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        if (sessions[i].session_id[0] == '\0') return i;
+        if ((now - sessions[i].last_activity) > SESSION_TTL) { profile_merge_locked(&sessions[i]); return i; }
+    }
+    return spill_evict_lru(now);
+}
+
+GameSession* find_session(const char *sid) {
+    GameSession *s = NULL;
+    time_t now = time(NULL);
+    int lo, hi;
+    session_range(&lo, &hi);
+    /* An owner is the only thread that claims or frees slots in its range: a hit needs no lock */
+    if (owner_self >= 0) {
+        for (int i = lo; i < hi; i++) {
+            if (strcmp(sessions[i].session_id, sid) == 0) { sessions[i].last_activity = now; return &sessions[i]; }
+        }
+    }
+    sessions_lock();
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (strcmp(sessions[i].session_id, sid) == 0) { s = &sessions[i]; break; }
+    }
+    /* Restored by a snapshot or a previous process into another range: move it home if there is room */
+    if (s && owner_self >= 0 && (s < &sessions[lo] || s >= &sessions[hi])) {
+        int i = session_free_slot(now);
+        if (i >= 0) {
+            sessions[i] = *s;
+            memset(s, 0, sizeof(GameSession));
+            s = &sessions[i];
+        }
+    }
+    if (!s) {
+        int i = spill_fault_in(sid, now);
+        if (i >= 0) s = &sessions[i];
+    }
+    if (s) s->last_activity = now;
+    sessions_unlock();
+    return s;
+}
+
+GameSession* create_session(void) {
+    sessions_lock();
+    time_t now = time(NULL);
+    int i = session_free_slot(now);
+    if (i >= 0) {
+        memset(&sessions[i], 0, sizeof(GameSession));
+        do generate_session_id(sessions[i].session_id);
+        while (spill_holds(sessions[i].session_id) || (owner_self >= 0 && session_owner_of(sessions[i].session_id) != owner_self));
+        sessions[i].difficulty = 1;
+        sessions[i].last_player_input = -1;
+        sessions[i].last_computer_move = -1;
+        sessions[i].last_activity = now;
+        strcpy(sessions[i].message, "Welcome! Click 'New Game' to start playing!");
+    }
+    sessions_unlock();
+    return i >= 0 ? &sessions[i] : NULL;
+}
+
+int generate_computer_move(GameSession *s) {
+    int move, freq[11] = {0};
+    switch (s->difficulty) {
+        case 1: move = rand() % 11; break;
+        case 2:
+            if (rand() % 100 < 30 && s->move_count > 0)
+                move = s->prev_moves[s->move_count - 1];
+            else move = rand() % 11;
+            break;
+        case DIFFICULTY_OPTIMAL:
+            /* A session restored without the table loaded plays hard */
+            if (strategy_table) { move = strategy_move(s); break; }
+            /* fall through */
+        case 3:
+            /* With a profile: take the predicted pick when bowling, avoid it when batting */
+            if (s->player && profile_map) {
+                move = profile_predict(s);
+                if (!s->is_batting) move = (move + 1 + rand() % 10) % 11;
+                break;
+            }
+            if (s->move_count == 0) { move = rand() % 11; }
+            else {
+                int max_f = 0, pred = rand() % 11;
+                for (int i = 0; i < s->move_count; i++) freq[s->prev_moves[i]]++;
+                for (int i = 0; i < 11; i++) if (freq[i] > max_f) { max_f = freq[i]; pred = i; }
+                move = pred;
+            }
+            break;
+        default: move = rand() % 11;
+    }
+    return move;
+}
+
+void reset_game(GameSession *s) {
+    s->player_score = 0;
+    s->computer_score = 0;
+    s->game_phase = 1;
+    s->is_batting = 0;
+    s->second_innings = 0;
+    s->first_innings_score = 0;
+    s->move_count = 0;
+    s->same_choice_count = 0;
+    s->last_player_input = -1;
+    s->last_computer_move = -1;
+    s->is_out = 0;
+    strcpy(s->message, "Choose HEAD or TAILS for the toss!");
+}
+
+char* get_session_cookie(const char *req) {
+    static __thread char sid[64];
+    char *p = strstr(req, "session=");
+    if (p) {
+        p += 8;
+        int i = 0;
+        while (p[i] && p[i] != ';' && p[i] != ' ' && p[i] != '\r' && i < 63) {
+            sid[i] = p[i]; i++;
+        }
+        sid[i] = '\0';
+        return sid;
+    }
+    return NULL;
+}
+
+void build_html_head(Buf *b) {
+    static const char open[] =
+        "<!DOCTYPE html><html lang=\"en\"><head>"
+        "<meta charset=\"UTF-8\">"
+        "<meta name=\"viewport\" content=\"width=device-width,initial-scale=1\">"
+        "<title>Hand Cricket Game</title>";
+    buf_append(b, open, sizeof(open) - 1);
+    buf_append(b, CSS_STYLES, strlen(CSS_STYLES));
+    buf_append(b, "</head><body>", 13);
+}
+
+void build_page_menu(Buf *resp, GameSession *s) {
+    const char *diff_names[] = {"", "Easy", "Medium", "Hard", "Optimal"};
+    
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        s->session_id);
+    build_html_head(resp);
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Hand Cricket Game</h1><p>Odd or Even Cricket</p></div>"
+        "<div class=\"message-box\">%s</div>"
+        "<div class=\"panel\"><div class=\"panel-title\">Main Menu</div>"
+        "<div class=\"btn-grid-2\">"
+        "<a href=\"/start\" class=\"btn btn-success\">New Game</a>"
+        "<a href=\"/help\" class=\"btn btn-info\">How to Play</a>"
+        "<a href=\"/pvp\" class=\"btn btn-warning\">Play a Person</a>"
+        "<a href=\"/leaderboard\" class=\"btn btn-primary\">Leaderboard</a>"
+        "</div></div>"
+        "<div class=\"panel\"><div class=\"panel-title\">Difficulty: %s</div>"
+        "<div class=\"%s\">"
+        "<a href=\"/diff/1\" class=\"btn btn-number %s\">Easy</a>"
+        "<a href=\"/diff/2\" class=\"btn btn-number %s\">Medium</a>"
+        "<a href=\"/diff/3\" class=\"btn btn-number %s\">Hard</a>"
+        "%s%s%s"
+        "</div></div>"
+        "<div class=\"footer\">Made with C | Hand Cricket v2.0 | <a href=\"/leaderboard\">Leaderboard</a></div>"
+        "</div></body></html>",
+        s->message, diff_names[s->difficulty], strategy_table ? "btn-grid" : "btn-grid-3",
+        s->difficulty == 1 ? "difficulty-active" : "",
+        s->difficulty == 2 ? "difficulty-active" : "",
+        s->difficulty == 3 ? "difficulty-active" : "",
+        strategy_table ? "<a href=\"/diff/4\" class=\"btn btn-number " : "",
+        strategy_table && s->difficulty == DIFFICULTY_OPTIMAL ? "difficulty-active" : "",
+        strategy_table ? "\">Optimal</a>" : "");
+
+}
+
+void build_page_help(Buf *resp, GameSession *s) {
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        s->session_id);
+    build_html_head(resp);
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>How to Play</h1></div>"
+        "<div class=\"panel\">"
+        "<p><b>1. TOSS:</b> Pick HEAD or TAILS. Winner chooses role.</p><br>"
+        "<p><b>2. GAMEPLAY:</b> Pick a number 0-10. Computer picks too.</p><br>"
+        "<p><b>3. OUT:</b> If both pick the same number, batsman is OUT!</p><br>"
+        "<p><b>4. SCORING:</b> Batting? Your number = runs. Bowling? Computer's number = their runs.</p><br>"
+        "<p><b>5. SPECIAL:</b> Pick 0 to steal computer's number as your runs!</p><br>"
+        "<p><b>6. TWO INNINGS:</b> After out, roles swap. Chase or defend!</p>"
+        "</div>"
+        "<div class=\"btn-grid-2\"><a href=\"/\" class=\"btn btn-primary\">Back to Menu</a>"
+        "<a href=\"/start\" class=\"btn btn-success\">Start Game</a></div>"
+        "<div class=\"footer\">Made with C</div>"
+        "</div></body></html>");
+
+}
+
+void build_page_toss(Buf *resp, GameSession *s) {
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        s->session_id);
+    build_html_head(resp);
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Toss Time!</h1></div>"
+        "<div class=\"message-box\">%s</div>"
+        "<div class=\"panel\"><div class=\"panel-title\">Make Your Call</div>"
+        "<div class=\"btn-grid-2\">"
+        "<a href=\"/toss/head\" class=\"btn btn-primary\" style=\"padding:25px;font-size:18px;\">HEAD</a>"
+        "<a href=\"/toss/tail\" class=\"btn btn-warning\" style=\"padding:25px;font-size:18px;\">TAILS</a>"
+        "</div></div>"
+        "<a href=\"/\" class=\"btn btn-danger\" style=\"width:100%%;\">Back to Menu</a>"
+        "<div class=\"footer\">Made with C</div>"
+        "</div></body></html>", s->message);
+
+}
+
+void build_page_choose(Buf *resp, GameSession *s) {
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        s->session_id);
+    build_html_head(resp);
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>You Won the Toss!</h1></div>"
+        "<div class=\"message-box\">%s</div>"
+        "<div class=\"panel\"><div class=\"panel-title\">Choose Your Role</div>"
+        "<div class=\"btn-grid-2\">"
+        "<a href=\"/choose/bat\" class=\"btn btn-success\" style=\"padding:25px;font-size:18px;\">BAT First</a>"
+        "<a href=\"/choose/bowl\" class=\"btn btn-danger\" style=\"padding:25px;font-size:18px;\">BOWL First</a>"
+        "</div></div>"
+        "<div class=\"footer\">Made with C</div>"
+        "</div></body></html>", s->message);
+
+}
+
+/*
+ * Progressive enhancement for the game page: with WebSocket support the
+ * number buttons send one byte over /ws and the page is patched from the
+ * binary reply (see WEBSOCKET below); without it the links work as before.
+ */
+const char *GAME_PAGE_SCRIPT =
+"<script>(function(){"
+"if(!window.WebSocket||!window.TextDecoder||!window.DataView)return;"
+"var ws=new WebSocket((location.protocol=='https:'?'wss://':'ws://')+location.host+'/ws'),open=false;"
+"ws.binaryType='arraybuffer';ws.onopen=function(){open=true;};ws.onclose=function(){open=false;};"
+"function $(i){return document.getElementById(i);}"
+"var links=document.querySelectorAll('a[href^=\"/play/\"]');"
+"for(var i=0;i<links.length;i++)links[i].onclick=function(e){if(!open)return true;e.preventDefault();"
+"ws.send(new Uint8Array([+this.getAttribute('href').substr(6)]));return false;};"
+"ws.onmessage=function(e){var b=new Uint8Array(e.data),v=new DataView(e.data);"
+"if(b[0]!=3){location.href='/game';return;}"
+"var bat=b[1]&1,second=b[1]&4,ps=v.getUint16(5),cs=v.getUint16(7),t=v.getUint16(9),tg=$('target');"
+"$('msg').textContent=new TextDecoder().decode(b.subarray(11));"
+"$('ps').textContent=ps;$('cs').textContent=cs;"
+"$('you').textContent=b[2]==255?'-':b[2];$('comp').textContent=b[3]==255?'-':b[3];"
+"$('status').textContent=second?(bat?'CHASING':'DEFENDING')+' - 2nd Innings':(bat?'BATTING':'BOWLING')+' - 1st Innings';"
+"$('status').className='status-badge '+(bat?'status-batting':'status-bowling');"
+"if(second){tg.style.display='block';tg.textContent='Target: '+t+' | '+(bat?'Need: '+(t-ps)+' more to win':'Computer needs: '+(t-cs)+' more');}"
+"else tg.style.display='none';};"
+"})();</script>";
+
+void build_page_game(Buf *resp, GameSession *s) {
+    char your_choice[8], comp_choice[8];
+    char target_html[256] = "<div class=\"target-info\" id=\"target\" style=\"display:none\"></div>";
+    char innings_text[64];
+    
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        s->session_id);
+    build_html_head(resp);
+    
+    if (s->last_player_input >= 0) sprintf(your_choice, "%d", s->last_player_input);
+    else strcpy(your_choice, "-");
+    if (s->last_computer_move >= 0) sprintf(comp_choice, "%d", s->last_computer_move);
+    else strcpy(comp_choice, "-");
+    
+    if (s->second_innings) {
+        sprintf(innings_text, "%s - 2nd Innings", s->is_batting ? "CHASING" : "DEFENDING");
+        if (s->is_batting) {
+            sprintf(target_html, "<div class=\"target-info\" id=\"target\">Target: %d | Need: %d more to win</div>",
+                s->first_innings_score + 1, (s->first_innings_score + 1) - s->player_score);
+        } else {
+            sprintf(target_html, "<div class=\"target-info\" id=\"target\">Target: %d | Computer needs: %d more</div>",
+                s->first_innings_score + 1, (s->first_innings_score + 1) - s->computer_score);
+        }
+    } else {
+        sprintf(innings_text, "%s - 1st Innings", s->is_batting ? "BATTING" : "BOWLING");
+    }
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Hand Cricket</h1></div>"
+        "<div class=\"message-box\" id=\"msg\">%s</div>"
+        "<div style=\"text-align:center;\">"
+        "<span class=\"status-badge %s\" id=\"status\">%s</span>"
+        "</div>"
+        "%s"
+        "<div class=\"scoreboard\">"
+        "<div class=\"score-card player\"><div class=\"label\">Your Score</div><div class=\"score\" id=\"ps\">%d</div></div>"
+        "<div class=\"score-card computer\"><div class=\"label\">Computer</div><div class=\"score\" id=\"cs\">%d</div></div>"
+        "</div>"
+        "<div class=\"choices\">"
+        "<div class=\"choice-box\"><div class=\"label\">Your Pick</div><div class=\"value\" id=\"you\">%s</div></div>"
+        "<div class=\"choice-box\"><div class=\"label\">Computer</div><div class=\"value\" id=\"comp\">%s</div></div>"
+        "</div>"
+        "<div class=\"panel\"><div class=\"panel-title\">Pick a Number (0-10)</div>"
+        "<div class=\"btn-grid\">"
+        "<a href=\"/play/0\" class=\"btn btn-number\">0</a>"
+        "<a href=\"/play/1\" class=\"btn btn-number\">1</a>"
+        "<a href=\"/play/2\" class=\"btn btn-number\">2</a>"
+        "<a href=\"/play/3\" class=\"btn btn-number\">3</a>"
+        "<a href=\"/play/4\" class=\"btn btn-number\">4</a>"
+        "<a href=\"/play/5\" class=\"btn btn-number\">5</a>"
+        "<a href=\"/play/6\" class=\"btn btn-number\">6</a>"
+        "<a href=\"/play/7\" class=\"btn btn-number\">7</a>"
+        "<a href=\"/play/8\" class=\"btn btn-number\">8</a>"
+        "<a href=\"/play/9\" class=\"btn btn-number\">9</a>"
+        "<a href=\"/play/10\" class=\"btn btn-number btn-wide\">10</a>"
+        "<a href=\"/reset\" class=\"btn btn-danger btn-wide\">Reset Game</a>"
+        "</div></div>"
+        "<div class=\"footer\">Made with C | <a href=\"/watch/%s\" target=\"_blank\">Spectator link</a></div>"
+        "</div>%s</body></html>",
+        s->message,
+        s->is_batting ? "status-batting" : "status-bowling",
+        innings_text, target_html,
+        s->player_score, s->computer_score,
+        your_choice, comp_choice, s->session_id, GAME_PAGE_SCRIPT);
+
+}
+
+void build_page_gameover(Buf *resp, GameSession *s) {
+    char result_class[32], result_icon[16], result_text[32], result_detail[64];
+    
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        s->session_id);
+    build_html_head(resp);
+    
+    if (s->player_score > s->computer_score) {
+        strcpy(result_class, "result-win");
+        strcpy(result_icon, "🎉");
+        strcpy(result_text, "YOU WIN!");
+        sprintf(result_detail, "Won by %d run(s)!", s->player_score - s->computer_score);
+    } else if (s->computer_score > s->player_score) {
+        strcpy(result_class, "result-lose");
+        strcpy(result_icon, "😔");
+        strcpy(result_text, "YOU LOST");
+        sprintf(result_detail, "Lost by %d run(s)", s->computer_score - s->player_score);
+    } else {
+        strcpy(result_class, "result-tie");
+        strcpy(result_icon, "🤝");
+        strcpy(result_text, "IT'S A TIE!");
+        sprintf(result_detail, "Both scored %d runs", s->player_score);
+    }
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Game Over!</h1></div>"
+        "<div class=\"result-banner %s\">"
+        "<div class=\"result-icon\">%s</div>"
+        "<div class=\"result-text\">%s</div>"
+        "<div class=\"result-detail\">%s</div>"
+        "</div>"
+        "<div class=\"scoreboard\">"
+        "<div class=\"score-card player\"><div class=\"label\">Your Score</div><div class=\"score\">%d</div></div>"
+        "<div class=\"score-card computer\"><div class=\"label\">Computer</div><div class=\"score\">%d</div></div>"
+        "</div>"
+        "<div class=\"btn-grid-2\">"
+        "<a href=\"/start\" class=\"btn btn-success\">Play Again</a>"
+        "<a href=\"/\" class=\"btn btn-primary\">Main Menu</a>"
+        "</div>"
+        "<div class=\"footer\">Made with C | <a href=\"/leaderboard\">Leaderboard</a></div>"
+        "</div></body></html>",
+        result_class, result_icon, result_text, result_detail,
+        s->player_score, s->computer_score);
+
+}
+
+/* Read-only scoreboard that follows a session over /events/<session> */
+void build_page_watch(Buf *resp, const char *sid) {
+    buf_printf(resp, "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nConnection: close\r\n\r\n");
+    build_html_head(resp);
+    
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Hand Cricket</h1><p>Spectating match %s</p></div>"
+        "<div class=\"message-box\" id=\"msg\">Connecting...</div>"
+        "<div style=\"text-align:center;\"><span class=\"status-badge\" id=\"status\">-</span></div>"
+        "<div class=\"target-info\" id=\"target\" style=\"display:none\"></div>"
+        "<div class=\"scoreboard\">"
+        "<div class=\"score-card player\"><div class=\"label\">Player</div><div class=\"score\" id=\"ps\">0</div></div>"
+        "<div class=\"score-card computer\"><div class=\"label\">Computer</div><div class=\"score\" id=\"cs\">0</div></div>"
+        "</div>"
+        "<div class=\"choices\">"
+        "<div class=\"choice-box\"><div class=\"label\">Player Pick</div><div class=\"value\" id=\"you\">-</div></div>"
+        "<div class=\"choice-box\"><div class=\"label\">Computer</div><div class=\"value\" id=\"comp\">-</div></div>"
+        "</div>"
+        "<div class=\"footer\">Live via Server-Sent Events</div>"
+        "</div>"
+        "<script>"
+        "function $(i){return document.getElementById(i);}"
+        "function show(e){var d=JSON.parse(e.data);"
+        "$('msg').textContent=d.message;$('ps').textContent=d.player;$('cs').textContent=d.computer;"
+        "$('you').textContent=d.you<0?'-':d.you;$('comp').textContent=d.comp<0?'-':d.comp;"
+        "$('status').textContent=d.phase==4?'Game over':d.phase==3?(d.batting?'Batting':'Bowling')+' - innings '+d.innings:'Waiting for the toss';"
+        "$('status').className='status-badge '+(d.phase==3?(d.batting?'status-batting':'status-bowling'):'');"
+        "$('target').style.display=d.target&&d.phase==3?'block':'none';$('target').textContent='Target: '+d.target;"
+        "if(e.type=='ball'){$('ps').parentNode.parentNode.className='scoreboard pulse';"
+        "setTimeout(function(){$('ps').parentNode.parentNode.className='scoreboard';},300);}}"
+        "var es=new EventSource('/events/%s');"
+        "es.addEventListener('state',show);es.addEventListener('ball',show);"
+        "es.onerror=function(){$('msg').textContent='Reconnecting...';};"
+        "</script></body></html>",
+        sid, sid);
+
+}
+
+/* One best-first table */
+void leaderboard_table(Buf *out, const Leaderboard *b, int kind, int d) {
+    static const char *diff_names[] = {"", "Easy", "Medium", "Hard", "Optimal"};
+    if (b->count[kind][d] == 0) {
+        buf_printf(out, "<div class=\"lb-empty\">No finished matches yet</div>");
+        return;
+    }
+    buf_printf(out, "<table class=\"lb-table\"><tr><th>#</th><th>Player</th><th>%s</th><th>Score</th>%s</tr>",
+        kind == BOARD_HIGH_SCORE ? "Runs" : "Won by", d == 0 ? "<th>Level</th>" : "");
+    for (int i = 0; i < b->count[kind][d]; i++) {
+        const LeaderEntry *e = &b->top[kind][d][i];
+        buf_printf(out, "<tr><td>%d</td><td>Player %s</td><td><b>%d</b></td><td>%d - %d</td>",
+            i + 1, e->player, board_key(kind, e), e->player_score, e->computer_score);
+        if (d == 0) buf_printf(out, "<td>%s</td>", diff_names[e->difficulty]);
+        buf_printf(out, "</tr>");
+    }
+    buf_printf(out, "</table>");
+}
+
+/* d = 0 for all difficulties, 1-4 for one */
+void build_page_leaderboard(Buf *resp, int d) {
+    static const char *diff_names[] = {"All levels", "Easy", "Medium", "Hard", "Optimal"};
+    Leaderboard b;
+    
+    leaderboard_read(&b);
+    buf_printf(resp, "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nConnection: close\r\n\r\n");
+    build_html_head(resp);
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Leaderboard</h1><p>%s | %llu matches | %llu won | %llu lost | %llu tied</p></div>"
+        "<div class=\"btn-grid-2\" style=\"grid-template-columns:repeat(5,1fr);margin-bottom:15px;\">",
+        diff_names[d], (unsigned long long)b.matches[d], (unsigned long long)b.wins[d],
+        (unsigned long long)b.losses[d], (unsigned long long)b.ties[d]);
+    for (int i = 0; i < DIFFICULTY_LEVELS; i++)
+        buf_printf(resp, "<a href=\"/leaderboard%s%.0d\" class=\"btn btn-number %s\">%s</a>",
+            i ? "/" : "", i, i == d ? "difficulty-active" : "", i ? diff_names[i] : "All");
+    buf_printf(resp, "</div><div class=\"panel\"><div class=\"panel-title\">Highest Scores</div>");
+    leaderboard_table(resp, &b, BOARD_HIGH_SCORE, d);
+    buf_printf(resp, "</div><div class=\"panel\"><div class=\"panel-title\">Biggest Wins</div>");
+    leaderboard_table(resp, &b, BOARD_BIGGEST_WIN, d);
+    buf_printf(resp,
+        "</div><div class=\"btn-grid-2\">"
+        "<a href=\"/start\" class=\"btn btn-success\">New Game</a>"
+        "<a href=\"/\" class=\"btn btn-primary\">Main Menu</a>"
+        "</div>"
+        "<div class=\"footer\">Updated every %d second(s)</div>"
+        "</div></body></html>", LEADERBOARD_MERGE_MS / 1000);
+}
+
+void build_page_leaderboard_json(Buf *resp) {
+    static const char *kind_names[] = {"high_score", "biggest_win"};
+    static const char *diff_labels[] = {"all", "easy", "medium", "hard", "optimal"};
+    Leaderboard b;
+    
+    leaderboard_read(&b);
+    buf_printf(resp, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n{");
+    for (int d = 0; d < DIFFICULTY_LEVELS; d++) {
+        buf_printf(resp, "%s\"%s\":{\"matches\":%llu,\"wins\":%llu,\"losses\":%llu,\"ties\":%llu",
+            d ? "," : "", diff_labels[d], (unsigned long long)b.matches[d], (unsigned long long)b.wins[d],
+            (unsigned long long)b.losses[d], (unsigned long long)b.ties[d]);
+        for (int k = 0; k < BOARD_KINDS; k++) {
+            buf_printf(resp, ",\"%s\":[", kind_names[k]);
+            for (int i = 0; i < b.count[k][d]; i++) {
+                const LeaderEntry *e = &b.top[k][d][i];
+                buf_printf(resp,
+                    "%s{\"player\":\"%s\",\"player_score\":%d,\"computer_score\":%d,\"difficulty\":%d,\"finished_at\":%lld}",
+                    i ? "," : "", e->player, e->player_score, e->computer_score, e->difficulty, (long long)e->finished_at);
+            }
+            buf_printf(resp, "]");
+        }
+        buf_printf(resp, "}");
+    }
+    buf_printf(resp, "}\n");
+}
+
+void handle_toss(GameSession *s, const char *choice) {
+    int player_head = (strcmp(choice, "head") == 0);
+    int coin = rand() % 2;
+    int won = (player_head && coin == 0) || (!player_head && coin == 1);
+    
+    if (won) {
+        s->game_phase = 2;
+        sprintf(s->message, "Coin: %s | You called: %s | YOU WON! Choose to Bat or Bowl.",
+            coin == 0 ? "HEAD" : "TAILS", player_head ? "HEAD" : "TAILS");
+    } else {
+        int comp_bats = rand() % 2;
+        /* The optimal computer takes whichever role the solver says is worth more */
+        if (s->difficulty == DIFFICULTY_OPTIMAL && strategy_table)
+            comp_bats = strategy_table->value_computer_bats_first >= strategy_table->value_human_bats_first;
+        s->is_batting = !comp_bats;
+        s->game_phase = 3;
+        sprintf(s->message, "Coin: %s | You called: %s | Computer won! You are %s.",
+            coin == 0 ? "HEAD" : "TAILS", player_head ? "HEAD" : "TAILS",
+            s->is_batting ? "BATTING" : "BOWLING");
+    }
+}
+
+void handle_choose(GameSession *s, const char *choice) {
+    s->is_batting = (strcmp(choice, "bat") == 0);
+    s->game_phase = 3;
+    sprintf(s->message, "You chose to %s first. Pick a number!", s->is_batting ? "BAT" : "BOWL");
+}
+
+/*
+ * The rules of one ball, shared by games against the computer and PvP.
+ * bat_repeats is how many times in a row the batsman has picked this
+ * number; zero_steals lets a batsman's 0 score the bowler's number.
+ */
+#define REPEAT_OUT_LIMIT 5
+int resolve_ball(int bat, int bowl, int bat_repeats, int zero_steals, int *runs) {
+    *runs = 0;
+    if (bat_repeats >= REPEAT_OUT_LIMIT) return MATCHLOG_OUT | MATCHLOG_REPEAT_OUT;
+    if (bat == bowl) return MATCHLOG_OUT;
+    *runs = (bat == 0 && zero_steals) ? bowl : bat;
+    return 0;
+}
+
+/* Plays one ball; returns the MATCHLOG_OUT / MATCHLOG_REPEAT_OUT flags for it */
+int handle_play(GameSession *s, int num) {
+    /* Only a ball in play is played and logged: clicks before the toss or after game over change nothing */
+    if (s->game_phase != 3) return 0;
+    uint64_t t0 = now_ns();
+    int comp = generate_computer_move(s);
+    int d = (s->difficulty >= 1 && s->difficulty <= DIFFICULTY_OPTIMAL) ? s->difficulty : 0;
+    MetricShard *m = metrics_local();
+    metric_add(&m->ai_move_ns[d], now_ns() - t0);
+    metric_add(&m->ai_moves[d], 1);
+    int prev = s->move_count > 0 ? s->prev_moves[s->move_count - 1] : -1;
+    s->last_player_input = num;
+    s->last_computer_move = comp;
+    
+    if (s->move_count > 0 && num == s->prev_moves[s->move_count - 1])
+        s->same_choice_count++;
+    else
+        s->same_choice_count = 1;
+    
+    if (s->move_count < 100) s->prev_moves[s->move_count++] = num;
+    
+    int innings = s->second_innings + 1, batting = s->is_batting, runs;
+    int log_flags = s->is_batting ? resolve_ball(num, comp, s->same_choice_count, 1, &runs)
+                                  : resolve_ball(comp, num, 0, 0, &runs);
+    s->is_out = (log_flags & MATCHLOG_OUT) != 0;
+    if (log_flags & MATCHLOG_REPEAT_OUT) {
+        sprintf(s->message, "Same number 5 times! YOU'RE OUT!");
+    } else if (s->is_out) {
+        sprintf(s->message, "OUT! Both picked %d! %s out!", num, s->is_batting ? "You're" : "Computer is");
+    } else {
+        if (s->is_batting) {
+            s->player_score += runs;
+            sprintf(s->message, "You: %d | Computer: %d | +%d runs!", num, comp, runs);
+            if (s->second_innings && s->player_score > s->first_innings_score) {
+                s->game_phase = 4;
+                strcpy(s->message, "You chased the target! YOU WIN!");
+            }
+        } else {
+            s->computer_score += runs;
+            sprintf(s->message, "You: %d | Computer: %d | Computer +%d", num, comp, comp);
+            if (s->second_innings && s->computer_score > s->first_innings_score) {
+                s->game_phase = 4;
+                strcpy(s->message, "Computer chased the target! You lost.");
+            }
+        }
+    }
+    
+    if (s->is_out && s->game_phase != 4) {
+        if (!s->second_innings) {
+            s->second_innings = 1;
+            s->first_innings_score = s->is_batting ? s->player_score : s->computer_score;
+            s->is_batting = !s->is_batting;
+            s->is_out = 0;
+            s->same_choice_count = 0;
+            s->move_count = 0;
+            sprintf(s->message, "Innings over! %s Target: %d",
+                s->is_batting ? "Now BATTING!" : "Now BOWLING!",
+                s->first_innings_score + 1);
+        } else {
+            s->game_phase = 4;
+        }
+    }
+    
+    int finished = s->game_phase == 4;      /* this ball ended the match: it started in play */
+    matchlog_ball(s, innings, batting, num, comp, runs, log_flags);
+    profile_ball(s, batting, prev, num, finished);
+    if (finished) leaderboard_record(s);
+    sse_publish(s, "ball", runs, log_flags & MATCHLOG_OUT);
+    return log_flags;
+}
+
+/* ==================== PLAYER VS PLAYER ==================== */
+/*
+ * Two sessions are paired through a single lock-free waiting slot: a
+ * joiner either CASes a waiting match out of the slot and takes its second
+ * seat, or CASes its own new match in and waits. Each match has its own
+ * mutex, held only while recording a pick or resolving a ball, so PvP
+ * never takes sessions_mutex and matches never wait on each other. Pages
+ * poll with a Refresh header while waiting for the other player.
+ */
+#define MAX_PVP_MATCHES 4096
+#define PVP_TIMEOUT 120         /* seconds without a pick before the other side wins */
+#define PVP_ABANDONED 3600      /* finished or dead matches can be reused after this */
+
+enum { PVP_FREE, PVP_WAITING, PVP_PLAYING, PVP_OVER };
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t gen;               /* bumped each time the slot is handed out */
+    int state;
+    char sid[2][64];            /* side 0 bats first */
+    int score[2];
+    int batting;                /* side currently batting */
+    int second_innings;
+    int first_innings_score;
+    int pick[2];                /* this ball's picks, -1 until made */
+    int last_pick[2];           /* previous ball */
+    int last_runs, last_flags, last_batting;
+    int repeats[2], prev_num[2];
+    int left;                   /* side that left or timed out, -1 if none */
+    time_t seen[2];
+    time_t last_activity;
+} PvpMatch;
+
+PvpMatch pvp_matches[MAX_PVP_MATCHES];
+int pvp_waiting = -1;           /* index of the match waiting for a second player */
+unsigned int pvp_alloc_hint = 0;
+
+void pvp_init(void) {
+    for (int i = 0; i < MAX_PVP_MATCHES; i++) pthread_mutex_init(&pvp_matches[i].lock, NULL);
+}
+
+/* The session's match, locked, or NULL if it has none (or the slot was reused) */
+PvpMatch* pvp_lock_match(GameSession *s) {
+    if (s->pvp_match < 1 || s->pvp_match > MAX_PVP_MATCHES) return NULL;
+    PvpMatch *m = &pvp_matches[s->pvp_match - 1];
+    pthread_mutex_lock(&m->lock);
+    if (m->gen != s->pvp_gen || m->state == PVP_FREE || strcmp(m->sid[s->pvp_side], s->session_id) != 0) {
+        pthread_mutex_unlock(&m->lock);
+        s->pvp_match = 0;
+        return NULL;
+    }
+    return m;
+}
+
+/* Claims a free (or long abandoned) slot, returned locked */
+int pvp_alloc(void) {
+    time_t now = time(NULL);
+    unsigned int start = __atomic_fetch_add(&pvp_alloc_hint, 1, __ATOMIC_RELAXED);
+    for (unsigned int t = 0; t < MAX_PVP_MATCHES; t++) {
+        int i = (int)((start + t) % MAX_PVP_MATCHES);
+        PvpMatch *m = &pvp_matches[i];
+        if (pthread_mutex_trylock(&m->lock) != 0) continue;
+        if (m->state == PVP_FREE || (m->state != PVP_WAITING && now - m->last_activity > PVP_ABANDONED)) {
+            int gen = m->gen + 1;
+            memset((char*)m + sizeof(m->lock), 0, sizeof(*m) - sizeof(m->lock));
+            m->gen = gen;
+            m->left = -1;
+            m->pick[0] = m->pick[1] = m->last_pick[0] = m->last_pick[1] = -1;
+            m->prev_num[0] = m->prev_num[1] = -1;
+            m->last_activity = now;
+            return i;
+        }
+        pthread_mutex_unlock(&m->lock);
+    }
+    return -1;
+}
+
+void pvp_seat(GameSession *s, int idx, int side) {
+    PvpMatch *m = &pvp_matches[idx];
+    strcpy(m->sid[side], s->session_id);
+    m->seen[side] = time(NULL);
+    s->pvp_match = idx + 1;
+    s->pvp_gen = m->gen;
+    s->pvp_side = side;
+}
+
+/* Leaves the current match: cancels a wait, or forfeits a game in progress */
+void pvp_leave(GameSession *s) {
+    PvpMatch *m = pvp_lock_match(s);
+    if (!m) return;
+    if (m->state == PVP_WAITING) {
+        int idx = (int)(m - pvp_matches);
+        __atomic_compare_exchange_n(&pvp_waiting, &idx, -1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        m->state = PVP_FREE;
+    } else if (m->state == PVP_PLAYING) {
+        m->state = PVP_OVER;
+        m->left = s->pvp_side;
+    }
+    pthread_mutex_unlock(&m->lock);
+    s->pvp_match = 0;
+}
+
+/* Pairs the session with a waiting player, or starts waiting; 0 if the match table is full */
+int pvp_join(GameSession *s) {
+    int mine = -1;
+    pvp_leave(s);
+    while (1) {
+        int w = __atomic_load_n(&pvp_waiting, __ATOMIC_ACQUIRE);
+        if (w >= 0) {
+            if (!__atomic_compare_exchange_n(&pvp_waiting, &w, -1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) continue;
+            PvpMatch *m = &pvp_matches[w];
+            pthread_mutex_lock(&m->lock);
+            if (m->state == PVP_WAITING && strcmp(m->sid[0], s->session_id) != 0) {
+                pvp_seat(s, w, 1);
+                m->state = PVP_PLAYING;
+                m->last_activity = time(NULL);
+                m->seen[0] = m->last_activity;    /* the clock starts now for both */
+                pthread_mutex_unlock(&m->lock);
+                metric_add(&metrics_local()->pvp_matches, 1);
+                if (mine >= 0) {
+                    pthread_mutex_lock(&pvp_matches[mine].lock);
+                    pvp_matches[mine].state = PVP_FREE;
+                    pthread_mutex_unlock(&pvp_matches[mine].lock);
+                }
+                return 1;
+            }
+            pthread_mutex_unlock(&m->lock);   /* cancelled meanwhile: look again */
+            continue;
+        }
+        if (mine < 0) {
+            if ((mine = pvp_alloc()) < 0) return 0;
+            pvp_matches[mine].state = PVP_WAITING;
+            pvp_seat(s, mine, 0);
+            pthread_mutex_unlock(&pvp_matches[mine].lock);
+        }
+        int none = -1;
+        if (__atomic_compare_exchange_n(&pvp_waiting, &none, mine, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return 1;
+    }
+}
+
+/* Both picks are in: the same rules as handle_play, for two humans. Caller holds m->lock */
+void pvp_resolve(PvpMatch *m) {
+    int bat = m->batting, bowl = !bat, runs;
+    for (int side = 0; side < 2; side++) {
+        m->repeats[side] = m->pick[side] == m->prev_num[side] ? m->repeats[side] + 1 : 1;
+        m->prev_num[side] = m->pick[side];
+    }
+    int flags = resolve_ball(m->pick[bat], m->pick[bowl], m->repeats[bat], 1, &runs);
+    m->last_pick[0] = m->pick[0];
+    m->last_pick[1] = m->pick[1];
+    m->pick[0] = m->pick[1] = -1;
+    m->last_runs = runs;
+    m->last_flags = flags;
+    m->last_batting = bat;
+    m->score[bat] += runs;
+    
+    if (m->second_innings && m->score[bat] > m->first_innings_score) m->state = PVP_OVER;
+    else if (flags & MATCHLOG_OUT) {
+        if (m->second_innings) m->state = PVP_OVER;
+        else {
+            m->second_innings = 1;
+            m->first_innings_score = m->score[bat];
+            m->batting = bowl;
+            m->repeats[0] = m->repeats[1] = 0;
+            m->prev_num[0] = m->prev_num[1] = -1;
+        }
+    }
+    metric_add(&metrics_local()->pvp_balls, 1);
+}
+
+/* Records this side's pick, resolving the ball once both are in */
+void pvp_pick(GameSession *s, int num) {
+    PvpMatch *m = pvp_lock_match(s);
+    if (!m) return;
+    if (m->state == PVP_PLAYING && m->pick[s->pvp_side] < 0) {
+        m->pick[s->pvp_side] = num;
+        m->seen[s->pvp_side] = m->last_activity = time(NULL);
+        if (m->pick[!s->pvp_side] >= 0) pvp_resolve(m);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* A consistent copy of the session's match for rendering; also applies timeouts */
+int pvp_view(GameSession *s, PvpMatch *out) {
+    PvpMatch *m = pvp_lock_match(s);
+    if (!m) return 0;
+    time_t now = time(NULL);
+    m->seen[s->pvp_side] = now;
+    /* The opponent owes a pick and has gone quiet: they forfeit */
+    if (m->state == PVP_PLAYING && m->pick[!s->pvp_side] < 0 && now - m->seen[!s->pvp_side] > PVP_TIMEOUT) {
+        m->state = PVP_OVER;
+        m->left = !s->pvp_side;
+    }
+    *out = *m;
+    pthread_mutex_unlock(&m->lock);
+    return 1;
+}
+
+void build_page_pvp(Buf *resp, GameSession *s) {
+    char body[4096];
+    const char *refresh = "";
+    PvpMatch m;
+    
+    if (!pvp_view(s, &m) || m.state == PVP_FREE) {
+        snprintf(body, sizeof(body),
+            "<div class=\"message-box\">Play hand cricket against another person. You are paired with the next player who joins.</div>"
+            "<div class=\"btn-grid-2\">"
+            "<a href=\"/pvp/join\" class=\"btn btn-success\">Find Opponent</a>"
+            "<a href=\"/\" class=\"btn btn-primary\">Main Menu</a>"
+            "</div>");
+    } else if (m.state == PVP_WAITING) {
+        refresh = "Refresh: 1; url=/pvp\r\n";
+        snprintf(body, sizeof(body),
+            "<div class=\"message-box pulse\">Looking for an opponent...</div>"
+            "<div class=\"btn-grid-2\">"
+            "<a href=\"/pvp/leave\" class=\"btn btn-danger\">Cancel</a>"
+            "<a href=\"/\" class=\"btn btn-primary\">Main Menu</a>"
+            "</div>");
+    } else {
+        int me = s->pvp_side, them = !me, batting = m.batting == me;
+        char msg[256], target[128] = "";
+        char *p = body, *end = body + sizeof(body);
+        
+        if (m.last_pick[0] < 0) strcpy(msg, batting ? "You bat first. Pick a number!" : "You bowl first. Pick a number!");
+        else if (m.last_flags & MATCHLOG_REPEAT_OUT)
+            snprintf(msg, sizeof(msg), "Same number 5 times! %s out!", m.last_batting == me ? "You're" : "Opponent is");
+        else if (m.last_flags & MATCHLOG_OUT)
+            snprintf(msg, sizeof(msg), "OUT! Both picked %d! %s out!", m.last_pick[me], m.last_batting == me ? "You're" : "Opponent is");
+        else
+            snprintf(msg, sizeof(msg), "You: %d | Opponent: %d | %s +%d", m.last_pick[me], m.last_pick[them],
+                m.last_batting == me ? "You" : "Opponent", m.last_runs);
+        if (m.second_innings)
+            snprintf(target, sizeof(target), "<div class=\"target-info\">Target: %d | %s need%s %d more</div>",
+                m.first_innings_score + 1, batting ? "You" : "Opponent", batting ? "" : "s",
+                m.first_innings_score + 1 - m.score[m.batting]);
+        
+        p += snprintf(p, end - p,
+            "<div class=\"message-box\">%s</div>"
+            "<div style=\"text-align:center;\"><span class=\"status-badge %s\">%s - %s Innings</span></div>%s"
+            "<div class=\"scoreboard\">"
+            "<div class=\"score-card player\"><div class=\"label\">You</div><div class=\"score\">%d</div></div>"
+            "<div class=\"score-card computer\"><div class=\"label\">Opponent</div><div class=\"score\">%d</div></div>"
+            "</div>",
+            msg, batting ? "status-batting" : "status-bowling", batting ? "BATTING" : "BOWLING",
+            m.second_innings ? "2nd" : "1st", target, m.score[me], m.score[them]);
+        
+        if (m.state == PVP_OVER) {
+            const char *result = m.left == them ? "Opponent left. YOU WIN!" : m.left == me ? "You left the match." :
+                m.score[me] > m.score[them] ? "YOU WIN!" : m.score[me] < m.score[them] ? "YOU LOST" : "IT'S A TIE!";
+            snprintf(p, end - p,
+                "<div class=\"result-banner %s\"><div class=\"result-text\">%s</div></div>"
+                "<div class=\"btn-grid-2\">"
+                "<a href=\"/pvp/join\" class=\"btn btn-success\">New Opponent</a>"
+                "<a href=\"/\" class=\"btn btn-primary\">Main Menu</a>"
+                "</div>",
+                m.left == them || (m.left < 0 && m.score[me] > m.score[them]) ? "result-win" :
+                m.left < 0 && m.score[me] == m.score[them] ? "result-tie" : "result-lose", result);
+        } else if (m.pick[me] >= 0) {
+            refresh = "Refresh: 1; url=/pvp\r\n";
+            snprintf(p, end - p,
+                "<div class=\"panel\"><div class=\"panel-title\">You picked %d</div>"
+                "<div class=\"lb-empty\">Waiting for your opponent's pick...</div></div>"
+                "<div class=\"btn-grid-2\"><a href=\"/pvp/leave\" class=\"btn btn-danger btn-wide\">Leave Match</a></div>",
+                m.pick[me]);
+        } else {
+            snprintf(p, end - p,
+                "<div class=\"panel\"><div class=\"panel-title\">Pick a Number (0-10)%s</div>"
+                "<div class=\"btn-grid\">"
+                "<a href=\"/pvp/play/0\" class=\"btn btn-number\">0</a>"
+                "<a href=\"/pvp/play/1\" class=\"btn btn-number\">1</a>"
+                "<a href=\"/pvp/play/2\" class=\"btn btn-number\">2</a>"
+                "<a href=\"/pvp/play/3\" class=\"btn btn-number\">3</a>"
+                "<a href=\"/pvp/play/4\" class=\"btn btn-number\">4</a>"
+                "<a href=\"/pvp/play/5\" class=\"btn btn-number\">5</a>"
+                "<a href=\"/pvp/play/6\" class=\"btn btn-number\">6</a>"
+                "<a href=\"/pvp/play/7\" class=\"btn btn-number\">7</a>"
+                "<a href=\"/pvp/play/8\" class=\"btn btn-number\">8</a>"
+                "<a href=\"/pvp/play/9\" class=\"btn btn-number\">9</a>"
+                "<a href=\"/pvp/play/10\" class=\"btn btn-number btn-wide\">10</a>"
+                "<a href=\"/pvp/leave\" class=\"btn btn-danger btn-wide\">Leave Match</a></div></div>",
+                m.pick[them] >= 0 ? " - opponent has picked" : "");
+        }
+    }
+    
+    buf_printf(resp,
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n%s"
+        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n",
+        refresh, s->session_id);
+    build_html_head(resp);
+    buf_printf(resp,
+        "<div class=\"container\">"
+        "<div class=\"header\"><h1>Hand Cricket</h1><p>Player vs Player</p></div>"
+        "%s"
+        "<div class=\"footer\">Made with C</div>"
+        "</div></body></html>", body);
+}
+
+typedef struct {
+    time_t now;
+    uint64_t active, expired;
+} SessionCounts;
+
+void count_sessions(int lo, int hi, void *arg) {
+    SessionCounts *c = arg;
+    sessions_lock();
+    for (int i = lo; i < hi; i++) {
+        if (sessions[i].session_id[0] == '\0') continue;
+        if (c->now - sessions[i].last_activity > SESSION_TTL) c->expired++;
+        else c->active++;
+    }
+    sessions_unlock();
+}
+
+/* Prometheus text exposition of the sharded counters and session gauges */
+void build_page_metrics(Buf *resp) {
+    static const char *diff_labels[] = {"other", "easy", "medium", "hard", "optimal"};
+    uint64_t hist[ROUTE_COUNT][LATENCY_BUCKETS + 1] = {{0}}, sum_ns[ROUTE_COUNT] = {0};
+    uint64_t lock_wait = 0, lock_contended = 0, lock_acquired = 0, bytes = 0;
+    uint64_t ai_moves[DIFFICULTY_LEVELS] = {0}, ai_ns[DIFFICULTY_LEVELS] = {0}, log_records = 0, log_dropped = 0;
+    uint64_t sse_events = 0, sse_dropped = 0, sse_queue_full = 0, lb_recorded = 0, lb_busy = 0, pvp_started = 0, pvp_balls = 0;
+    uint64_t rate_limited[3] = {0}, shed = 0, access_records = 0, access_dropped = 0;
+    uint64_t h2_connections = 0, h2_streams = 0, spilled = 0, faulted_in = 0, on_disk, profile_merges = 0, handoffs = 0;
+    uint64_t capture_records = 0, capture_dropped = 0;
+    int active = 0, expired = 0;
+    
+    for (int i = 0; i < METRIC_SHARDS; i++) {
+        MetricShard *m = &metric_shards[i];
+        for (int r = 0; r < ROUTE_COUNT; r++) {
+            for (int b = 0; b <= LATENCY_BUCKETS; b++) hist[r][b] += metric_read(&m->latency_hist[r][b]);
+            sum_ns[r] += metric_read(&m->latency_sum_ns[r]);
+        }
+        lock_wait += metric_read(&m->lock_wait_ns);
+        lock_contended += metric_read(&m->lock_contended);
+        lock_acquired += metric_read(&m->lock_acquired);
+        bytes += metric_read(&m->bytes_sent);
+        for (int d = 0; d < DIFFICULTY_LEVELS; d++) { ai_moves[d] += metric_read(&m->ai_moves[d]); ai_ns[d] += metric_read(&m->ai_move_ns[d]); }
+        log_records += metric_read(&m->match_log_records);
+        log_dropped += metric_read(&m->match_log_dropped);
+        sse_events += metric_read(&m->sse_events);
+        sse_dropped += metric_read(&m->sse_dropped);
+        sse_queue_full += metric_read(&m->sse_queue_full);
+        lb_recorded += metric_read(&m->leaderboard_recorded);
+        lb_busy += metric_read(&m->leaderboard_busy);
+        pvp_started += metric_read(&m->pvp_matches);
+        pvp_balls += metric_read(&m->pvp_balls);
+        for (int k = 0; k < 3; k++) rate_limited[k] += metric_read(&m->rate_limited[k]);
+        shed += metric_read(&m->connections_shed);
+        access_records += metric_read(&m->access_log_records);
+        access_dropped += metric_read(&m->access_log_dropped);
+        h2_connections += metric_read(&m->h2_connections);
+        h2_streams += metric_read(&m->h2_streams);
+        spilled += metric_read(&m->sessions_spilled);
+        faulted_in += metric_read(&m->sessions_faulted_in);
+        profile_merges += metric_read(&m->profile_merges);
+        handoffs += metric_read(&m->owner_handoffs);
+        capture_records += metric_read(&m->capture_records);
+        capture_dropped += metric_read(&m->capture_dropped);
+    }
+    
+    SessionCounts counts = { time(NULL), 0, 0 };
+    time_t now = counts.now;
+    owners_each(count_sessions, &counts);
+    active = (int)counts.active;
+    expired = (int)counts.expired;
+    sessions_lock();
+    on_disk = spill_count;
+    sessions_unlock();
+    
+    buf_printf(resp, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+    
+    buf_printf(resp, "# HELP handcricket_requests_total Requests handled per route.\n# TYPE handcricket_requests_total counter\n");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        uint64_t count = 0;
+        for (int b = 0; b <= LATENCY_BUCKETS; b++) count += hist[r][b];
+        buf_printf(resp, "handcricket_requests_total{route=\"%s\"} %llu\n", route_names[r], (unsigned long long)count);
+    }
+    
+    buf_printf(resp, "# HELP handcricket_request_duration_seconds Time spent in handle_request.\n# TYPE handcricket_request_duration_seconds histogram\n");
+    for (int r = 0; r < ROUTE_COUNT; r++) {
+        uint64_t cum = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            cum += hist[r][b];
+            buf_printf(resp, "handcricket_request_duration_seconds_bucket{route=\"%s\",le=\"%g\"} %llu\n",
+                route_names[r], latency_bounds_us[b] / 1e6, (unsigned long long)cum);
+        }
+        cum += hist[r][LATENCY_BUCKETS];
+        buf_printf(resp,
+            "handcricket_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %llu\n"
+            "handcricket_request_duration_seconds_sum{route=\"%s\"} %.9f\n"
+            "handcricket_request_duration_seconds_count{route=\"%s\"} %llu\n",
+            route_names[r], (unsigned long long)cum, route_names[r], sum_ns[r] / 1e9,
+            route_names[r], (unsigned long long)cum);
+    }
+    
+    buf_printf(resp,
+        "# HELP handcricket_sessions Session slots by state.\n# TYPE handcricket_sessions gauge\n"
+        "handcricket_sessions{state=\"active\"} %d\n"
+        "handcricket_sessions{state=\"expired\"} %d\n"
+        "handcricket_sessions{state=\"free\"} %d\n"
+        "# HELP handcricket_sessions_spilled Paused matches held in the --spill slab.\n# TYPE handcricket_sessions_spilled gauge\n"
+        "handcricket_sessions_spilled %llu\n"
+        "# HELP handcricket_session_spills_total Sessions moved to the slab.\n# TYPE handcricket_session_spills_total counter\n"
+        "handcricket_session_spills_total %llu\n"
+        "# HELP handcricket_session_faults_total Spilled sessions brought back by a returning player.\n"
+        "# TYPE handcricket_session_faults_total counter\n"
+        "handcricket_session_faults_total %llu\n"
+        "# HELP handcricket_profile_merges_total Batches of balls merged into --profiles records.\n"
+        "# TYPE handcricket_profile_merges_total counter\n"
+        "handcricket_profile_merges_total %llu\n"
+        "# HELP handcricket_owner_handoffs_total Requests and WebSocket moves handed to their session's owner core.\n"
+        "# TYPE handcricket_owner_handoffs_total counter\n"
+        "handcricket_owner_handoffs_total %llu\n"
+        "# HELP handcricket_session_lock_wait_seconds_total Time spent waiting for the session table lock.\n"
+        "# TYPE handcricket_session_lock_wait_seconds_total counter\n"
+        "handcricket_session_lock_wait_seconds_total %.9f\n"
+        "# HELP handcricket_session_lock_acquisitions_total Session table lock acquisitions.\n"
+        "# TYPE handcricket_session_lock_acquisitions_total counter\n"
+        "handcricket_session_lock_acquisitions_total{contended=\"false\"} %llu\n"
+        "handcricket_session_lock_acquisitions_total{contended=\"true\"} %llu\n"
+        "# HELP handcricket_bytes_sent_total Response bytes written to clients.\n"
+        "# TYPE handcricket_bytes_sent_total counter\n"
+        "handcricket_bytes_sent_total %llu\n",
+        active, expired, MAX_SESSIONS - active - expired,
+        (unsigned long long)on_disk, (unsigned long long)spilled, (unsigned long long)faulted_in,
+        (unsigned long long)profile_merges, (unsigned long long)handoffs, lock_wait / 1e9,
+        (unsigned long long)(lock_acquired - lock_contended), (unsigned long long)lock_contended,
+        (unsigned long long)bytes);
+    
+    buf_printf(resp,
+        "# HELP handcricket_ai_moves_total Computer moves generated per difficulty.\n# TYPE handcricket_ai_moves_total counter\n");
+    for (int d = 1; d < DIFFICULTY_LEVELS; d++)
+        buf_printf(resp, "handcricket_ai_moves_total{difficulty=\"%s\"} %llu\n", diff_labels[d], (unsigned long long)ai_moves[d]);
+    buf_printf(resp,
+        "# HELP handcricket_ai_move_seconds_total Time spent in generate_computer_move per difficulty.\n# TYPE handcricket_ai_move_seconds_total counter\n");
+    for (int d = 1; d < DIFFICULTY_LEVELS; d++)
+        buf_printf(resp, "handcricket_ai_move_seconds_total{difficulty=\"%s\"} %.9f\n", diff_labels[d], ai_ns[d] / 1e9);
+    
+    buf_printf(resp,
+        "# HELP handcricket_match_log_records_total Balls queued for the match log.\n# TYPE handcricket_match_log_records_total counter\n"
+        "handcricket_match_log_records_total %llu\n"
+        "# HELP handcricket_match_log_dropped_total Balls dropped because the match log writer fell behind.\n"
+        "# TYPE handcricket_match_log_dropped_total counter\n"
+        "handcricket_match_log_dropped_total %llu\n",
+        (unsigned long long)log_records, (unsigned long long)log_dropped);
+    
+    buf_printf(resp,
+        "# HELP handcricket_access_log_records_total Requests queued for the access log.\n"
+        "# TYPE handcricket_access_log_records_total counter\n"
+        "handcricket_access_log_records_total %llu\n"
+        "# HELP handcricket_access_log_dropped_total Requests not logged because the access log rings were full.\n"
+        "# TYPE handcricket_access_log_dropped_total counter\n"
+        "handcricket_access_log_dropped_total %llu\n",
+        (unsigned long long)access_records, (unsigned long long)access_dropped);
+    
+    buf_printf(resp,
+        "# HELP handcricket_capture_records_total Requests recorded by --capture.\n"
+        "# TYPE handcricket_capture_records_total counter\n"
+        "handcricket_capture_records_total %llu\n"
+        "# HELP handcricket_capture_dropped_total Requests not captured because the writer fell a batch behind.\n"
+        "# TYPE handcricket_capture_dropped_total counter\n"
+        "handcricket_capture_dropped_total %llu\n",
+        (unsigned long long)capture_records, (unsigned long long)capture_dropped);
+    
+    buf_printf(resp,
+        "# HELP handcricket_h2_connections_total Connections served as HTTP/2 (h2c).\n# TYPE handcricket_h2_connections_total counter\n"
+        "handcricket_h2_connections_total %llu\n"
+        "# HELP handcricket_h2_streams_total HTTP/2 request streams answered.\n# TYPE handcricket_h2_streams_total counter\n"
+        "handcricket_h2_streams_total %llu\n",
+        (unsigned long long)h2_connections, (unsigned long long)h2_streams);
     
-    sprintf(html,
-        "%s<div class=\"container\">"
-        "<div class=\"header\"><h1>Game Over!</h1></div>"
-        "<div class=\"result-banner %s\">"
-        "<div class=\"result-icon\">%s</div>"
-        "<div class=\"result-text\">%s</div>"
-        "<div class=\"result-detail\">%s</div>"
-        "</div>"
-        "<div class=\"scoreboard\">"
-        "<div class=\"score-card player\"><div class=\"label\">Your Score</div><div class=\"score\">%d</div></div>"
-        "<div class=\"score-card computer\"><div class=\"label\">Computer</div><div class=\"score\">%d</div></div>"
-        "</div>"
-        "<div class=\"btn-grid-2\">"
-        "<a href=\"/start\" class=\"btn btn-success\">Play Again</a>"
-        "<a href=\"/\" class=\"btn btn-primary\">Main Menu</a>"
-        "</div>"
-        "<div class=\"footer\">Made with C</div>"
-        "</div></body></html>",
-        head, result_class, result_icon, result_text, result_detail,
-        s->player_score, s->computer_score);
+    buf_printf(resp,
+        "# HELP handcricket_sse_watchers Open /events spectator streams.\n# TYPE handcricket_sse_watchers gauge\n"
+        "handcricket_sse_watchers %d\n"
+        "# HELP handcricket_sse_events_total Events written to spectator streams.\n# TYPE handcricket_sse_events_total counter\n"
+        "handcricket_sse_events_total %llu\n"
+        "# HELP handcricket_sse_dropped_total Spectators disconnected because a send failed or would block.\n"
+        "# TYPE handcricket_sse_dropped_total counter\n"
+        "handcricket_sse_dropped_total %llu\n"
+        "# HELP handcricket_sse_queue_full_total Events not sent because the fan-out queue was full.\n"
+        "# TYPE handcricket_sse_queue_full_total counter\n"
+        "handcricket_sse_queue_full_total %llu\n",
+        __atomic_load_n(&sse_watcher_count, __ATOMIC_RELAXED),
+        (unsigned long long)sse_events, (unsigned long long)sse_dropped, (unsigned long long)sse_queue_full);
     
-    sprintf(resp,
-        "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
-        "Set-Cookie: session=%s; Path=/\r\nConnection: close\r\n\r\n%s",
-        s->session_id, html);
+    buf_printf(resp,
+        "# HELP handcricket_leaderboard_recorded_total Finished matches recorded for the leaderboard.\n"
+        "# TYPE handcricket_leaderboard_recorded_total counter\n"
+        "handcricket_leaderboard_recorded_total %llu\n"
+        "# HELP handcricket_leaderboard_shard_busy_total Leaderboard shards skipped because another thread held them.\n"
+        "# TYPE handcricket_leaderboard_shard_busy_total counter\n"
+        "handcricket_leaderboard_shard_busy_total %llu\n",
+        (unsigned long long)lb_recorded, (unsigned long long)lb_busy);
+    
+    buf_printf(resp,
+        "# HELP handcricket_pvp_matches_total Player vs player matches paired.\n# TYPE handcricket_pvp_matches_total counter\n"
+        "handcricket_pvp_matches_total %llu\n"
+        "# HELP handcricket_pvp_balls_total Player vs player balls resolved.\n# TYPE handcricket_pvp_balls_total counter\n"
+        "handcricket_pvp_balls_total %llu\n",
+        (unsigned long long)pvp_started, (unsigned long long)pvp_balls);
+    
+    buf_printf(resp,
+        "# HELP handcricket_rate_limited_total Requests answered 429 per limit.\n# TYPE handcricket_rate_limited_total counter\n");
+    for (int k = 0; k < 3; k++)
+        buf_printf(resp, "handcricket_rate_limited_total{scope=\"%s\"} %llu\n", rate_scope_names[k], (unsigned long long)rate_limited[k]);
+    buf_printf(resp,
+        "# HELP handcricket_connections_active Connections currently being served.\n# TYPE handcricket_connections_active gauge\n"
+        "handcricket_connections_active %d\n"
+        "# HELP handcricket_connections_shed_total Connections answered 503 because --max-connections was reached.\n"
+        "# TYPE handcricket_connections_shed_total counter\n"
+        "handcricket_connections_shed_total %llu\n",
+        __atomic_load_n(&active_connections, __ATOMIC_RELAXED), (unsigned long long)shed);
+    
+    buf_printf(resp,
+        "# HELP handcricket_uptime_seconds Seconds since the server started.\n# TYPE handcricket_uptime_seconds gauge\n"
+        "handcricket_uptime_seconds %ld\n", (long)(now - server_start_time));
+}
+
+/* Session ids are the digits generate_session_id() makes; anything else is rejected */
+int valid_session_id(const char *sid) {
+    size_t n = strlen(sid);
+    if (n == 0 || n >= sizeof(((GameSession*)0)->session_id)) return 0;
+    for (size_t i = 0; i < n; i++) if (sid[i] < '0' || sid[i] > '9') return 0;
+    return 1;
+}
+
+/* A copy of the watched session, taken on its owner so it is not mid-change */
+typedef struct {
+    const char *sid;
+    GameSession copy;
+    int found;
+} EventsCopy;
+
+void events_copy(void *arg) {
+    EventsCopy *e = arg;
+    sessions_lock();
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (strcmp(sessions[i].session_id, e->sid) == 0) { e->copy = sessions[i]; e->found = 1; break; }
+    }
+    sessions_unlock();
+}
+
+/* Starts an event stream for a spectator; returns 1 if the socket now belongs to the watcher table */
+int handle_events(int sock, const char *sid) {
+    char hello[2048];
+    EventsCopy e;
+    GameSession *copy = &e.copy;
+    int len;
+    
+    e.sid = sid;
+    e.found = 0;
+    if (valid_session_id(sid)) owner_run(owner_for(sid), events_copy, &e);
+    if (!e.found) {
+        const char *nf = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nNo such session\n";
+        send_response(sock, nf, strlen(nf));
+        return 0;
+    }
+    
+    len = snprintf(hello, sizeof(hello),
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+        "Connection: keep-alive\r\nX-Accel-Buffering: no\r\n\r\nretry: 2000\n\n");
+    len += sse_format(hello + len, sizeof(hello) - len, "state", copy, 0, copy->is_out);
+    if (sse_subscribe(sock, matchlog_key(sid), hello, len) < 0) {
+        const char *busy = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 5\r\nConnection: close\r\n\r\n";
+        send_response(sock, busy, strlen(busy));
+        return 0;
+    }
+    note_sent(hello, len);
+    return 1;
+}
+
+/* ==================== WEBSOCKET ==================== */
+/*
+ * GET /ws upgrades the connection (RFC 6455) for the session in the
+ * cookie. The browser then sends each move as a one-byte binary message
+ * and gets back one binary frame per ball, so a ball costs a few dozen
+ * bytes each way instead of a request plus a full page:
+ *
+ *   0     phase            5-6   player score (big endian)
+ *   1     flags: 1 batting, 2 out on this ball, 4 second innings
+ *   2     player's number  7-8   computer score
+ *   3     computer's number (255 = none)
+ *   4     runs off the ball 9-10 target (0 in the first innings)
+ *   11..  the session message, UTF-8
+ *
+ * The connection keeps its thread, like every other connection here.
+ */
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_PAYLOAD 125
+#define WS_IDLE_SECONDS 600
+#define WS_STATE_MAX (11 + 512)
+
+/* SHA-1, only for the handshake's Sec-WebSocket-Accept */
+void sha1(const unsigned char *data, size_t len, unsigned char out[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    unsigned char block[64];
+    uint64_t bits = (uint64_t)len * 8;
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    
+    for (size_t off = 0; off < total; off += 64) {
+        uint32_t w[80], a, b, c, d, e, f, k, t;
+        for (int i = 0; i < 64; i++) {
+            size_t pos = off + i;
+            if (pos < len) block[i] = data[pos];
+            else if (pos == len) block[i] = 0x80;
+            else if (pos >= total - 8) block[i] = (unsigned char)(bits >> (8 * (total - 1 - pos)));
+            else block[i] = 0;
+        }
+        for (int i = 0; i < 16; i++)
+            w[i] = (uint32_t)block[4*i] << 24 | (uint32_t)block[4*i+1] << 16 | (uint32_t)block[4*i+2] << 8 | block[4*i+3];
+        for (int i = 16; i < 80; i++) { t = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]; w[i] = t << 1 | t >> 31; }
+        a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+        for (int i = 0; i < 80; i++) {
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            t = (a << 5 | a >> 27) + f + e + k + w[i];
+            e = d; d = c; c = b << 30 | b >> 2; b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) out[i] = (unsigned char)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+void base64_encode(const unsigned char *in, size_t len, char *out) {
+    static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+    for (i = 0; i + 2 < len; i += 3) {
+        *out++ = tbl[in[i] >> 2];
+        *out++ = tbl[(in[i] & 3) << 4 | in[i+1] >> 4];
+        *out++ = tbl[(in[i+1] & 15) << 2 | in[i+2] >> 6];
+        *out++ = tbl[in[i+2] & 63];
+    }
+    if (i < len) {
+        *out++ = tbl[in[i] >> 2];
+        if (i + 1 < len) { *out++ = tbl[(in[i] & 3) << 4 | in[i+1] >> 4]; *out++ = tbl[(in[i+1] & 15) << 2]; }
+        else { *out++ = tbl[(in[i] & 3) << 4]; *out++ = '='; }
+        *out++ = '=';
+    }
+    *out = '\0';
+}
+
+/* Copies a request header's value (case-insensitive name) into out; 0 if absent */
+int get_header(const char *req, const char *name, char *out, size_t cap) {
+    size_t n = strlen(name);
+    for (const char *line = strstr(req, "\r\n"); line && line[2] != '\r'; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, n) == 0 && line[2 + n] == ':') {
+            const char *v = line + 3 + n;
+            size_t i = 0;
+            while (*v == ' ') v++;
+            while (v[i] && v[i] != '\r' && i < cap - 1) { out[i] = v[i]; i++; }
+            out[i] = '\0';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ws_read_full(int sock, unsigned char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(sock, buf + got, len - got);
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+/* One unfragmented server frame (servers never mask); payloads past WS_STATE_MAX are refused */
+int ws_send(int sock, int opcode, const unsigned char *data, size_t len) {
+    unsigned char frame[4 + WS_STATE_MAX];
+    size_t hdr = len < 126 ? 2 : 4;
+    if (len > WS_STATE_MAX) return -1;
+    frame[0] = (unsigned char)(0x80 | opcode);
+    if (len < 126) frame[1] = (unsigned char)len;
+    else { frame[1] = 126; frame[2] = (unsigned char)(len >> 8); frame[3] = (unsigned char)len; }
+    memcpy(frame + hdr, data, len);
+    ssize_t n = send(sock, frame, hdr + len, MSG_NOSIGNAL);
+    if (n > 0) note_sent((const char*)frame, (uint64_t)n);
+    return n == (ssize_t)(hdr + len) ? 0 : -1;
+}
+
+/* The state message: fills m (WS_STATE_MAX bytes) and returns its length */
+size_t ws_state(unsigned char *m, const GameSession *s, int runs, int out) {
+    size_t mlen = strlen(s->message);
+    int target = s->second_innings ? s->first_innings_score + 1 : 0;
+    m[0] = (unsigned char)s->game_phase;
+    m[1] = (unsigned char)((s->is_batting ? 1 : 0) | (out ? 2 : 0) | (s->second_innings ? 4 : 0));
+    m[2] = s->last_player_input >= 0 ? (unsigned char)s->last_player_input : 255;
+    m[3] = s->last_computer_move >= 0 ? (unsigned char)s->last_computer_move : 255;
+    m[4] = (unsigned char)runs;
+    m[5] = (unsigned char)(s->player_score >> 8); m[6] = (unsigned char)s->player_score;
+    m[7] = (unsigned char)(s->computer_score >> 8); m[8] = (unsigned char)s->computer_score;
+    m[9] = (unsigned char)(target >> 8); m[10] = (unsigned char)target;
+    if (mlen > WS_STATE_MAX - 11) mlen = WS_STATE_MAX - 11;
+    memcpy(m + 11, s->message, mlen);
+    return 11 + mlen;
+}
+
+/* A move (or, with move unset, just the current state), run on the session's owner */
+typedef struct {
+    GameSession *s;
+    int move, num;
+    size_t len;                     /* 0: the session is gone */
+    unsigned char m[WS_STATE_MAX];
+    char sid[64];
+} WsMove;
+
+/* The socket's session; during a live upgrade the other process may have moved it to another slot */
+GameSession* ws_session(WsMove *w) {
+    if (strcmp(w->s->session_id, w->sid) != 0) {
+        GameSession *s = find_session(w->sid);
+        if (!s) return NULL;
+        w->s = s;
+    }
+    w->s->last_activity = time(NULL);
+    return w->s;
+}
+
+void ws_move(void *arg) {
+    WsMove *w = arg;
+    GameSession *s = ws_session(w);
+    int runs = 0, flags = 0;
+    w->len = 0;
+    if (!s) return;
+    if (w->move && !rate_check_session(s)) w->num = -1;    /* over the limit: answer with the unchanged state */
+    if (w->move && w->num >= 0 && w->num <= 10 && s->game_phase == 3) {
+        int before = s->is_batting ? s->player_score : s->computer_score;
+        int was_batting = s->is_batting;
+        flags = handle_play(s, w->num);
+        runs = (was_batting ? s->player_score : s->computer_score) - before;
+    }
+    w->len = ws_state(w->m, s, runs, flags & MATCHLOG_OUT);
+}
+
+/* Any frame, pings included, keeps the session from being spilled while a socket holds it */
+void ws_touch(void *arg) {
+    ws_session(arg);
+}
+
+/* Message loop after the handshake; returns when either side closes */
+void ws_serve(int sock, GameSession *s, const char *sid) {
+    unsigned char hdr[2], ext[2], mask[4], payload[WS_MAX_PAYLOAD];
+    struct timeval idle = { WS_IDLE_SECONDS, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+    
+    int owner = owner_for(sid);
+    WsMove w = { s, 0, -1, 0, {0}, {0} };
+    snprintf(w.sid, sizeof(w.sid), "%s", sid);
+    owner_run(owner, ws_move, &w);
+    if (!w.len || ws_send(sock, 0x2, w.m, w.len) < 0) return;
+    while (ws_read_full(sock, hdr, 2) == 0) {
+        int opcode = hdr[0] & 0x0f;
+        size_t len = hdr[1] & 0x7f;
+        if (!(hdr[1] & 0x80) || !(hdr[0] & 0x80)) break;           /* clients must mask; no fragments */
+        if (len == 126) {
+            if (ws_read_full(sock, ext, 2) < 0) break;
+            len = (size_t)ext[0] << 8 | ext[1];
+        }
+        if (len > WS_MAX_PAYLOAD) {
+            unsigned char code[2] = {0x03, 0xF1};                  /* 1009: message too big */
+            ws_send(sock, 0x8, code, 2);
+            break;
+        }
+        if (ws_read_full(sock, mask, 4) < 0 || ws_read_full(sock, payload, len) < 0) break;
+        for (size_t i = 0; i < len; i++) payload[i] ^= mask[i & 3];
+        if (opcode != 0x1 && opcode != 0x2) owner_run(owner, ws_touch, &w);    /* moves touch it in ws_move */
+        
+        if (opcode == 0x8) { ws_send(sock, 0x8, payload, len < 2 ? len : 2); break; }
+        if (opcode == 0x9) { ws_send(sock, 0xA, payload, len); continue; }
+        if (opcode != 0x1 && opcode != 0x2) continue;
+        
+        /* A move: one byte 0-10 (binary), or its digits (text) */
+        uint64_t t0 = now_ns();
+        w.move = 1;
+        w.num = -1;
+        if (opcode == 0x2 && len == 1) w.num = payload[0];
+        else if (opcode == 0x1 && len >= 1 && len <= 2) { payload[len] = 0; w.num = atoi((char*)payload); }
+        owner_run(owner, ws_move, &w);
+        int rc = w.len ? ws_send(sock, 0x2, w.m, w.len) : -1;
+        metrics_observe_request(ROUTE_WS_PLAY, now_ns() - t0);
+        if (rc < 0) break;
+    }
+}
+
+/* The cookie's session for a WebSocket, run on its owner */
+typedef struct {
+    const char *req;
+    char sid[64];
+    GameSession *s;
+} WsAttach;
+
+void ws_attach(void *arg) {
+    WsAttach *a = arg;
+    a->s = find_session(a->sid);
+    uint64_t player = a->s && profile_map ? get_player_cookie(a->req) : 0;
+    if (player && a->s->player != player) profile_attach(a->s, player);
+}
+
+/* Upgrades to a WebSocket for the cookie's session, then serves it */
+void handle_ws(int sock, const char *req, uint64_t t0) {
+    char key[128], upgrade[64], accept[32], resp[256], *sid = get_session_cookie(req);
+    unsigned char digest[20];
+    WsAttach a = { req, "", NULL };
+    
+    if (sid) {
+        snprintf(a.sid, sizeof(a.sid), "%s", sid);
+        owner_run(owner_for(a.sid), ws_attach, &a);
+    }
+    GameSession *s = a.s;
+    if (s) request_note.session = matchlog_key(a.sid);
+    if (!get_header(req, "Upgrade", upgrade, sizeof(upgrade)) || strcasecmp(upgrade, "websocket") != 0 ||
+        !get_header(req, "Sec-WebSocket-Key", key, sizeof(key) - sizeof(WS_GUID)) || !s) {
+        const char *bad = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        send_response(sock, bad, strlen(bad));
+        metrics_observe_request(ROUTE_WS, now_ns() - t0);
+        return;
+    }
+    strcat(key, WS_GUID);
+    sha1((unsigned char*)key, strlen(key), digest);
+    base64_encode(digest, sizeof(digest), accept);
+    int n = snprintf(resp, sizeof(resp),
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    send_response(sock, resp, n);
+    metrics_observe_request(ROUTE_WS, now_ns() - t0);
+    ws_serve(sock, s, a.sid);
+}
+
+/* A request for the cookie's session; runs on the session's owner (see SESSION OWNERS) and only builds the response */
+typedef struct {
+    const char *req, *path;
+    uint32_t ip;
+    Buf *resp;
+    char sid[64];
+    int route;
+    uint64_t session;       /* matchlog_key() of the session, for the access log */
+} SessionRequest;
+
+void session_request(void *arg) {
+    SessionRequest *r = arg;
+    const char *req = r->req, *path = r->path;
+    Buf *resp = r->resp;
+    int route = ROUTE_OTHER;
+    
+    GameSession *s = r->sid[0] ? find_session(r->sid) : NULL;
+    if (!s && !rate_check_ip(r->ip, RATE_SCOPE_CREATE)) {
+        buf_append(resp, RATE_LIMITED_RESPONSE, sizeof(RATE_LIMITED_RESPONSE) - 1);
+        return;
+    }
+    if (!s) s = create_session();
+    if (!s) {
+        buf_append(resp, "HTTP/1.1 500 Error\r\n\r\n", 22);
+        return;
+    }
+    r->session = matchlog_key(s->session_id);
+    if (!rate_check_session(s)) {
+        buf_append(resp, RATE_LIMITED_RESPONSE, sizeof(RATE_LIMITED_RESPONSE) - 1);
+        return;
+    }
+    uint64_t player = profile_map ? get_player_cookie(req) : 0;
+    int new_player = profile_map && !player;
+    if (new_player) player = new_player_id();
+    if (player && s->player != player) profile_attach(s, player);
+    
+    if (strcmp(path, "/") == 0) {
+        route = ROUTE_MENU;
+        s->game_phase = 0;
+        build_page_menu(resp, s);
+    }
+    else if (strcmp(path, "/help") == 0) { route = ROUTE_HELP; build_page_help(resp, s); }
+    else if (strcmp(path, "/start") == 0) { route = ROUTE_START; reset_game(s); sse_publish(s, "state", 0, 0); build_page_toss(resp, s); }
+    else if (strcmp(path, "/reset") == 0) { route = ROUTE_RESET; s->game_phase = 0; strcpy(s->message, "Game reset!"); sse_publish(s, "state", 0, 0); build_page_menu(resp, s); }
+    else if (strncmp(path, "/diff/", 6) == 0) {
+        route = ROUTE_DIFF;
+        int d = atoi(path + 6);
+        if (d >= 1 && d <= 3) { s->difficulty = d; sprintf(s->message, "Difficulty: %s", d==1?"Easy":d==2?"Medium":"Hard"); }
+        else if (d == DIFFICULTY_OPTIMAL && strategy_table) { s->difficulty = d; strcpy(s->message, "Difficulty: Optimal"); }
+        build_page_menu(resp, s);
+    }
+    else if (strncmp(path, "/toss/", 6) == 0) {
+        route = ROUTE_TOSS;
+        handle_toss(s, path + 6);
+        sse_publish(s, "state", 0, 0);
+        if (s->game_phase == 2) build_page_choose(resp, s);
+        else build_page_game(resp, s);
+    }
+    else if (strncmp(path, "/choose/", 8) == 0) { route = ROUTE_CHOOSE; handle_choose(s, path + 8); sse_publish(s, "state", 0, 0); build_page_game(resp, s); }
+    else if (strncmp(path, "/pvp", 4) == 0 && (path[4] == '\0' || path[4] == '/')) {
+        route = ROUTE_PVP;
+        if (strcmp(path, "/pvp/join") == 0) {
+            if (!pvp_join(s)) {
+                buf_append(resp, "HTTP/1.1 503 Busy\r\n\r\n", 21);
+                r->route = route;
+                return;
+            }
+        }
+        else if (strcmp(path, "/pvp/leave") == 0) pvp_leave(s);
+        else if (strncmp(path, "/pvp/play/", 10) == 0) {
+            int n = atoi(path + 10);
+            if (n >= 0 && n <= 10) pvp_pick(s, n);
+        }
+        build_page_pvp(resp, s);
+    }
+    else if (strcmp(path, "/game") == 0) {
+        /* Current screen without playing a ball (the WebSocket page lands here) */
+        route = ROUTE_GAME;
+        if (s->game_phase == 4) build_page_gameover(resp, s);
+        else if (s->game_phase == 3) build_page_game(resp, s);
+        else if (s->game_phase == 2) build_page_choose(resp, s);
+        else if (s->game_phase == 1) build_page_toss(resp, s);
+        else build_page_menu(resp, s);
+    }
+    else if (strncmp(path, "/play/", 6) == 0) {
+        route = ROUTE_PLAY;
+        int n = atoi(path + 6);
+        if (n >= 0 && n <= 10 && s->game_phase == 3) handle_play(s, n);
+        if (s->game_phase == 4) build_page_gameover(resp, s);
+        else build_page_game(resp, s);
+    }
+    else build_page_menu(resp, s);
+    
+    if (new_player) add_player_cookie(resp, player);
+    r->route = route;
+}
+
+/* Returns 1 if the socket was handed off and must stay open */
+int handle_request(int sock, const char *req, uint32_t ip, Buf *resp) {
+    uint64_t t0 = now_ns();
+    request_note.ip = ip;
+    
+    char path[256] = "/";
+    sscanf(req, "GET %255s", path);
+    capture_begin(req, path);
+    
+    if (!rate_check_ip(ip, RATE_SCOPE_IP)) {
+        send_rate_limited(sock);
+        metrics_observe_request(ROUTE_OTHER, now_ns() - t0);
+        return 0;
+    }
+    
+    /* Scrapes must not allocate or touch game sessions */
+    if (strcmp(path, "/metrics") == 0) {
+        build_page_metrics(resp);
+        send_response(sock, resp->data, resp->len);
+        metrics_observe_request(ROUTE_METRICS, now_ns() - t0);
+        return 0;
+    }
+    
+    /* Spectators watch someone else's session: no cookie, no new session */
+    if (strncmp(path, "/events/", 8) == 0) {
+        int kept = handle_events(sock, path + 8);
+        metrics_observe_request(ROUTE_EVENTS, now_ns() - t0);
+        return kept;
+    }
+    /* Read-only views of the published board */
+    if (strcmp(path, "/leaderboard.json") == 0 || strcmp(path, "/leaderboard") == 0 ||
+        (strncmp(path, "/leaderboard/", 13) == 0 && path[13] >= '1' && path[13] <= '4' && !path[14])) {
+        if (path[12] == '.') build_page_leaderboard_json(resp);
+        else build_page_leaderboard(resp, path[12] == '/' ? path[13] - '0' : 0);
+        send_response(sock, resp->data, resp->len);
+        metrics_observe_request(ROUTE_LEADERBOARD, now_ns() - t0);
+        return 0;
+    }
+    if (strcmp(path, "/ws") == 0) {
+        handle_ws(sock, req, t0);
+        return 0;
+    }
+    if (strncmp(path, "/watch/", 7) == 0 && valid_session_id(path + 7)) {
+        build_page_watch(resp, path + 7);
+        send_response(sock, resp->data, resp->len);
+        metrics_observe_request(ROUTE_WATCH, now_ns() - t0);
+        return 0;
+    }
+    
+    SessionRequest r = { req, path, ip, resp, "", ROUTE_OTHER, 0 };
+    char *sid = get_session_cookie(req);
+    if (sid) snprintf(r.sid, sizeof(r.sid), "%s", sid);
+    owner_run(owner_for(sid ? r.sid : NULL), session_request, &r);
+    request_note.session = r.session;
+    send_response(sock, resp->data, resp->len);
+    metrics_observe_request(r.route, now_ns() - t0);
+    return 0;
+}
+
+/* ==================== HTTP/2 ==================== */
+/*
+ * Cleartext HTTP/2 (h2c, RFC 9113) on the same port, entered by prior
+ * knowledge (the connection opens with the client preface) or by a GET
+ * carrying "Upgrade: h2c". One thread serves the whole connection: each
+ * request stream is turned back into an HTTP/1.1 request and run through
+ * handle_request() with send_response() captured, and the captured
+ * response is re-framed as HEADERS + DATA. Requests take microseconds, so
+ * they run in arrival order; response bodies are interleaved under the
+ * peer's connection and stream windows. Response headers use HPACK
+ * incremental indexing, so the repeated set-cookie and content-type cost
+ * one byte each after the first response on a connection. /events and
+ * /ws keep their socket to themselves, so their streams are reset with
+ * HTTP_1_1_REQUIRED, which tells the client to retry them over HTTP/1.1.
+ */
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_MAX_STREAMS 100          /* SETTINGS_MAX_CONCURRENT_STREAMS we advertise */
+#define H2_FRAME_MAX 16384          /* largest frame we accept (the protocol default) */
+#define H2_DEFAULT_WINDOW 65535
+#define H2_MAX_WINDOW 0x7fffffff
+#define H2_HEADER_BLOCK_MAX 65536
+#define H2_IDLE_SECS 120
+#define HPACK_TABLE_SIZE 4096       /* dynamic table size, both directions */
+#define HPACK_MAX_ENTRIES (HPACK_TABLE_SIZE / 32)
+#define HPACK_INDEX_MAX_VALUE 512   /* longer response values are sent without indexing */
+
+enum { H2_DATA, H2_HEADERS, H2_PRIORITY, H2_RST_STREAM, H2_SETTINGS, H2_PUSH_PROMISE, H2_PING, H2_GOAWAY,
+       H2_WINDOW_UPDATE, H2_CONTINUATION };
+enum { H2_NO_ERROR, H2_PROTOCOL_ERROR, H2_INTERNAL_ERROR, H2_FLOW_CONTROL_ERROR, H2_SETTINGS_TIMEOUT,
+       H2_STREAM_CLOSED, H2_FRAME_SIZE_ERROR, H2_REFUSED_STREAM, H2_CANCEL, H2_COMPRESSION_ERROR,
+       H2_CONNECT_ERROR, H2_ENHANCE_YOUR_CALM, H2_INADEQUATE_SECURITY, H2_HTTP_1_1_REQUIRED };
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+#define H2_SETTINGS_HEADER_TABLE_SIZE 1
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 4
+#define H2_SETTINGS_MAX_FRAME_SIZE 5
+
+/* Set by the live upgrade: open HTTP/2 connections send GOAWAY and finish up */
+volatile int server_draining = 0;
+
+/* RFC 7541 Appendix B */
+const uint32_t hpack_huffman_codes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+const uint8_t hpack_huffman_lengths[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+/* RFC 7541 Appendix A, indices 1..61 */
+const char *hpack_static[61][2] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+    {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+    {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+    {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""},
+    {"cache-control", ""}, {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""},
+    {"content-length", ""}, {"content-location", ""}, {"content-range", ""}, {"content-type", ""},
+    {"cookie", ""}, {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+    {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+    {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""},
+    {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+
+/* Huffman decoding tree: node 0 is the root, a child of 0 means no such code, -1 - sym is a leaf */
+int16_t hpack_tree[256][2];
+pthread_once_t hpack_tree_once = PTHREAD_ONCE_INIT;
+
+void hpack_tree_build(void) {
+    int nodes = 1;
+    for (int sym = 0; sym < 256; sym++) {
+        int node = 0;
+        for (int bit = hpack_huffman_lengths[sym] - 1; bit >= 0; bit--) {
+            int b = (hpack_huffman_codes[sym] >> bit) & 1;
+            if (bit == 0) hpack_tree[node][b] = (int16_t)(-1 - sym);
+            else {
+                if (!hpack_tree[node][b]) hpack_tree[node][b] = (int16_t)nodes++;
+                node = hpack_tree[node][b];
+            }
+        }
+    }
+}
+
+/* Padding must be under 8 bits of the EOS code's leading ones (RFC 7541 5.2) */
+int hpack_huffman_decode(const uint8_t *in, size_t len, char *out, size_t cap, size_t *out_len) {
+    int node = 0, depth = 0, ones = 1;
+    size_t n = 0;
+    pthread_once(&hpack_tree_once, hpack_tree_build);
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (in[i] >> bit) & 1, next = hpack_tree[node][b];
+            if (next == 0) return -1;
+            if (next < 0) {
+                if (n == cap) return -1;
+                out[n++] = (char)(-1 - next);
+                node = 0; depth = 0; ones = 1;
+            } else {
+                node = next; depth++; ones &= b;
+            }
+        }
+    }
+    if (depth > 7 || !ones) return -1;
+    *out_len = n;
+    return 0;
+}
+
+int hpack_int(const uint8_t **p, const uint8_t *end, int prefix, uint32_t *out) {
+    uint32_t max = (1u << prefix) - 1, v;
+    if (*p >= end) return -1;
+    v = *(*p)++ & max;
+    if (v < max) { *out = v; return 0; }
+    for (int shift = 0; shift <= 21; shift += 7) {
+        if (*p >= end) return -1;
+        uint8_t b = *(*p)++;
+        v += (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *out = v; return 0; }
+    }
+    return -1;
+}
+
+/* Decodes a string literal into out (NUL-terminated); fields may not contain NUL, CR or LF */
+int hpack_string(const uint8_t **p, const uint8_t *end, char *out, size_t cap, size_t *out_len) {
+    int huffman = *p < end && (**p & 0x80);
+    uint32_t len;
+    if (hpack_int(p, end, 7, &len) < 0 || len > (size_t)(end - *p)) return -1;
+    if (huffman) {
+        if (hpack_huffman_decode(*p, len, out, cap - 1, out_len) < 0) return -1;
+    } else {
+        if (len > cap - 1) return -1;
+        memcpy(out, *p, len);
+        *out_len = len;
+    }
+    *p += len;
+    out[*out_len] = '\0';
+    return strcspn(out, "\r\n") == *out_len ? 0 : -1;
+}
+
+/* A dynamic table; entry 0 is the newest and sits at slot first of the ring */
+typedef struct {
+    char *name[HPACK_MAX_ENTRIES];
+    char *value[HPACK_MAX_ENTRIES];
+    int first, count;
+    size_t size, max;
+} HpackTable;
+
+void hpack_evict(HpackTable *t, size_t max) {
+    while (t->count && t->size > max) {
+        int slot = (t->first + t->count - 1) % HPACK_MAX_ENTRIES;
+        t->size -= strlen(t->name[slot]) + strlen(t->value[slot]) + 32;
+        free(t->name[slot]);
+        free(t->value[slot]);
+        t->count--;
+    }
+}
+
+void hpack_set_max(HpackTable *t, size_t max) {
+    hpack_evict(t, max);
+    t->max = max;
+}
+
+void hpack_add(HpackTable *t, const char *name, size_t nlen, const char *value, size_t vlen) {
+    size_t need = nlen + vlen + 32;
+    if (need > t->max) { hpack_evict(t, 0); return; }
+    hpack_evict(t, t->max - need);
+    t->first = (t->first + HPACK_MAX_ENTRIES - 1) % HPACK_MAX_ENTRIES;
+    t->name[t->first] = strndup(name, nlen);
+    t->value[t->first] = strndup(value, vlen);
+    t->count++;
+    t->size += need;
+}
+
+int hpack_get(const HpackTable *t, uint32_t index, const char **name, const char **value) {
+    if (index >= 1 && index <= 61) {
+        *name = hpack_static[index - 1][0];
+        *value = hpack_static[index - 1][1];
+        return 0;
+    }
+    if (index < 62 || index - 62 >= (uint32_t)t->count) return -1;
+    int slot = (t->first + (int)(index - 62)) % HPACK_MAX_ENTRIES;
+    *name = t->name[slot];
+    *value = t->value[slot];
+    return 0;
+}
+
+void hpack_put_int(Buf *out, uint8_t first, int prefix, uint32_t v) {
+    uint32_t max = (1u << prefix) - 1;
+    char b;
+    if (v < max) { b = (char)(first | v); buf_append(out, &b, 1); return; }
+    b = (char)(first | max);
+    buf_append(out, &b, 1);
+    for (v -= max; v >= 128; v >>= 7) { b = (char)(0x80 | (v & 0x7f)); buf_append(out, &b, 1); }
+    b = (char)v;
+    buf_append(out, &b, 1);
+}
+
+void hpack_put_string(Buf *out, const char *s, size_t len) {
+    hpack_put_int(out, 0x00, 7, (uint32_t)len);
+    buf_append(out, s, len);
+}
+
+typedef struct {
+    uint32_t id;            /* 0: free slot */
+    int32_t window;         /* what the peer lets us send on this stream */
+    Buf resp;               /* captured HTTP/1.1 response */
+    size_t body_off;        /* next body byte to send */
+} H2Stream;
+
+typedef struct {
+    int sock;
+    uint32_t ip;
+    Buf in, out, block;         /* unread input, output batched per loop turn, header block being assembled */
+    H2Stream streams[H2_MAX_STREAMS];
+    int open_streams;
+    int32_t window;             /* connection send window */
+    int32_t initial_window;     /* peer's SETTINGS_INITIAL_WINDOW_SIZE */
+    uint32_t max_frame;         /* peer's SETTINGS_MAX_FRAME_SIZE */
+    uint32_t last_stream;       /* highest stream the client opened */
+    uint32_t block_stream;      /* stream whose header block awaits CONTINUATION, 0 if none */
+    HpackTable decoder, encoder;
+    int size_update;            /* encoder table resized: announce it in the next header block */
+    int goaway;                 /* GOAWAY sent or received: no new streams */
+} H2Conn;
+
+void h2_frame_header(Buf *out, uint32_t len, int type, int flags, uint32_t stream) {
+    char h[9] = { (char)(len >> 16), (char)(len >> 8), (char)len, (char)type, (char)flags,
+                  (char)(stream >> 24), (char)(stream >> 16), (char)(stream >> 8), (char)stream };
+    buf_append(out, h, 9);
+}
+
+void h2_put32(char *p, uint32_t v) {
+    p[0] = (char)(v >> 24); p[1] = (char)(v >> 16); p[2] = (char)(v >> 8); p[3] = (char)v;
+}
+
+uint32_t h2_get32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void h2_goaway(H2Conn *c, int error) {
+    char payload[8];
+    h2_put32(payload, c->last_stream);
+    h2_put32(payload + 4, (uint32_t)error);
+    h2_frame_header(&c->out, 8, H2_GOAWAY, 0, 0);
+    buf_append(&c->out, payload, 8);
+    c->goaway = 1;
+}
+
+void h2_rst_stream(H2Conn *c, uint32_t stream, int error) {
+    char payload[4];
+    h2_put32(payload, (uint32_t)error);
+    h2_frame_header(&c->out, 4, H2_RST_STREAM, 0, stream);
+    buf_append(&c->out, payload, 4);
+}
+
+void h2_window_update(H2Conn *c, uint32_t stream, uint32_t increment) {
+    char payload[4];
+    h2_put32(payload, increment);
+    h2_frame_header(&c->out, 4, H2_WINDOW_UPDATE, 0, stream);
+    buf_append(&c->out, payload, 4);
+}
+
+H2Stream* h2_stream(H2Conn *c, uint32_t id) {
+    for (int i = 0; i < H2_MAX_STREAMS; i++) if (c->streams[i].id == id) return &c->streams[i];
+    return NULL;
+}
+
+void h2_stream_close(H2Conn *c, H2Stream *st) {
+    buf_put(&st->resp);
+    st->id = 0;
+    c->open_streams--;
+}
+
+/* Applies a SETTINGS payload (a frame, or the HTTP2-Settings header of an upgrade) */
+int h2_apply_settings(H2Conn *c, const uint8_t *p, size_t len) {
+    if (len % 6) return H2_FRAME_SIZE_ERROR;
+    for (; len; p += 6, len -= 6) {
+        unsigned id = (unsigned)p[0] << 8 | p[1];
+        uint32_t v = h2_get32(p + 2);
+        if (id == H2_SETTINGS_HEADER_TABLE_SIZE) {
+            size_t max = v < HPACK_TABLE_SIZE ? v : HPACK_TABLE_SIZE;
+            if (max != c->encoder.max) { hpack_set_max(&c->encoder, max); c->size_update = 1; }
+        } else if (id == H2_SETTINGS_INITIAL_WINDOW_SIZE) {
+            if (v > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+            int64_t delta = (int64_t)v - c->initial_window;
+            for (int i = 0; i < H2_MAX_STREAMS; i++) {
+                if (!c->streams[i].id) continue;
+                if (c->streams[i].window + delta > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+                c->streams[i].window += (int32_t)delta;
+            }
+            c->initial_window = (int32_t)v;
+        } else if (id == H2_SETTINGS_MAX_FRAME_SIZE) {
+            if (v < 16384 || v > 16777215) return H2_PROTOCOL_ERROR;
+            c->max_frame = v;
+        }
+    }
+    return H2_NO_ERROR;
+}
+
+/*
+ * Decodes a complete request header block into an HTTP/1.1 request.
+ * Header blocks that are not requests (trailers) pass req = NULL: they
+ * must still be decoded to keep the dynamic table in step.
+ */
+int h2_decode_request(H2Conn *c, const uint8_t *p, size_t len, Buf *req) {
+    const uint8_t *end = p + len;
+    char method[16] = "", path[256] = "", authority[256] = "localhost", name_buf[256], value_buf[8192];
+    Buf cookie = buf_get(REQUEST_INITIAL), fields = buf_get(REQUEST_INITIAL);
+    int rc = H2_COMPRESSION_ERROR, saw_field = 0;
+    
+    while (p < end) {
+        const char *name, *value;
+        size_t nlen, vlen;
+        uint32_t index;
+        int indexing = 0;
+        if (*p & 0x80) {
+            /* Indexed field */
+            if (hpack_int(&p, end, 7, &index) < 0 || hpack_get(&c->decoder, index, &name, &value) < 0) goto out;
+            nlen = strlen(name);
+            vlen = strlen(value);
+        } else if ((*p & 0xe0) == 0x20) {
+            /* Dynamic table size update: only at the start of a block */
+            if (saw_field || hpack_int(&p, end, 5, &index) < 0 || index > HPACK_TABLE_SIZE) goto out;
+            hpack_set_max(&c->decoder, index);
+            continue;
+        } else {
+            /* Literal: with incremental indexing (01), without (0000) or never indexed (0001) */
+            indexing = (*p & 0xc0) == 0x40;
+            if (hpack_int(&p, end, indexing ? 6 : 4, &index) < 0) goto out;
+            if (index) {
+                if (hpack_get(&c->decoder, index, &name, &value) < 0) goto out;
+                nlen = strlen(name);
+                if (nlen >= sizeof(name_buf)) goto out;
+                memcpy(name_buf, name, nlen + 1);
+            } else if (hpack_string(&p, end, name_buf, sizeof(name_buf), &nlen) < 0) goto out;
+            if (hpack_string(&p, end, value_buf, sizeof(value_buf), &vlen) < 0) goto out;
+            name = name_buf;
+            value = value_buf;
+        }
+        saw_field = 1;
+        if (req) {
+            if (strcmp(name, ":method") == 0) snprintf(method, sizeof(method), "%s", value);
+            else if (strcmp(name, ":path") == 0) snprintf(path, sizeof(path), "%s", value);
+            else if (strcmp(name, ":authority") == 0) snprintf(authority, sizeof(authority), "%s", value);
+            else if (strcmp(name, "cookie") == 0) {
+                /* Cookie crumbs may arrive as separate fields (RFC 9113 8.2.3) */
+                if (cookie.len) buf_append(&cookie, "; ", 2);
+                buf_append(&cookie, value, vlen);
+            } else if (name[0] != ':') {
+                buf_printf(&fields, "%s: %s\r\n", name, value);
+            }
+        }
+        /* name and value were copied out of any table slot this can evict */
+        if (indexing) hpack_add(&c->decoder, name, nlen, value, vlen);
+    }
+    rc = H2_NO_ERROR;
+    if (req) {
+        if (!method[0] || !path[0]) rc = H2_PROTOCOL_ERROR;
+        buf_printf(req, "%s %s HTTP/1.1\r\nHost: %s\r\n", method, path, authority);
+        if (cookie.len) buf_printf(req, "Cookie: %s\r\n", cookie.data);
+        buf_append(req, fields.data, fields.len);
+        buf_append(req, "\r\n", 2);
+    }
+out:
+    buf_put(&cookie);
+    buf_put(&fields);
+    return rc;
+}
+
+/* Encodes one response field, by index when the encoder's table already has it */
+void h2_encode_field(H2Conn *c, Buf *out, const char *name, size_t nlen, const char *value, size_t vlen, int indexing) {
+    uint32_t name_index = 0;
+    for (int i = 0; i < 61 && !name_index; i++) {
+        if (strncmp(hpack_static[i][0], name, nlen) != 0 || hpack_static[i][0][nlen]) continue;
+        for (int j = i; j < 61 && strcmp(hpack_static[j][0], hpack_static[i][0]) == 0; j++) {
+            if (strncmp(hpack_static[j][1], value, vlen) == 0 && !hpack_static[j][1][vlen]) {
+                hpack_put_int(out, 0x80, 7, (uint32_t)j + 1);
+                return;
+            }
+        }
+        name_index = (uint32_t)i + 1;
+    }
+    for (int i = 0; i < c->encoder.count; i++) {
+        int slot = (c->encoder.first + i) % HPACK_MAX_ENTRIES;
+        const char *tn = c->encoder.name[slot], *tv = c->encoder.value[slot];
+        if (strncmp(tn, name, nlen) != 0 || tn[nlen]) continue;
+        if (strncmp(tv, value, vlen) == 0 && !tv[vlen]) { hpack_put_int(out, 0x80, 7, 62 + (uint32_t)i); return; }
+        if (!name_index) name_index = 62 + (uint32_t)i;
+    }
+    indexing = indexing && vlen <= HPACK_INDEX_MAX_VALUE;
+    hpack_put_int(out, indexing ? 0x40 : 0x00, indexing ? 6 : 4, name_index);
+    if (!name_index) hpack_put_string(out, name, nlen);
+    hpack_put_string(out, value, vlen);
+    if (indexing) hpack_add(&c->encoder, name, nlen, value, vlen);
+}
+
+/* Connection-specific HTTP/1.1 fields, not allowed in HTTP/2; content-length is recomputed */
+int h2_dropped_field(const char *name, size_t nlen) {
+    const char *drop[] = { "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", "content-length" };
+    for (size_t i = 0; i < sizeof(drop) / sizeof(drop[0]); i++)
+        if (strlen(drop[i]) == nlen && memcmp(drop[i], name, nlen) == 0) return 1;
+    return 0;
+}
+
+/* Sends the captured response's head as HEADERS; the body goes out later through h2_pump() */
+void h2_respond(H2Conn *c, H2Stream *st) {
+    const char *data = st->resp.data, *head_end = strstr(data, "\r\n\r\n");
+    char name[64], length[24];
+    Buf block = buf_get(REQUEST_INITIAL);
+    size_t off = 0;
+    
+    st->body_off = head_end ? (size_t)(head_end + 4 - data) : st->resp.len;
+    if (c->size_update) { hpack_put_int(&block, 0x20, 5, (uint32_t)c->encoder.max); c->size_update = 0; }
+    h2_encode_field(c, &block, ":status", 7, st->resp.len > 12 && strncmp(data, "HTTP/1.", 7) == 0 ? data + 9 : "500", 3, 1);
+    for (const char *line = head_end ? strstr(data, "\r\n") + 2 : NULL; line && line < head_end; ) {
+        const char *eol = strstr(line, "\r\n"), *colon = memchr(line, ':', (size_t)(eol - line)), *value;
+        size_t nlen = colon ? (size_t)(colon - line) : 0;
+        if (nlen && nlen < sizeof(name)) {
+            for (size_t i = 0; i < nlen; i++) name[i] = (char)(line[i] >= 'A' && line[i] <= 'Z' ? line[i] + 32 : line[i]);
+            for (value = colon + 1; *value == ' '; value++) {}
+            if (!h2_dropped_field(name, nlen)) h2_encode_field(c, &block, name, nlen, value, (size_t)(eol - value), 1);
+        }
+        line = eol + 2;
+    }
+    snprintf(length, sizeof(length), "%zu", st->resp.len - st->body_off);
+    h2_encode_field(c, &block, "content-length", 14, length, strlen(length), 0);
+    
+    int end_stream = st->body_off == st->resp.len;
+    do {
+        size_t n = block.len - off < c->max_frame ? block.len - off : c->max_frame;
+        int flags = (off + n == block.len ? H2_FLAG_END_HEADERS : 0) | (!off && end_stream ? H2_FLAG_END_STREAM : 0);
+        h2_frame_header(&c->out, (uint32_t)n, off ? H2_CONTINUATION : H2_HEADERS, flags, st->id);
+        buf_append(&c->out, block.data + off, n);
+        off += n;
+    } while (off < block.len);
+    buf_put(&block);
+    if (end_stream) h2_stream_close(c, st);
+}
+
+/* Runs one request through handle_request() and queues the response */
+void h2_request(H2Conn *c, uint32_t id, const Buf *req) {
+    H2Stream *st = c->goaway ? NULL : h2_stream(c, 0);
+    char path[256] = "/";
+    if (!st) { h2_rst_stream(c, id, H2_REFUSED_STREAM); return; }
+    
+    /* These keep the socket for themselves; HTTP_1_1_REQUIRED makes the client retry over HTTP/1.1 */
+    sscanf(req->data, "GET %255s", path);
+    if (strcmp(path, "/ws") == 0 || strncmp(path, "/events/", 8) == 0) { h2_rst_stream(c, id, H2_HTTP_1_1_REQUIRED); return; }
+    
+    Buf page = buf_get(RESPONSE_INITIAL);
+    metric_add(&metrics_local()->h2_streams, 1);
+    st->id = id;
+    st->window = c->initial_window;
+    st->resp = buf_get(RESPONSE_INITIAL);
+    c->open_streams++;
+    request_note.session = 0;
+    request_note.status = 0;    /* not the 101 of an upgrade */
+    request_note.bytes = 0;
+    response_capture = &st->resp;
+    handle_request(c->sock, req->data, c->ip, &page);
+    response_capture = NULL;
+    buf_put(&page);
+    h2_respond(c, st);
+}
+
+/* Sends response bodies one frame per stream per round, as far as the windows allow */
+void h2_pump(H2Conn *c) {
+    int progress = 1;
+    while (progress && c->open_streams && c->window > 0) {
+        progress = 0;
+        for (int i = 0; i < H2_MAX_STREAMS && c->window > 0; i++) {
+            H2Stream *st = &c->streams[i];
+            if (!st->id || st->window <= 0) continue;
+            size_t n = st->resp.len - st->body_off;
+            if (n > (size_t)st->window) n = (size_t)st->window;
+            if (n > (size_t)c->window) n = (size_t)c->window;
+            if (n > c->max_frame) n = c->max_frame;
+            int end = st->body_off + n == st->resp.len;
+            h2_frame_header(&c->out, (uint32_t)n, H2_DATA, end ? H2_FLAG_END_STREAM : 0, st->id);
+            buf_append(&c->out, st->resp.data + st->body_off, n);
+            st->body_off += n;
+            st->window -= (int32_t)n;
+            c->window -= (int32_t)n;
+            if (end) h2_stream_close(c, st);
+            progress = 1;
+        }
+    }
+}
+
+/* A complete header block arrived on stream id */
+int h2_headers_done(H2Conn *c, uint32_t id) {
+    int rc;
+    if (id <= c->last_stream) {
+        /* Trailers of a request we already answered */
+        return h2_decode_request(c, (const uint8_t *)c->block.data, c->block.len, NULL);
+    }
+    Buf req = buf_get(REQUEST_INITIAL);
+    c->last_stream = id;
+    rc = h2_decode_request(c, (const uint8_t *)c->block.data, c->block.len, &req);
+    if (rc == H2_PROTOCOL_ERROR) { h2_rst_stream(c, id, H2_PROTOCOL_ERROR); rc = H2_NO_ERROR; }
+    else if (rc == H2_NO_ERROR) h2_request(c, id, &req);
+    buf_put(&req);
+    return rc;
+}
+
+/* Handles one frame; returns an error code for GOAWAY, or H2_NO_ERROR */
+int h2_frame(H2Conn *c, int type, int flags, uint32_t id, const uint8_t *p, uint32_t len) {
+    if (c->block_stream && (type != H2_CONTINUATION || id != c->block_stream)) return H2_PROTOCOL_ERROR;
+    switch (type) {
+        case H2_DATA:
+            /* Request bodies are not used; hand the flow-control credit straight back */
+            if (!id) return H2_PROTOCOL_ERROR;
+            if (len) { h2_window_update(c, 0, len); if (!(flags & H2_FLAG_END_STREAM)) h2_window_update(c, id, len); }
+            return H2_NO_ERROR;
+        case H2_HEADERS: {
+            uint32_t pad = 0;
+            if (!id || !(id & 1)) return H2_PROTOCOL_ERROR;
+            if (flags & H2_FLAG_PADDED) { if (!len) return H2_PROTOCOL_ERROR; pad = *p++; len--; }
+            if (flags & H2_FLAG_PRIORITY) { if (len < 5) return H2_PROTOCOL_ERROR; p += 5; len -= 5; }
+            if (pad > len) return H2_PROTOCOL_ERROR;
+            c->block.len = 0;
+            buf_append(&c->block, (const char *)p, len - pad);
+            if (!(flags & H2_FLAG_END_HEADERS)) { c->block_stream = id; return H2_NO_ERROR; }
+            return h2_headers_done(c, id);
+        }
+        case H2_CONTINUATION:
+            if (!c->block_stream || c->block.len + len > H2_HEADER_BLOCK_MAX) return H2_PROTOCOL_ERROR;
+            buf_append(&c->block, (const char *)p, len);
+            if (!(flags & H2_FLAG_END_HEADERS)) return H2_NO_ERROR;
+            c->block_stream = 0;
+            return h2_headers_done(c, id);
+        case H2_PRIORITY:
+            return len == 5 ? H2_NO_ERROR : H2_FRAME_SIZE_ERROR;
+        case H2_RST_STREAM: {
+            H2Stream *st = id ? h2_stream(c, id) : NULL;
+            if (!id) return H2_PROTOCOL_ERROR;
+            if (len != 4) return H2_FRAME_SIZE_ERROR;
+            if (st) h2_stream_close(c, st);
+            return H2_NO_ERROR;
+        }
+        case H2_SETTINGS: {
+            int rc;
+            if (id) return H2_PROTOCOL_ERROR;
+            if (flags & H2_FLAG_ACK) return len ? H2_FRAME_SIZE_ERROR : H2_NO_ERROR;
+            if ((rc = h2_apply_settings(c, p, len)) != H2_NO_ERROR) return rc;
+            h2_frame_header(&c->out, 0, H2_SETTINGS, H2_FLAG_ACK, 0);
+            return H2_NO_ERROR;
+        }
+        case H2_PING:
+            if (id) return H2_PROTOCOL_ERROR;
+            if (len != 8) return H2_FRAME_SIZE_ERROR;
+            if (!(flags & H2_FLAG_ACK)) {
+                h2_frame_header(&c->out, 8, H2_PING, H2_FLAG_ACK, 0);
+                buf_append(&c->out, (const char *)p, 8);
+            }
+            return H2_NO_ERROR;
+        case H2_GOAWAY:
+            c->goaway = 1;
+            return H2_NO_ERROR;
+        case H2_WINDOW_UPDATE: {
+            uint32_t inc;
+            if (len != 4) return H2_FRAME_SIZE_ERROR;
+            inc = h2_get32(p) & 0x7fffffff;
+            if (!inc) return H2_PROTOCOL_ERROR;
+            if (!id) {
+                if ((int64_t)c->window + inc > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+                c->window += (int32_t)inc;
+            } else {
+                H2Stream *st = h2_stream(c, id);
+                if (st && (int64_t)st->window + inc > H2_MAX_WINDOW) { h2_rst_stream(c, id, H2_FLOW_CONTROL_ERROR); h2_stream_close(c, st); }
+                else if (st) st->window += (int32_t)inc;
+            }
+            return H2_NO_ERROR;
+        }
+        case H2_PUSH_PROMISE:
+            return H2_PROTOCOL_ERROR;
+        default:
+            return H2_NO_ERROR;     /* unknown frame types are ignored */
+    }
 }
 
-void handle_toss(GameSession *s, const char *choice) {
-    int player_head = (strcmp(choice, "head") == 0);
-    int coin = rand() % 2;
-    int won = (player_head && coin == 0) || (!player_head && coin == 1);
+int h2_flush(H2Conn *c) {
+    size_t off = 0;
+    while (off < c->out.len) {
+        ssize_t n = write(c->sock, c->out.data + off, c->out.len - off);
+        if (n <= 0) return -1;
+        off += (size_t)n;
+    }
+    c->out.len = 0;
+    return 0;
+}
+
+/* The HTTP2-Settings header is a base64url SETTINGS payload without padding */
+size_t base64url_decode(const char *in, uint8_t *out, size_t cap) {
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (; *in && *in != '='; in++) {
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        const char *pos = strchr(alphabet, *in);
+        if (!pos) return (size_t)-1;
+        acc = acc << 6 | (uint32_t)(pos - alphabet);
+        bits += 6;
+        if (bits >= 8) {
+            if (n == cap) return (size_t)-1;
+            bits -= 8;
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return n;
+}
+
+/* True for a complete GET that asks to switch to h2c (RFC 7540 3.2) */
+int h2_upgrade_requested(const char *req) {
+    char upgrade[64], settings[8];
+    return strncmp(req, "GET ", 4) == 0 && strstr(req, "\r\n\r\n") && get_header(req, "Upgrade", upgrade, sizeof(upgrade)) &&
+           strcasecmp(upgrade, "h2c") == 0 && get_header(req, "HTTP2-Settings", settings, sizeof(settings));
+}
+
+/*
+ * Serves a connection as HTTP/2 until it closes, idles out or errors.
+ * data holds the bytes already read: the preface onwards, or with upgrade
+ * set an HTTP/1.1 request asking for h2c, which becomes stream 1.
+ */
+void h2_serve(int sock, uint32_t ip, const char *data, size_t len, int upgrade) {
+    H2Conn *c = calloc(1, sizeof(H2Conn));
+    const char settings[] = { 0, H2_SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, H2_MAX_STREAMS };
+    int preface = 1, idle = 0, rc = H2_NO_ERROR;
+    if (!c) return;
     
-    if (won) {
-        s->game_phase = 2;
-        sprintf(s->message, "Coin: %s | You called: %s | YOU WON! Choose to Bat or Bowl.",
-            coin == 0 ? "HEAD" : "TAILS", player_head ? "HEAD" : "TAILS");
-    } else {
-        int comp_bats = rand() % 2;
-        s->is_batting = !comp_bats;
-        s->game_phase = 3;
-        sprintf(s->message, "Coin: %s | You called: %s | Computer won! You are %s.",
-            coin == 0 ? "HEAD" : "TAILS", player_head ? "HEAD" : "TAILS",
-            s->is_batting ? "BATTING" : "BOWLING");
+    c->sock = sock;
+    c->ip = ip;
+    c->in = buf_get(9 + H2_FRAME_MAX + 1);
+    c->out = buf_get(RESPONSE_INITIAL);
+    c->block = buf_get(REQUEST_INITIAL);
+    c->window = c->initial_window = H2_DEFAULT_WINDOW;
+    c->max_frame = H2_FRAME_MAX;
+    c->decoder.max = c->encoder.max = HPACK_TABLE_SIZE;
+    metric_add(&metrics_local()->h2_connections, 1);
+    
+    h2_frame_header(&c->out, sizeof(settings), H2_SETTINGS, 0, 0);
+    buf_append(&c->out, settings, sizeof(settings));
+    if (upgrade) {
+        const char *switching = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+        char encoded[512];
+        uint8_t decoded[384];
+        size_t n;
+        size_t head = (size_t)(strstr(data, "\r\n\r\n") + 4 - data);
+        Buf req = buf_get(head + 1);
+        buf_append(&req, data, head);
+        data += head;
+        len -= head;
+        get_header(req.data, "HTTP2-Settings", encoded, sizeof(encoded));
+        if ((n = base64url_decode(encoded, decoded, sizeof(decoded))) == (size_t)-1 || h2_apply_settings(c, decoded, n) != H2_NO_ERROR) {
+            const char *bad = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+            send_response(sock, bad, strlen(bad));
+            buf_put(&req);
+            goto done;
+        }
+        send_response(sock, switching, strlen(switching));
+        c->last_stream = 1;
+        h2_request(c, 1, &req);
+        buf_put(&req);
+    }
+    buf_append(&c->in, data, len);
+    
+    for (;;) {
+        size_t pos = 0;
+        if (preface && c->in.len >= H2_PREFACE_LEN) {
+            if (memcmp(c->in.data, H2_PREFACE, H2_PREFACE_LEN) != 0) break;
+            pos = H2_PREFACE_LEN;
+            preface = 0;
+        }
+        while (!preface && rc == H2_NO_ERROR && c->in.len - pos >= 9) {
+            const uint8_t *h = (const uint8_t *)c->in.data + pos;
+            uint32_t len = (uint32_t)h[0] << 16 | (uint32_t)h[1] << 8 | h[2];
+            if (len > H2_FRAME_MAX) { rc = H2_FRAME_SIZE_ERROR; break; }
+            if (c->in.len - pos < 9 + len) break;
+            rc = h2_frame(c, h[3], h[4], h2_get32(h + 5) & 0x7fffffff, h + 9, len);
+            pos += 9 + len;
+        }
+        memmove(c->in.data, c->in.data + pos, c->in.len - pos);
+        c->in.len -= pos;
+        
+        if (rc != H2_NO_ERROR) h2_goaway(c, rc);
+        else if (server_draining && !c->goaway) h2_goaway(c, H2_NO_ERROR);
+        else h2_pump(c);
+        if (h2_flush(c) < 0 || rc != H2_NO_ERROR || (c->goaway && !c->open_streams)) break;
+        
+        /* Wait for more frames (or window updates for blocked bodies) */
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) {
+            if (++idle >= H2_IDLE_SECS) { h2_goaway(c, H2_NO_ERROR); h2_flush(c); break; }
+            continue;
+        }
+        idle = 0;
+        ssize_t n = read(sock, c->in.data + c->in.len, c->in.cap - 1 - c->in.len);
+        if (n <= 0) break;
+        c->in.len += (size_t)n;
     }
+done:
+    for (int i = 0; i < H2_MAX_STREAMS; i++) buf_put(&c->streams[i].resp);
+    hpack_set_max(&c->decoder, 0);
+    hpack_set_max(&c->encoder, 0);
+    buf_put(&c->in);
+    buf_put(&c->out);
+    buf_put(&c->block);
+    free(c);
 }
 
-void handle_choose(GameSession *s, const char *choice) {
-    s->is_batting = (strcmp(choice, "bat") == 0);
-    s->game_phase = 3;
-    sprintf(s->message, "You chose to %s first. Pick a number!", s->is_batting ? "BAT" : "BOWL");
+/* ==================== SESSION SNAPSHOTS ==================== */
+/*
+ * The session table is periodically packed into a staging buffer while
+ * holding sessions_mutex (a few microseconds of memcpy; with --cores each
+ * range is packed on its owner, see owners_each), then written to
+ * FILE.tmp and renamed over FILE with the lock released, so gameplay never
+ * waits on disk. On startup the file is mmapped and live sessions restored.
+ */
+#define SNAPSHOT_MAGIC 0x53534348u /* "HCSS" */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MESSAGE_LEN 128   /* status lines are short; a longer message is cut here on restore */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t count;
+    int64_t saved_at;
+} SnapshotHeader;
+
+typedef struct {
+    char session_id[32];
+    int64_t last_activity;
+    int32_t player_score;
+    int32_t computer_score;
+    int32_t first_innings_score;
+    uint8_t difficulty;
+    uint8_t game_phase;
+    uint8_t is_batting;
+    uint8_t second_innings;
+    uint8_t move_count;
+    uint8_t same_choice_count;
+    uint8_t is_out;
+    int8_t last_player_input;
+    int8_t last_computer_move;
+    uint8_t prev_moves[100];
+    char message[SNAPSHOT_MESSAGE_LEN];
+} __attribute__((packed)) SnapshotRecord;
+
+const char *snapshot_path = NULL;
+int snapshot_interval = 30;
+SnapshotRecord snapshot_staging[MAX_SESSIONS];
+
+void pack_session(SnapshotRecord *r, const GameSession *s) {
+    memset(r, 0, sizeof(*r));
+    memcpy(r->session_id, s->session_id, strnlen(s->session_id, sizeof(r->session_id) - 1));
+    r->last_activity = s->last_activity;
+    r->player_score = s->player_score;
+    r->computer_score = s->computer_score;
+    r->first_innings_score = s->first_innings_score;
+    r->difficulty = (uint8_t)s->difficulty;
+    r->game_phase = (uint8_t)s->game_phase;
+    r->is_batting = (uint8_t)s->is_batting;
+    r->second_innings = (uint8_t)s->second_innings;
+    r->move_count = (uint8_t)s->move_count;
+    r->same_choice_count = (uint8_t)s->same_choice_count;
+    r->is_out = (uint8_t)s->is_out;
+    r->last_player_input = (int8_t)s->last_player_input;
+    r->last_computer_move = (int8_t)s->last_computer_move;
+    for (int i = 0; i < s->move_count && i < 100; i++) r->prev_moves[i] = (uint8_t)s->prev_moves[i];
+    memcpy(r->message, s->message, strnlen(s->message, sizeof(r->message) - 1));
 }
 
-void handle_play(GameSession *s, int num) {
-    int comp = generate_computer_move(s);
-    s->last_player_input = num;
-    s->last_computer_move = comp;
+void unpack_session(GameSession *s, const SnapshotRecord *r) {
+    memset(s, 0, sizeof(*s));
+    memcpy(s->session_id, r->session_id, sizeof(r->session_id));
+    s->session_id[sizeof(r->session_id) - 1] = '\0';
+    s->last_activity = (time_t)r->last_activity;
+    s->player_score = r->player_score;
+    s->computer_score = r->computer_score;
+    s->first_innings_score = r->first_innings_score;
+    s->difficulty = r->difficulty;
+    s->game_phase = r->game_phase;
+    s->is_batting = r->is_batting;
+    s->second_innings = r->second_innings;
+    s->move_count = r->move_count > 100 ? 100 : r->move_count;
+    s->same_choice_count = r->same_choice_count;
+    s->is_out = r->is_out;
+    s->last_player_input = r->last_player_input;
+    s->last_computer_move = r->last_computer_move;
+    for (int i = 0; i < s->move_count; i++) s->prev_moves[i] = r->prev_moves[i] % 11;
+    memcpy(s->message, r->message, sizeof(r->message));
+    s->message[sizeof(r->message) - 1] = '\0';
+}
+
+/* Packs the live sessions in [lo, hi) after those already staged; h->saved_at is the time they are judged by */
+void snapshot_pack_range(int lo, int hi, void *arg) {
+    SnapshotHeader *h = arg;
+    sessions_lock();
+    for (int i = lo; i < hi; i++) {
+        if (sessions[i].session_id[0] == '\0' || h->saved_at - sessions[i].last_activity > SESSION_TTL) continue;
+        pack_session(&snapshot_staging[h->count++], &sessions[i]);
+    }
+    sessions_unlock();
+}
+
+/* Returns the number of sessions written, or -1 on error */
+int save_snapshot(void) {
+    SnapshotHeader h = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, sizeof(SnapshotRecord), 0, 0 };
+    char tmp[1024];
     
-    if (s->move_count > 0 && num == s->prev_moves[s->move_count - 1])
-        s->same_choice_count++;
-    else
-        s->same_choice_count = 1;
+    h.saved_at = time(NULL);
+    owners_each(snapshot_pack_range, &h);
     
-    if (s->move_count < 100) s->prev_moves[s->move_count++] = num;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", snapshot_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    size_t len = h.count * sizeof(SnapshotRecord);
+    int ok = write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+             write(fd, snapshot_staging, len) == (ssize_t)len &&
+             fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp, snapshot_path) != 0) { unlink(tmp); return -1; }
+    return (int)h.count;
+}
+
+/* Restores live sessions from the snapshot file; returns how many */
+int load_snapshot(void) {
+    int fd = open(snapshot_path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) { close(fd); return 0; }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
     
-    if (s->same_choice_count >= 5 && s->is_batting) {
-        sprintf(s->message, "Same number 5 times! YOU'RE OUT!");
-        s->is_out = 1;
-    } else if (num == comp) {
-        s->is_out = 1;
-        sprintf(s->message, "OUT! Both picked %d! %s out!", num, s->is_batting ? "You're" : "Computer is");
+    const SnapshotHeader *h = map;
+    const SnapshotRecord *rec = (const SnapshotRecord *)(h + 1);
+    int restored = 0;
+    time_t now = time(NULL);
+    if (h->magic == SNAPSHOT_MAGIC && h->version == SNAPSHOT_VERSION &&
+        h->record_size == sizeof(SnapshotRecord) &&
+        sizeof(*h) + (size_t)h->count * sizeof(SnapshotRecord) <= (size_t)st.st_size) {
+        for (uint32_t i = 0; i < h->count && restored < MAX_SESSIONS; i++) {
+            if (rec[i].session_id[0] == '\0' || now - rec[i].last_activity > SESSION_TTL) continue;
+            unpack_session(&sessions[restored++], &rec[i]);
+        }
     } else {
-        s->is_out = 0;
-        if (s->is_batting) {
-            int runs = (num == 0) ? comp : num;
-            s->player_score += runs;
-            sprintf(s->message, "You: %d | Computer: %d | +%d runs!", num, comp, runs);
-            if (s->second_innings && s->player_score > s->first_innings_score) {
-                s->game_phase = 4;
-                strcpy(s->message, "You chased the target! YOU WIN!");
-            }
-        } else {
-            s->computer_score += comp;
-            sprintf(s->message, "You: %d | Computer: %d | Computer +%d", num, comp, comp);
-            if (s->second_innings && s->computer_score > s->first_innings_score) {
-                s->game_phase = 4;
-                strcpy(s->message, "Computer chased the target! You lost.");
-            }
+        fprintf(stderr, "Ignoring snapshot %s: unrecognised format\n", snapshot_path);
+    }
+    munmap(map, st.st_size);
+    return restored;
+}
+
+void *snapshot_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep(snapshot_interval);
+        if (save_snapshot() < 0) perror("snapshot");
+    }
+    return NULL;
+}
+
+/* Writes out what is still only in memory: pending profile balls and the queued log and capture records */
+void flush_on_exit(void) {
+    if (profile_map) owners_each(profile_flush_range, NULL);
+    if (match_log_fd >= 0) {
+        owners_each(owner_push_range, NULL);
+        matchlog_flush();
+    }
+    if (access_log_fd >= 0) access_log_flush();
+    if (capture_fd >= 0) capture_flush();
+}
+
+/* Takes a final snapshot and flushes the logs on Ctrl+C / SIGTERM */
+void *shutdown_thread(void *arg) {
+    sigset_t *set = arg;
+    int sig;
+    sigwait(set, &sig);
+    if (snapshot_path) {
+        int n = save_snapshot();
+        if (n >= 0) printf("Saved %d session(s) to %s\n", n, snapshot_path);
+        else perror("snapshot");
+    }
+    flush_on_exit();
+    exit(0);
+    return NULL;
+}
+
+typedef struct {
+    int sock;
+    uint32_t ip;    /* client IPv4 address, network byte order */
+} Conn;
+
+void *client_thread(void *arg) {
+    Conn conn = *(Conn*)arg;
+    free(arg);
+    Buf req = buf_get(REQUEST_INITIAL), resp = buf_get(RESPONSE_INITIAL);
+    ssize_t n;
+    int kept = 0;
+    /* One read as before; keep reading only while a full buffer has no end of headers yet */
+    while ((n = read(conn.sock, req.data + req.len, req.cap - 1 - req.len)) > 0) {
+        req.len += (size_t)n;
+        req.data[req.len] = '\0';
+        if (req.len + 1 < req.cap || strstr(req.data, "\r\n\r\n") || req.cap >= REQUEST_MAX) break;
+        buf_grow(&req, req.cap * 2);
+    }
+    if (req.len >= 16 && memcmp(req.data, H2_PREFACE, 16) == 0) h2_serve(conn.sock, conn.ip, req.data, req.len, 0);
+    else if (h2_upgrade_requested(req.data)) h2_serve(conn.sock, conn.ip, req.data, req.len, 1);
+    else if (req.len) kept = handle_request(conn.sock, req.data, conn.ip, &resp);
+    if (!kept) close(conn.sock);
+    buf_put(&req);
+    buf_put(&resp);
+    release_connection();
+    return NULL;
+}
+
+/* ==================== SESSION SPILL ==================== */
+/*
+ * With --spill FILE the session table is only the hot tier. Sessions idle
+ * for --spill-idle seconds, and the least recently used idle one whenever
+ * the table is full, are packed into a slot of a slab file mapped with
+ * MAP_SHARED, and their table slot is freed. A find_session() miss looks
+ * the cookie up in the slab index, so a returning player is faulted back
+ * in on their next request. Sessions without a match started have
+ * nothing to resume and are dropped instead of spilled.
+ *
+ * The slab is a header and an array of SnapshotRecord slots; free slots
+ * are chained through the file and it doubles when the chain runs out.
+ * The index (session key -> slot) is an open-addressing table in memory,
+ * rebuilt from the slab at startup along with the free chain, so paused
+ * matches survive restarts and a crash mid-write cannot corrupt the list.
+ * Every slab access happens under sessions_mutex. During a live upgrade
+ * the old process stops using the slab before the successor maps it.
+ */
+#define SPILL_MAGIC "HCSPILL"
+#define SPILL_VERSION 1
+#define SPILL_INITIAL_SLOTS 1024
+#define SPILL_SCAN_SECS 10
+#define SPILL_MIN_IDLE (WS_IDLE_SECONDS + 60)  /* no WebSocket can still be holding the session */
+#define DEFAULT_SPILL_IDLE 900
+#define SPILL_TTL (30 * 24 * 3600)              /* paused matches are kept for 30 days */
+#define SPILL_EXPIRE_BATCH 4096                 /* slab slots checked for expiry per scan */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;      /* slots after the header */
+    uint32_t free_head;     /* first free slot + 1, 0 when none */
+} SpillHeader;
+
+typedef struct {
+    uint32_t next_free;     /* next free slot + 1 while this one is free */
+    SnapshotRecord rec;     /* session_id[0] == '\0' while free */
+} __attribute__((packed)) SpillSlot;
+
+typedef struct {
+    uint64_t key;           /* matchlog_key() of the session id */
+    uint32_t slot;          /* slab slot + 1, 0 = empty */
+} SpillIndexEntry;
+
+const char *spill_path = NULL;
+int spill_idle = DEFAULT_SPILL_IDLE;
+int spill_fd = -1;
+int spill_suspended = 0;            /* a successor process owns the slab */
+SpillHeader *spill_map = NULL;
+size_t spill_map_size = 0;
+SpillIndexEntry *spill_index = NULL;
+uint64_t spill_index_mask = 0;
+uint64_t spill_count = 0;           /* sessions on disk */
+
+SpillSlot* spill_slot(uint32_t i) {
+    return (SpillSlot *)(spill_map + 1) + i;
+}
+
+/* The index entry for sid, or the empty entry where it would go */
+SpillIndexEntry* spill_index_find(const char *sid) {
+    uint64_t key = matchlog_key(sid), i = (key * 0x9E3779B97F4A7C15ull) & spill_index_mask;
+    while (spill_index[i].slot) {
+        if (spill_index[i].key == key && strcmp(spill_slot(spill_index[i].slot - 1)->rec.session_id, sid) == 0) break;
+        i = (i + 1) & spill_index_mask;
+    }
+    return &spill_index[i];
+}
+
+int spill_index_resize(uint64_t entries) {
+    SpillIndexEntry *old = spill_index;
+    uint64_t old_mask = spill_index_mask;
+    if (!(spill_index = calloc(entries, sizeof(SpillIndexEntry)))) { spill_index = old; return -1; }
+    spill_index_mask = entries - 1;
+    for (uint64_t i = 0; old && i <= old_mask; i++)
+        if (old[i].slot) *spill_index_find(spill_slot(old[i].slot - 1)->rec.session_id) = old[i];
+    free(old);
+    return 0;
+}
+
+/* Backward-shift deletion keeps every probe chain unbroken */
+void spill_index_remove(SpillIndexEntry *e) {
+    uint64_t hole = (uint64_t)(e - spill_index), i = hole;
+    for (;;) {
+        i = (i + 1) & spill_index_mask;
+        if (!spill_index[i].slot) break;
+        uint64_t home = (spill_index[i].key * 0x9E3779B97F4A7C15ull) & spill_index_mask;
+        if (((i - home) & spill_index_mask) >= ((i - hole) & spill_index_mask)) {
+            spill_index[hole] = spill_index[i];
+            hole = i;
         }
     }
+    spill_index[hole].slot = 0;
+}
+
+void spill_free_slot(uint32_t i) {
+    SpillSlot *slot = spill_slot(i);
+    memset(&slot->rec, 0, sizeof(slot->rec));
+    slot->next_free = spill_map->free_head;
+    spill_map->free_head = i + 1;
+}
+
+/* Doubles the slab; the new slots join the free chain */
+int spill_grow(void) {
+    uint32_t old = spill_map->capacity, cap = old ? old * 2 : SPILL_INITIAL_SLOTS;
+    size_t size = sizeof(SpillHeader) + (size_t)cap * sizeof(SpillSlot);
+    if (ftruncate(spill_fd, (off_t)size) != 0) return -1;
+    void *map = mremap(spill_map, spill_map_size, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) return -1;
+    spill_map = map;
+    spill_map_size = size;
+    spill_map->capacity = cap;
+    for (uint32_t i = cap; i > old; i--) spill_free_slot(i - 1);
+    return 0;
+}
+
+/* Writes a session to the slab; it is then on disk only once the caller frees its table slot */
+int spill_store(const GameSession *s) {
+    if ((spill_count + 1) * 4 > (spill_index_mask + 1) * 3 && spill_index_resize((spill_index_mask + 1) * 2) < 0) return -1;
+    if (!spill_map->free_head && spill_grow() < 0) return -1;
+    uint32_t i = spill_map->free_head - 1;
+    SpillSlot *slot = spill_slot(i);
+    spill_map->free_head = slot->next_free;
+    slot->next_free = 0;
+    pack_session(&slot->rec, s);
+    SpillIndexEntry *e = spill_index_find(slot->rec.session_id);
+    if (e->slot) spill_free_slot(e->slot - 1);  /* an older copy of the same session */
+    else spill_count++;
+    e->key = matchlog_key(slot->rec.session_id);
+    e->slot = i + 1;
+    return 0;
+}
+
+/* Frees table slot i, keeping a started match on disk */
+int spill_evict(int i) {
+    profile_merge_locked(&sessions[i]);
+    if (sessions[i].game_phase != 0) {
+        if (spill_store(&sessions[i]) < 0) return -1;
+        metric_add(&metrics_local()->sessions_spilled, 1);
+    }
+    memset(&sessions[i], 0, sizeof(GameSession));
+    return i;
+}
+
+int spill_evict_lru(time_t now) {
+    int lru = -1, lo, hi;
+    if (spill_fd < 0 || spill_suspended) return -1;
+    session_range(&lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        if (now - sessions[i].last_activity < SPILL_MIN_IDLE || sessions[i].pvp_match) continue;
+        if (lru < 0 || sessions[i].last_activity < sessions[lru].last_activity) lru = i;
+    }
+    return lru >= 0 ? spill_evict(lru) : -1;
+}
+
+int spill_holds(const char *sid) {
+    return spill_fd >= 0 && !spill_suspended && spill_index_find(sid)->slot != 0;
+}
+
+/* Moves a spilled session back into the table; returns its slot or -1 */
+int spill_fault_in(const char *sid, time_t now) {
+    if (!valid_session_id(sid) || !spill_holds(sid)) return -1;
+    int i = session_free_slot(now);
+    if (i < 0) return -1;
+    SpillIndexEntry *e = spill_index_find(sid);    /* making room may have moved it */
+    uint32_t slot = e->slot - 1;
+    unpack_session(&sessions[i], &spill_slot(slot)->rec);
+    spill_index_remove(e);
+    spill_free_slot(slot);
+    spill_count--;
+    metric_add(&metrics_local()->sessions_faulted_in, 1);
+    return i;
+}
+
+/* Frees slab slots of matches paused longer than SPILL_TTL, a batch at a time; returns the next cursor */
+uint32_t spill_expire(uint32_t cursor, time_t now) {
+    for (int n = 0; n < SPILL_EXPIRE_BATCH && spill_map->capacity; n++, cursor++) {
+        if (cursor >= spill_map->capacity) cursor = 0;
+        SnapshotRecord *r = &spill_slot(cursor)->rec;
+        if (r->session_id[0] == '\0' || now - r->last_activity <= SPILL_TTL) continue;
+        SpillIndexEntry *e = spill_index_find(r->session_id);
+        if (e->slot == cursor + 1) spill_index_remove(e);
+        spill_free_slot(cursor);
+        spill_count--;
+    }
+    return cursor;
+}
+
+/*
+ * Rebuilds the index and free chain from the slab, following the file if
+ * another process grew it. Called with sessions_mutex held.
+ */
+int spill_reindex(void) {
+    struct stat st;
+    SpillHeader *sh = spill_map;
+    if (fstat(spill_fd, &st) != 0) return -1;
+    if ((size_t)st.st_size != spill_map_size) {
+        void *map = mremap(spill_map, spill_map_size, st.st_size, MREMAP_MAYMOVE);
+        if (map == MAP_FAILED) return -1;
+        spill_map = sh = map;
+        spill_map_size = (size_t)st.st_size;
+    }
+    if (sizeof(SpillHeader) + (size_t)sh->capacity * sizeof(SpillSlot) > spill_map_size) return -1;
     
-    if (s->is_out && s->game_phase != 4) {
-        if (!s->second_innings) {
-            s->second_innings = 1;
-            s->first_innings_score = s->is_batting ? s->player_score : s->computer_score;
-            s->is_batting = !s->is_batting;
-            s->is_out = 0;
-            s->same_choice_count = 0;
-            s->move_count = 0;
-            sprintf(s->message, "Innings over! %s Target: %d",
-                s->is_batting ? "Now BATTING!" : "Now BOWLING!",
-                s->first_innings_score + 1);
-        } else {
-            s->game_phase = 4;
+    uint64_t entries = 1024;
+    while (entries < (uint64_t)sh->capacity * 2) entries <<= 1;
+    free(spill_index);
+    spill_index = NULL;
+    spill_count = 0;
+    if (spill_index_resize(entries) < 0) return -1;
+    
+    time_t now = time(NULL);
+    sh->free_head = 0;
+    for (uint32_t i = sh->capacity; i > 0; i--) {
+        SnapshotRecord *r = &spill_slot(i - 1)->rec;
+        r->session_id[sizeof(r->session_id) - 1] = '\0';
+        if (r->session_id[0] == '\0' || now - r->last_activity > SPILL_TTL || !valid_session_id(r->session_id)) {
+            spill_free_slot(i - 1);
+            continue;
         }
+        SpillIndexEntry *e = spill_index_find(r->session_id);
+        if (e->slot) {
+            /* Two copies after a crash: keep the newer */
+            if (spill_slot(e->slot - 1)->rec.last_activity >= r->last_activity) { spill_free_slot(i - 1); continue; }
+            spill_free_slot(e->slot - 1);
+        } else spill_count++;
+        e->key = matchlog_key(r->session_id);
+        e->slot = i;
+    }
+    /* A session both in the table (restored from a snapshot) and on disk: the newer copy wins */
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (sessions[i].session_id[0] == '\0') continue;
+        SpillIndexEntry *e = spill_index_find(sessions[i].session_id);
+        if (!e->slot) continue;
+        uint32_t slot = e->slot - 1;
+        if (spill_slot(slot)->rec.last_activity > sessions[i].last_activity) unpack_session(&sessions[i], &spill_slot(slot)->rec);
+        spill_index_remove(e);
+        spill_free_slot(slot);
+        spill_count--;
     }
+    return 0;
 }
 
-void handle_request(int sock, const char *req) {
-    char resp[BUFFER_SIZE];
-    char *sid = get_session_cookie(req);
-    GameSession *s = sid ? find_session(sid) : NULL;
-    if (!s) s = create_session();
-    if (!s) { write(sock, "HTTP/1.1 500 Error\r\n\r\n", 22); return; }
+/* Maps the slab; returns the number of paused sessions or -1 */
+int spill_open(void) {
+    struct stat st;
+    SpillHeader h;
+    int fd = open(spill_path, O_RDWR | O_CREAT, 0644), rc;
+    if (fd < 0 || fstat(fd, &st) != 0) { if (fd >= 0) close(fd); return -1; }
+    if (st.st_size == 0) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SPILL_MAGIC, sizeof(SPILL_MAGIC));
+        h.version = SPILL_VERSION;
+        h.slot_size = sizeof(SpillSlot);
+        if (pwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) { close(fd); return -1; }
+        st.st_size = sizeof(h);
+    }
+    void *map = (size_t)st.st_size >= sizeof(h) ? mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    SpillHeader *sh = map;
+    if (map == MAP_FAILED || memcmp(sh->magic, SPILL_MAGIC, sizeof(SPILL_MAGIC)) != 0 ||
+        sh->version != SPILL_VERSION || sh->slot_size != sizeof(SpillSlot)) {
+        if (map != MAP_FAILED) munmap(map, st.st_size);
+        close(fd);
+        return -1;
+    }
+    spill_fd = fd;
+    spill_map = sh;
+    spill_map_size = (size_t)st.st_size;
+    sessions_lock();
+    rc = spill_reindex();
+    sessions_unlock();
+    if (rc < 0) { munmap(spill_map, spill_map_size); close(spill_fd); spill_fd = -1; return -1; }
+    return (int)spill_count;
+}
+
+/* Spills sessions idle for spill_idle seconds among slots lo..hi-1 */
+void spill_idle_sessions(int lo, int hi) {
+    if (spill_fd < 0) return;
+    sessions_lock();
+    if (!spill_suspended) {
+        time_t now = time(NULL);
+        for (int i = lo; i < hi; i++) {
+            if (sessions[i].session_id[0] == '\0' || now - sessions[i].last_activity < spill_idle || sessions[i].pvp_match) continue;
+            spill_evict(i);
+        }
+    }
+    sessions_unlock();
+}
+
+void *spill_thread(void *arg) {
+    uint32_t cursor = 0;
+    (void)arg;
+    while (1) {
+        sleep(SPILL_SCAN_SECS);
+        /* With --cores each owner spills its own range */
+        if (!owner_count) spill_idle_sessions(0, MAX_SESSIONS);
+        sessions_lock();
+        if (!spill_suspended) cursor = spill_expire(cursor, time(NULL));
+        sessions_unlock();
+    }
+    return NULL;
+}
+
+/* ==================== LIVE UPGRADE ==================== */
+/*
+ * Sessions live in a memfd mapping guarded by a process-shared robust
+ * mutex. On SIGUSR2 the server re-executes the binary at the path it was
+ * started from (so a newly installed file is picked up), handing down the
+ * listening socket, the memfd and a readiness pipe as fds 3, 4 and 5. The
+ * new process maps the same sessions, takes over the leaderboard the old
+ * one left in the mapping, starts accepting on the same socket and writes
+ * a byte to the pipe. Only then does the old process stop accepting; it
+ * finishes its in-flight connections for up to UPGRADE_DRAIN_SECS,
+ * flushes its logs and exits. The listening socket stays open throughout,
+ * so no client is refused, and sessions never leave memory. If the new
+ * binary fails to start, the pipe closes without a byte and the old
+ * process carries on serving. From the fork until the old process exits,
+ * the mapping records its pid and both processes run session work under
+ * the shared mutex, since either may touch any slot (see SESSION OWNERS).
+ * The new process clears it once its parent, the old one, is gone.
+ */
+#define UPGRADE_MAGIC "HCSHARE"
+#define UPGRADE_VERSION 2
+#define UPGRADE_ENV "HANDCRICKET_UPGRADE"
+#define UPGRADE_LISTEN_FD 3
+#define UPGRADE_SHARED_FD 4
+#define UPGRADE_READY_FD 5
+#define UPGRADE_READY_SECS 10
+#define UPGRADE_DRAIN_SECS 30
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t session_size;      /* layout of the binary that created it; a successor must match */
+    uint32_t max_sessions;
+    uint32_t board_size;
+    uint32_t board_valid;       /* board holds the outgoing process's leaderboard */
+    int32_t handover_pid;       /* the outgoing process from its fork until it exits, else 0 */
+    pthread_mutex_t lock;       /* sessions_mutex */
+    Leaderboard board;
+} __attribute__((aligned(64))) SharedState;
+
+SharedState *shared_state = NULL;
+int shared_fd = -1;
+int listen_fd = -1;
+int upgrade_wake[2] = {-1, -1};     /* readable once the accept loop should stop */
+char upgrade_exe[4096];
+char **upgrade_argv = NULL;
+
+size_t shared_size(void) {
+    return sizeof(SharedState) + MAX_SESSIONS * sizeof(GameSession);
+}
+
+int shared_layout_ok(const SharedState *st) {
+    return memcmp(st->magic, UPGRADE_MAGIC, sizeof(UPGRADE_MAGIC)) == 0 && st->version == UPGRADE_VERSION &&
+           st->session_size == sizeof(GameSession) && st->max_sessions == MAX_SESSIONS &&
+           st->board_size == sizeof(Leaderboard);
+}
+
+/*
+ * Moves the session table into shared memory: the predecessor's when this
+ * process was started by an upgrade, otherwise a new memfd. Returns 1 if
+ * sessions were inherited, 0 if not, -1 if no shared memory is available
+ * (the server then runs on local_sessions and cannot be upgraded live).
+ */
+int shared_init(int upgraded) {
+    size_t size = shared_size();
+    struct stat st;
+    void *map;
     
-    char path[256] = "/";
-    sscanf(req, "GET %255s", path);
+    if (upgraded && fstat(UPGRADE_SHARED_FD, &st) == 0 && (size_t)st.st_size == size &&
+        (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, UPGRADE_SHARED_FD, 0)) != MAP_FAILED) {
+        if (shared_layout_ok(map)) {
+            shared_state = map;
+            shared_fd = UPGRADE_SHARED_FD;
+            sessions = (GameSession *)(shared_state + 1);
+            sessions_mutex = &shared_state->lock;
+            /* Runs before leaderboard_thread starts, so the board can be taken over directly */
+            if (__atomic_load_n(&shared_state->board_valid, __ATOMIC_ACQUIRE)) {
+                leader_global = shared_state->board;
+                leader_published = leader_global;
+                __atomic_store_n(&shared_state->board_valid, 0, __ATOMIC_RELEASE);
+            }
+            return 1;
+        }
+        munmap(map, size);
+    }
+    if (upgraded) {
+        fprintf(stderr, "Upgrade: the previous process has a different session layout; not taking over its sessions\n");
+        close(UPGRADE_SHARED_FD);
+    }
     
-    if (strcmp(path, "/") == 0) {
-        s->game_phase = 0;
-        build_page_menu(resp, s);
+    int fd = memfd_create("handcricket-sessions", 0);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)size) != 0 ||
+        (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return -1;
     }
-    else if (strcmp(path, "/help") == 0) build_page_help(resp, s);
-    else if (strcmp(path, "/start") == 0) { reset_game(s); build_page_toss(resp, s); }
-    else if (strcmp(path, "/reset") == 0) { s->game_phase = 0; strcpy(s->message, "Game reset!"); build_page_menu(resp, s); }
-    else if (strncmp(path, "/diff/", 6) == 0) {
-        int d = atoi(path + 6);
-        if (d >= 1 && d <= 3) { s->difficulty = d; sprintf(s->message, "Difficulty: %s", d==1?"Easy":d==2?"Medium":"Hard"); }
-        build_page_menu(resp, s);
+    pthread_mutexattr_t attr;
+    shared_state = map;
+    memcpy(shared_state->magic, UPGRADE_MAGIC, sizeof(UPGRADE_MAGIC));
+    shared_state->version = UPGRADE_VERSION;
+    shared_state->session_size = sizeof(GameSession);
+    shared_state->max_sessions = MAX_SESSIONS;
+    shared_state->board_size = sizeof(Leaderboard);
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared_state->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    shared_fd = fd;
+    sessions = (GameSession *)(shared_state + 1);
+    sessions_mutex = &shared_state->lock;
+    return 0;
+}
+
+/* 1 while an outgoing process still shares the session table with its successor */
+int upgrade_handover(void) {
+    int32_t pid = shared_state ? __atomic_load_n(&shared_state->handover_pid, __ATOMIC_ACQUIRE) : 0;
+    if (!pid) return 0;
+    if (pid == getpid() || pid == getppid()) return 1;
+    /* Re-parented: the old process has exited */
+    __atomic_compare_exchange_n(&shared_state->handover_pid, &pid, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Starts the successor; returns 0 once it is accepting connections */
+int upgrade_start(void) {
+    extern char **environ;
+    int ready[2], n = 0;
+    char ok = 0;
+    
+    if (!shared_state || listen_fd < 0) {
+        fprintf(stderr, "Upgrade: not available (no shared memory for sessions)\n");
+        return -1;
     }
-    else if (strncmp(path, "/toss/", 6) == 0) {
-        handle_toss(s, path + 6);
-        if (s->game_phase == 2) build_page_choose(resp, s);
-        else build_page_game(resp, s);
+    leaderboard_read(&shared_state->board);
+    __atomic_store_n(&shared_state->board_valid, 1, __ATOMIC_RELEASE);
+    /* The successor indexes the spill slab itself; this process must not touch it meanwhile */
+    sessions_lock();
+    spill_suspended = 1;
+    sessions_unlock();
+    
+    /* Everything the child needs is prepared before fork: it may only exec */
+    while (environ[n]) n++;
+    char **env = malloc((n + 2) * sizeof(char *));
+    if (!env || pipe(ready) != 0) { free(env); return -1; }
+    n = 0;
+    for (char **e = environ; *e; e++)
+        if (strncmp(*e, UPGRADE_ENV "=", sizeof(UPGRADE_ENV)) != 0) env[n++] = *e;
+    env[n++] = UPGRADE_ENV "=1";
+    env[n] = NULL;
+    
+    __atomic_store_n(&shared_state->handover_pid, (int32_t)getpid(), __ATOMIC_RELEASE);
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);  /* this thread blocks the signals main hands out */
+        int l = fcntl(listen_fd, F_DUPFD, 10), m = fcntl(shared_fd, F_DUPFD, 10), r = fcntl(ready[1], F_DUPFD, 10);
+        dup2(l, UPGRADE_LISTEN_FD);
+        dup2(m, UPGRADE_SHARED_FD);
+        dup2(r, UPGRADE_READY_FD);
+        if (syscall(SYS_close_range, UPGRADE_READY_FD + 1, ~0U, 0) != 0)
+            for (int fd = UPGRADE_READY_FD + 1; fd < 65536; fd++) close(fd);
+        execve(upgrade_exe, upgrade_argv, env);
+        _exit(127);
     }
-    else if (strncmp(path, "/choose/", 8) == 0) { handle_choose(s, path + 8); build_page_game(resp, s); }
-    else if (strncmp(path, "/play/", 6) == 0) {
-        int n = atoi(path + 6);
-        if (n >= 0 && n <= 10) handle_play(s, n);
-        if (s->game_phase == 4) build_page_gameover(resp, s);
-        else build_page_game(resp, s);
+    close(ready[1]);
+    free(env);
+    if (pid < 0) {
+        __atomic_store_n(&shared_state->handover_pid, 0, __ATOMIC_RELEASE);
+        close(ready[0]);
+        return -1;
     }
-    else build_page_menu(resp, s);
     
-    write(sock, resp, strlen(resp));
+    struct pollfd pfd = { ready[0], POLLIN, 0 };
+    if (poll(&pfd, 1, UPGRADE_READY_SECS * 1000) == 1 && read(ready[0], &ok, 1) != 1) ok = 0;
+    close(ready[0]);
+    if (ok) {
+        printf("Upgrade: process %d is serving; draining this one\n", (int)pid);
+        fflush(stdout);
+        return 0;
+    }
+    fprintf(stderr, "Upgrade: %s did not start; still serving\n", upgrade_exe);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    __atomic_store_n(&shared_state->handover_pid, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&shared_state->board_valid, 0, __ATOMIC_RELEASE);
+    sessions_lock();
+    spill_suspended = 0;
+    if (spill_fd >= 0 && spill_reindex() < 0) { fprintf(stderr, "Upgrade: spill slab unusable; no longer spilling\n"); spill_suspended = 1; }
+    sessions_unlock();
+    return -1;
 }
 
-void *client_thread(void *arg) {
-    int sock = *(int*)arg;
-    free(arg);
-    char buf[BUFFER_SIZE];
-    ssize_t n = read(sock, buf, BUFFER_SIZE - 1);
-    if (n > 0) { buf[n] = '\0'; handle_request(sock, buf); }
-    close(sock);
+void *upgrade_thread(void *arg) {
+    sigset_t *set = arg;
+    int sig;
+    do sigwait(set, &sig); while (upgrade_start() != 0);
+    if (write(upgrade_wake[1], "", 1) != 1) exit(0);
     return NULL;
 }
 
-int main(void) {
-    int server_fd;
+/* In the new process, once it is ready to accept: lets the predecessor start draining */
+void upgrade_ready(void) {
+    if (write(UPGRADE_READY_FD, "1", 1) != 1) perror("upgrade");
+    close(UPGRADE_READY_FD);
+}
+
+/* In the old process, once the successor is accepting */
+void upgrade_drain(void) {
+    time_t deadline = time(NULL) + UPGRADE_DRAIN_SECS;
+    close(listen_fd);
+    server_draining = 1;
+    while (__atomic_load_n(&active_connections, __ATOMIC_RELAXED) > 0 && time(NULL) < deadline) usleep(50000);
+    flush_on_exit();     /* the sessions live on in the successor; no snapshot from here */
+    printf("Upgrade: drained, exiting\n");
+    exit(0);
+}
+
+#ifndef HANDCRICKET_NO_MAIN
+int main(int argc, char **argv) {
     struct sockaddr_in addr;
+    unsigned int seed = 0;
+    int restored = 0, spilled = 0, inherited = 0, cores = 0, upgraded = getenv(UPGRADE_ENV) != NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) snapshot_path = argv[++i];
+        else if (strcmp(argv[i], "--snapshot-interval") == 0 && i + 1 < argc) snapshot_interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--match-log") == 0 && i + 1 < argc) match_log_path = argv[++i];
+        else if (strcmp(argv[i], "--rate-limit") == 0 && i + 1 < argc) ip_rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-connections") == 0 && i + 1 < argc) max_connections = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--strategy") == 0 && i + 1 < argc) strategy_path = argv[++i];
+        else if (strcmp(argv[i], "--access-log") == 0 && i + 1 < argc) access_log_path = argv[++i];
+        else if (strcmp(argv[i], "--access-log-max-mb") == 0 && i + 1 < argc) access_log_max_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spill") == 0 && i + 1 < argc) spill_path = argv[++i];
+        else if (strcmp(argv[i], "--spill-idle") == 0 && i + 1 < argc) spill_idle = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profiles") == 0 && i + 1 < argc) profile_path = argv[++i];
+        else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) cores = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) capture_path = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "Usage: %s [--snapshot FILE] [--snapshot-interval SECS] [--match-log FILE]\n"
+                            "       [--rate-limit REQS_PER_SEC (0 = off)] [--max-connections N] [--strategy FILE]\n"
+                            "       [--access-log FILE] [--access-log-max-mb N (0 = never rotate)]\n"
+                            "       [--spill FILE] [--spill-idle SECS] [--profiles FILE] [--cores N]\n"
+                            "       [--capture FILE] [--seed N (fixed RNG seed, for replays)]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (snapshot_interval < 1) snapshot_interval = 1;
+    if (ip_rate < 0) ip_rate = 0;
+    if (max_connections < 1) max_connections = 1;
+    if (access_log_max_mb < 0) access_log_max_mb = 0;
+    if (spill_idle < SPILL_MIN_IDLE) spill_idle = SPILL_MIN_IDLE;
+    if (spill_idle > SESSION_TTL - 60) spill_idle = SESSION_TTL - 60;   /* spill before the table expires them */
     
-    srand(time(NULL));
-    memset(sessions, 0, sizeof(sessions));
+    srand(seed ? seed : (unsigned)time(NULL));
+    server_start_time = time(NULL);
+    unsetenv(UPGRADE_ENV);
+    ssize_t exe_len = readlink("/proc/self/exe", upgrade_exe, sizeof(upgrade_exe) - 1);
+    upgrade_exe[exe_len > 0 ? exe_len : 0] = '\0';
+    upgrade_argv = argv;
+    if ((inherited = shared_init(upgraded)) < 0)
+        fprintf(stderr, "No shared memory for sessions; live upgrades are disabled\n");
+    if (inherited > 0)
+        for (int i = 0; i < MAX_SESSIONS; i++) restored += sessions[i].session_id[0] != '\0';
     
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (match_log_path && (match_log_fd = matchlog_open(match_log_path)) < 0) {
+        fprintf(stderr, "Cannot open match log %s (missing permissions or not a match log)\n", match_log_path);
+        return 1;
+    }
+    if (access_log_path && (access_log_fd = access_log_open()) < 0) {
+        perror(access_log_path);
+        return 1;
+    }
+    if (capture_path && (capture_fd = capture_open()) < 0) {
+        fprintf(stderr, "Cannot open capture %s (missing permissions or not a capture file)\n", capture_path);
+        return 1;
+    }
+    if (strategy_path && strategy_load(strategy_path) < 0) {
+        fprintf(stderr, "Cannot load strategy table %s (regenerate it with handcricket_solver)\n", strategy_path);
+        return 1;
+    }
     
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(PORT);
+    {
+        static sigset_t upgrade_signals, stop_signals;
+        pthread_t tid;
+        /* Block the stop signals in every thread (before any is created); only shutdown_thread receives them */
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        if (snapshot_path || match_log_path || access_log_path || profile_path || capture_path) pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+        /* Same for SIGUSR2, which only upgrade_thread receives */
+        sigemptyset(&upgrade_signals);
+        sigaddset(&upgrade_signals, SIGUSR2);
+        pthread_sigmask(SIG_BLOCK, &upgrade_signals, NULL);
+        if (pipe(upgrade_wake) == 0) {
+            pthread_create(&tid, NULL, upgrade_thread, &upgrade_signals);
+            pthread_detach(tid);
+        }
+        if (snapshot_path || match_log_path || access_log_path || profile_path || capture_path) {
+            pthread_create(&tid, NULL, shutdown_thread, &stop_signals);
+            pthread_detach(tid);
+        }
+    }
+    if (snapshot_path) {
+        pthread_t tid;
+        if (inherited <= 0) restored = load_snapshot();
+        pthread_create(&tid, NULL, snapshot_thread, NULL);
+        pthread_detach(tid);
+    }
+    if (match_log_path) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, matchlog_thread, NULL);
+        pthread_detach(tid);
+    }
+    if (access_log_path) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, access_log_thread, NULL);
+        pthread_detach(tid);
+    }
+    if (capture_path) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, capture_thread, NULL);
+        pthread_detach(tid);
+    }
+    if (profile_path && profile_open() < 0) {
+        fprintf(stderr, "Cannot open player profiles %s (missing permissions or not a profile file)\n", profile_path);
+        return 1;
+    }
+    if (spill_path) {
+        pthread_t tid;
+        if ((spilled = spill_open()) < 0) {
+            fprintf(stderr, "Cannot open spill slab %s (missing permissions or not a spill file)\n", spill_path);
+            return 1;
+        }
+        pthread_create(&tid, NULL, spill_thread, NULL);
+        pthread_detach(tid);
+    }
+    {
+        pthread_t tid;
+        sse_init();
+        pthread_create(&tid, NULL, sse_thread, NULL);
+        pthread_detach(tid);
+        leaderboard_init();
+        pvp_init();
+        rate_init();
+        pool_init();
+        pthread_create(&tid, NULL, leaderboard_thread, NULL);
+        pthread_detach(tid);
+        if (cores > 0) owners_start(cores);
+    }
     
-    bind(server_fd, (struct sockaddr*)&addr, sizeof(addr));
-    listen(server_fd, 10);
+    if (upgraded) {
+        int accepting = 0;
+        socklen_t optlen = sizeof(accepting);
+        listen_fd = UPGRADE_LISTEN_FD;
+        if (getsockopt(listen_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &optlen) != 0 || !accepting) {
+            fprintf(stderr, "Upgrade: fd %d is not a listening socket\n", UPGRADE_LISTEN_FD);
+            return 1;
+        }
+    } else {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(PORT);
+        
+        bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+        listen(listen_fd, 10);
+    }
+    /* Both processes poll the socket during an upgrade; whichever loses an accept moves on */
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
     
     printf("\n");
     printf("╔═══════════════════════════════════════════════╗\n");
     printf("║     HAND CRICKET GAME - WEB SERVER            ║\n");
     printf("╠═══════════════════════════════════════════════╣\n");
     printf("║  Open: http://localhost:%d                   ║\n", PORT);
+    printf("║  Metrics: http://localhost:%d/metrics        ║\n", PORT);
+    printf("║  Spectate: /watch/<session> (live SSE)        ║\n");
+    printf("║  Leaderboard: /leaderboard                    ║\n");
     printf("║  Press Ctrl+C to stop                         ║\n");
     printf("╚═══════════════════════════════════════════════╝\n\n");
+    if (snapshot_path)
+        printf("Snapshots: %s every %ds (%d session(s) restored)\n", snapshot_path, snapshot_interval, restored);
+    if (match_log_path)
+        printf("Match log: %s\n", match_log_path);
+    if (strategy_table)
+        printf("Strategy table: %s (Optimal difficulty enabled)\n", strategy_path);
+    if (access_log_path) {
+        if (access_log_max_mb) printf("Access log: %s (rotated every %d MB)\n", access_log_path, access_log_max_mb);
+        else printf("Access log: %s\n", access_log_path);
+    }
+    if (spill_path) printf("Spill: %s after %ds idle (%d paused match(es) on disk)\n", spill_path, spill_idle, spilled);
+    if (profile_path) printf("Profiles: %s (Hard adapts to each player's habits)\n", profile_path);
+    if (capture_path) printf("Capture: %s (replay with handcricket_replay)\n", capture_path);
+    if (seed) printf("RNG seed: %u\n", seed);
+    if (owner_count) printf("Session owners: %d core(s), %d session slots each\n", owner_count, MAX_SESSIONS / owner_count);
+    if (ip_rate) printf("Rate limits: %d req/s per address, %d req/s per session, %d connections\n", ip_rate, SESSION_RATE, max_connections);
+    else printf("Rate limits: off, %d connections\n", max_connections);
+    if (upgraded) printf("Upgrade: took over from process %d (%d session(s))\n", (int)getppid(), inherited > 0 ? restored : 0);
+    printf("\n");
+    fflush(stdout);
+    if (upgraded) upgrade_ready();
     
     while (1) {
         struct sockaddr_in client;
         socklen_t len = sizeof(client);
-        int *sock = malloc(sizeof(int));
-        *sock = accept(server_fd, (struct sockaddr*)&client, &len);
-        if (*sock >= 0) {
-            pthread_t tid;
-            pthread_create(&tid, NULL, client_thread, sock);
-            pthread_detach(tid);
-        } else free(sock);
+        struct pollfd pfd[2] = { { listen_fd, POLLIN, 0 }, { upgrade_wake[0], POLLIN, 0 } };
+        if (poll(pfd, 2, -1) < 0) continue;
+        if (pfd[1].revents) break;
+        int sock = accept(listen_fd, (struct sockaddr*)&client, &len);
+        if (sock < 0) continue;
+        if (!admit_connection(sock)) { close(sock); continue; }
+        Conn *conn = malloc(sizeof(Conn));
+        pthread_t tid;
+        conn->sock = sock;
+        conn->ip = client.sin_addr.s_addr;
+        if (pthread_create(&tid, NULL, client_thread, conn) == 0) pthread_detach(tid);
+        else { close(sock); free(conn); release_connection(); }
     }
     
+    upgrade_drain();
     return 0;
 }
+#endif /* HANDCRICKET_NO_MAIN */